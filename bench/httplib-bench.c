@@ -0,0 +1,763 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/arena.h"
+#include "../src/http_server.h"
+#include "../src/scan.h"
+#include "../src/template.h"
+#include "../test/alloccount.h"
+
+#define RESPONSE_BODY_SIZE (1024 * 1024)
+#define CHUNK_SIZE 1024
+//Mindestlaufzeit eines Benchmarks in Sekunden, wird mit dem Faktor der Kommandozeile multipliziert.
+#define BENCH_MIN_SECONDS 0.2
+//Buchungen der Waschmaschine in den Booking-Benchmarks, eine alle BOOKING_SPACING Sekunden.
+#define BOOKING_COUNT 1000000
+#define BOOKING_SPACING 100
+//Gleichzeitig schreibende Threads in den WAL-Benchmarks und die Datei ihres Logs im Arbeitsverzeichnis.
+#define WAL_WRITERS 16
+#define WAL_BENCH_PATH "bench.wal"
+//Buchungen der Startup-Benchmarks, jede zehnte wird storniert, und die Änderungen hinter dem Snapshot.
+#define STARTUP_BOOKINGS 10000000
+#define STARTUP_TAIL 1000
+#define STARTUP_WAL_PATH "startup.wal"
+#define STARTUP_SNAPSHOT_PATH "startup.snap"
+
+/**
+ * Die frühere Implementierung von str_cat: für jedes Anhängen wird ein neuer Puffer
+ * der exakten Größe angelegt und beide Hälften byteweise kopiert.
+ */
+static void legacy_str_cat(string *dest, const char *src, size_t len) {
+    char *str = calloc(1, dest->len + len);
+    for (unsigned int i = 0; i < dest->len; i++) {
+        str[i] = dest->str[i];
+    }
+    for (unsigned int i = 0; i < len; i++) {
+        str[i + dest->len] = src[i];
+    }
+    free(dest->str);
+    dest->str = str;
+    dest->len = len + dest->len;
+}
+
+/**
+ * Die frühere Implementierung von response_string mit legacy_str_cat.
+ */
+static string *legacy_response_string(http_response *src) {
+    string *temp = str_cpy(src->protocol->str, src->protocol->len);
+    legacy_str_cat(temp, " ", 1);
+    legacy_str_cat(temp, src->status_code->str, src->status_code->len);
+    legacy_str_cat(temp, " ", 1);
+    legacy_str_cat(temp, src->status_description->str, src->status_description->len);
+    legacy_str_cat(temp, "\r\n", 2);
+    legacy_str_cat(temp, "Content-Type: ", 14);
+    legacy_str_cat(temp, src->entity_header->content_type->str, src->entity_header->content_type->len);
+    legacy_str_cat(temp, "\r\n", 2);
+    legacy_str_cat(temp, "Content-Length: ", 16);
+    string *body_len_str = number_to_str(src->body->len);
+    legacy_str_cat(temp, body_len_str->str, body_len_str->len);
+    str_free(body_len_str);
+    legacy_str_cat(temp, "\r\n", 2);
+    legacy_str_cat(temp, "\r\n", 2);
+    legacy_str_cat(temp, src->body->str, src->body->len);
+    return temp;
+}
+
+static char chunk[CHUNK_SIZE];
+
+/**
+ * Ein typischer Request von Firefox beim Laden einer Seite.
+ */
+static const char browser_request[] =
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: localhost:8080\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+        "image/png,image/svg+xml,*/*;q=0.8\r\n"
+        "Accept-Language: de,en-US;q=0.7,en;q=0.3\r\n"
+        "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+        "Referer: http://localhost:8080/\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=3f2a9c1e7b8d4f60a1c2e3d4f5061728; theme=dark; lang=de\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "Priority: u=0, i\r\n"
+        "\r\n";
+
+//Wie der lange Dateiname aus resources/index.html, einmal ohne und einmal mit Escapes.
+static char long_uri[300];
+static const char escaped_uri[] = "/images/Wohnung%20Erdgeschoss/K%C3%BCche%20und%20Bad/../"
+                                  "Gr%C3%BCndriss%20WG%20Zimmer%203%20%28renoviert%29%20-%20Ansicht%20Nord.png";
+
+//Der Inhalt von resources/debug.html, damit die Vorlagen-Benchmarks ohne DOC_ROOT laufen.
+static const char debug_page[] =
+        "<!DOCTYPE html>\n<html lang=\"de\">\n  <body>\n    <h1>Willkommen im /debug Bereich!</h1>\n"
+        "    <pre>\nHTTP-Methode: ${method}\nHTTP-Ressource: ${ressource}\nHTTP-Protokoll-Version: ${version}\n"
+        "    </pre>\n  </body>\n</html>\n";
+static const char *const debug_slots[] = {"method", "ressource", "version"};
+
+static double min_seconds = BENCH_MIN_SECONDS;
+static const char *filter = NULL;
+
+/**
+ * Verhindert, dass der Compiler ein Ergebnis wegoptimiert, das sonst niemand liest.
+ */
+static volatile size_t sink;
+
+/**
+ * Misst eine Operation und gibt eine Zeile im Format der Go-Benchmarks aus, z.B.
+ * "BenchmarkStrCat  1000000  52.1 ns/op  96 B/op  3.00 allocs/op". So lassen sich die
+ * Ergebnisse zweier Commits mit benchstat vergleichen. Die Anzahl der Durchläufe wird so
+ * lange erhöht, bis die Messung mindestens min_seconds dauert.
+ * @param name Der Name ohne "Benchmark", Varianten werden mit '/' angehängt.
+ * @param op Die Operation.
+ * @param state Wird an op übergeben.
+ */
+static void bench(const char *name, void (*op)(void *state), void *state) {
+    if (filter != NULL && strstr(name, filter) == NULL) {
+        return;
+    }
+    //ein Durchlauf zum Aufwärmen, z.B. für den Datei-Cache
+    op(state);
+    size_t n = 1;
+    for (;;) {
+        const size_t allocations = alloc_count();
+        const size_t bytes = alloc_bytes();
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < n; ++i) {
+            op(state);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        const double ns = (double) (end.tv_sec - start.tv_sec) * 1e9 + (double) (end.tv_nsec - start.tv_nsec);
+        if (ns >= min_seconds * 1e9 || n >= 1000000000) {
+            printf("Benchmark%s\t%zu\t%.1f ns/op\t%.0f B/op\t%.2f allocs/op\n", name, n, ns / (double) n,
+                   (double) (alloc_bytes() - bytes) / (double) n, (double) (alloc_count() - allocations) / (double) n);
+            fflush(stdout);
+            return;
+        }
+        //etwas mehr Durchläufe als geschätzt, höchstens hundertmal so viele wie zuletzt
+        double next = ns > 0 ? (double) n * min_seconds * 1e9 / ns * 1.2 : (double) n * 100;
+        if (next > (double) n * 100) {
+            next = (double) n * 100;
+        }
+        n = next > (double) n ? (size_t) next : n + 1;
+    }
+}
+
+static void op_str_cat(void *state) {
+    (void) state;
+    string *str = str_new();
+    for (int i = 0; i < 16; ++i) {
+        str_cat(str, "Content-Type: ", 14);
+    }
+    sink = str->len;
+    str_free(str);
+}
+
+static void op_str_split(void *state) {
+    (void) state;
+    string line = {29, "/images/wg/zimmer/3/grundriss", 0};
+    string **parts = str_split(&line, '/');
+    size_t count = 0;
+    while (parts[count] != NULL) {
+        str_free(parts[count++]);
+    }
+    sink = count;
+    arena_free(parts);
+}
+
+static void op_str_decode(void *state) {
+    string raw = {strlen(state), state, 0};
+    string *result = str_decode(&raw);
+    sink = result->len;
+    str_free(result);
+}
+
+/**
+ * Dekodiert und normalisiert eine URI auf einer Kopie im Stack wie in process().
+ */
+static void op_normalize_path(void *state) {
+    char path[1024];
+    size_t len = strlen(state);
+    memcpy(path, state, len);
+    if (http_normalize_path(path, &len) != HTTP_PATH_OK) {
+        exit(1);
+    }
+    sink = len;
+}
+
+static void op_str_replace_with(void *state) {
+    (void) state;
+    const char *text = "Hallo WG, die Miete der WG ist fällig. Gruß, die WG";
+    string *str = str_cpy(text, strlen(text));
+    str_replace_with(str, "WG", "Wohngemeinschaft");
+    sink = str->len;
+    str_free(str);
+}
+
+/**
+ * Füllt debug.html wie bisher mit str_replace_with aus, ein Aufruf pro Platzhalter.
+ */
+static void op_debug_str_replace_with(void *state) {
+    (void) state;
+    string *page = str_cpy(debug_page, sizeof(debug_page) - 1);
+    str_replace_with(page, "${method}", "GET");
+    str_replace_with(page, "${ressource}", "/debug?name=<b>");
+    str_replace_with(page, "${version}", "HTTP/1.1");
+    sink = page->len;
+    str_free(page);
+}
+
+/**
+ * Füllt die einmal geparste Vorlage von debug.html aus.
+ * @param state Die Vorlage (html_template *).
+ */
+static void op_debug_template(void *state) {
+    const str_view values[] = {{"GET", 3}, {"/debug?name=<b>", 15}, {"HTTP/1.1", 8}};
+    string *page = template_render(state, values);
+    sink = page->len;
+    str_free(page);
+}
+
+static void op_str_to_http_request(void *state) {
+    (void) state;
+    string *raw = str_cpy(browser_request, sizeof(browser_request) - 1);
+    http_request *req = str_to_http_request(raw);
+    sink = req->uri->len;
+    free_request(req);
+    str_free(raw);
+}
+
+/**
+ * Parst browser_request in zwei Hälften wie bei einem geteilten recv().
+ */
+static void op_parse_request(void *state) {
+    (void) state;
+    const size_t len = sizeof(browser_request) - 1;
+    http_request_view req;
+    http_parser parser = {0};
+    if (http_parse_request(&parser, browser_request, len / 2, &req) != HTTP_PARSE_INCOMPLETE ||
+        http_parse_request(&parser, browser_request, len, &req) != HTTP_PARSE_COMPLETE) {
+        exit(1);
+    }
+    sink = req.header_count;
+}
+
+static void op_response_string_404(void *state) {
+    (void) state;
+    http_response *resp = response_new();
+    set_response_status(resp, char_to_string("404"), char_to_string("Not Found"));
+    resp->connection = char_to_string("keep-alive");
+    set_response_default_html_body(resp);
+    string *serialized = response_string(resp);
+    sink = serialized->len;
+    str_free(serialized);
+    free_response(resp);
+}
+
+/**
+ * Baut eine Response mit 1 MiB Body aus Stücken von CHUNK_SIZE Bytes und serialisiert sie,
+ * state wählt die frühere Implementierung.
+ */
+static void op_response_string_1mb(void *state) {
+    const bool legacy = state != NULL;
+    string *body = str_new();
+    for (size_t i = 0; i < RESPONSE_BODY_SIZE / CHUNK_SIZE; ++i) {
+        (legacy ? legacy_str_cat : str_cat)(body, chunk, CHUNK_SIZE);
+    }
+    http_response *resp = response_new();
+    set_response_status(resp, char_to_string("200"), char_to_string("OK"));
+    set_response_body(resp, body, get_content_type("html", 4));
+    string *serialized = legacy ? legacy_response_string(resp) : response_string(resp);
+    sink = serialized->len;
+    str_free(serialized);
+    free_response(resp);
+}
+
+static void op_get_content_type(void *state) {
+    (void) state;
+    static const char *const endings[] = {"html", "JS", "css", "png", "jpeg", "woff2", "unknown", "ico"};
+    size_t len = 0;
+    for (size_t i = 0; i < sizeof(endings) / sizeof(endings[0]); ++i) {
+        len += get_content_type(endings[i], strlen(endings[i]))->len;
+    }
+    sink = len;
+}
+
+/**
+ * Ein Request für process() samt Kontext und Arena eines Workers.
+ */
+typedef struct process_state {
+    process_context *ctx;
+    arena *request_arena;
+    char raw[1024];
+    http_request_view request;
+} process_state;
+
+/**
+ * Parst den Request für einen process()-Benchmark, wie ihn eine Verbindung übergibt.
+ */
+static void process_state_init(process_state *state, process_context *ctx, arena *request_arena,
+                               const char *request) {
+    state->ctx = ctx;
+    state->request_arena = request_arena;
+    snprintf(state->raw, sizeof(state->raw), "%s", request);
+    http_parser parser = {0};
+    if (http_parse_request(&parser, state->raw, strlen(state->raw), &state->request) != HTTP_PARSE_COMPLETE) {
+        exit(1);
+    }
+}
+
+/**
+ * Beantwortet den Request wie eine Verbindung: process(), Header serialisieren, Arena zurücksetzen.
+ */
+static void op_process(void *arg) {
+    process_state *state = arg;
+    arena *previous = arena_use(state->request_arena);
+    bool keep_alive = true;
+    http_response *resp = process(state->ctx, &state->request, &keep_alive);
+    if (resp->prepared_header != NULL) {
+        sink = resp->prepared_header->len;
+    } else {
+        string *header = response_header_string(resp);
+        sink = header->len;
+        str_free(header);
+    }
+    free_response(resp);
+    arena_use(previous);
+    arena_reset(state->request_arena);
+}
+
+/**
+ * Eine Buchungsliste für die Booking-Benchmarks und ein Zufallsgenerator, der die angefragten
+ * Zeiten über alle Buchungen verteilt, damit nicht immer derselbe Pfad im Baum gemessen wird.
+ */
+typedef struct booking_state {
+    booking_store *store;
+    uint64_t random;
+} booking_state;
+
+/**
+ * Wählt zufällig eine der BOOKING_COUNT Buchungen (xorshift64).
+ * @return Der Anfang der Lücke vor der Buchung, die Buchung selbst beginnt BOOKING_SPACING später.
+ */
+static int64_t booking_random_slot(booking_state *state) {
+    state->random ^= state->random << 13;
+    state->random ^= state->random >> 7;
+    state->random ^= state->random << 17;
+    return (int64_t) (state->random % BOOKING_COUNT) * BOOKING_SPACING;
+}
+
+/**
+ * Versucht eine Buchung, die sich mit einer bestehenden überschneidet, und wird abgelehnt.
+ */
+static void op_booking_conflict(void *arg) {
+    booking_state *state = arg;
+    const int64_t start = booking_random_slot(state) + BOOKING_SPACING / 2;
+    booking conflict;
+    if (booking_create(state->store, 0, start, start + 10, "bench", 5, NULL, &conflict, NULL) != BOOKING_CONFLICT) {
+        exit(1);
+    }
+    sink = (size_t) conflict.id;
+}
+
+/**
+ * Bucht eine freie Lücke zwischen zwei Buchungen und storniert sie wieder.
+ */
+static void op_booking_create_cancel(void *arg) {
+    booking_state *state = arg;
+    const int64_t start = booking_random_slot(state) + BOOKING_SPACING - 5;
+    booking created;
+    if (booking_create(state->store, 0, start, start + 5, "bench", 5, &created, NULL, NULL) != BOOKING_OK) {
+        exit(1);
+    }
+    booking_cancel(state->store, created.id, NULL, NULL);
+    sink = (size_t) created.id;
+}
+
+/**
+ * Fragt ab, wer die Waschmaschine in einem Fenster über zehn Buchungen hat.
+ */
+static void op_booking_query(void *arg) {
+    booking_state *state = arg;
+    const int64_t start = booking_random_slot(state);
+    booking found[16];
+    sink = booking_list(state->store, 0, start, start + 10 * BOOKING_SPACING, found, 16);
+}
+
+/**
+ * Die Booking-Benchmarks auf einer Waschmaschine mit BOOKING_COUNT Buchungen unterschiedlicher
+ * Länge. Konfliktprüfung und Abfrage sollen trotz der Menge im Bereich von Mikrosekunden bleiben.
+ * @return Die Buchungen, für die process()-Benchmarks der API.
+ */
+static booking_store *bench_booking(void) {
+    booking_store *store = booking_store_new();
+    for (int64_t i = 0; i < BOOKING_COUNT; ++i) {
+        const int64_t start = i * BOOKING_SPACING + BOOKING_SPACING / 4;
+        const int64_t length = BOOKING_SPACING / 2 + i % (BOOKING_SPACING / 5);
+        if (booking_create(store, 0, start, start + length, "bench", 5, NULL, NULL, NULL) != BOOKING_OK) {
+            exit(1);
+        }
+    }
+    booking_state state = {store, 88172645463325252ULL};
+    bench("Booking/conflict_1M", op_booking_conflict, &state);
+    bench("Booking/create_cancel_1M", op_booking_create_cancel, &state);
+    bench("Booking/query_1M", op_booking_query, &state);
+    return store;
+}
+
+/**
+ * Eine Abfrage freier Zeiten für die Availability-Benchmarks.
+ */
+typedef struct availability_state {
+    booking_store *store;
+    int64_t start;
+    int64_t end;
+    int64_t duration;
+} availability_state;
+
+/**
+ * Sucht, wann Gästezimmer und Küche zugleich frei sind.
+ */
+static void op_free_slots(void *arg) {
+    availability_state *state = arg;
+    static const unsigned int resources[] = {2, 3};
+    booking_window windows[256];
+    sink = booking_free_slots(state->store, resources, 2, state->start, state->end, state->duration, windows, 256);
+}
+
+/**
+ * Die Availability-Benchmarks: Gästezimmer und Küche sind 2026 zufällig gebucht, eine Viertelstunde
+ * bis vier Stunden mit Lücken bis sechs Stunden. Gesucht werden gemeinsame freie Zeiten in einer
+ * Woche und in einem Jahr, mit jeder Implementierung von scan_bitmap_nor.
+ */
+static void bench_availability(void) {
+    static const char *const level_names[] = {"scalar", "sse2", "avx2"};
+    const int64_t year = 1767225600;
+    booking_store *store = booking_store_new();
+    uint64_t random = 88172645463325252ULL;
+    for (unsigned int resource = 2; resource < 4; ++resource) {
+        for (int64_t start = year; start < year + 365 * 86400;) {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            const int64_t length = (int64_t) (1 + random % 16) * 900;
+            booking_create(store, resource, start, start + length, "bench", 5, NULL, NULL, NULL);
+            start += length + (int64_t) (random >> 32) % (6 * 3600);
+        }
+    }
+    const scan_level best = scan_get_level();
+    const scan_level levels[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+        if (!scan_set_level(levels[i])) {
+            continue;
+        }
+        char name[64];
+        availability_state week = {store, year + 100 * 86400, year + 107 * 86400, 2 * 3600};
+        snprintf(name, sizeof(name), "Availability/week_%s", level_names[levels[i]]);
+        bench(name, op_free_slots, &week);
+        availability_state whole = {store, year, year + 365 * 86400, 8 * 3600};
+        snprintf(name, sizeof(name), "Availability/year_%s", level_names[levels[i]]);
+        bench(name, op_free_slots, &whole);
+    }
+    scan_set_level(best);
+    booking_store_free(store);
+}
+
+/**
+ * Die Schreiber eines WAL-Benchmarks: in jeder Runde hängt jeder Schreiber einen Eintrag an und
+ * wartet, bis er dauerhaft ist, wie ein Worker mit einer Buchung.
+ */
+typedef struct wal_state {
+    wal *log;
+    size_t writers;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    bool stop;
+} wal_state;
+
+static void *wal_writer(void *arg) {
+    wal_state *state = arg;
+    //ein Eintrag in der Größe einer Buchung
+    static const char record[48] = "bench";
+    for (;;) {
+        pthread_barrier_wait(&state->start);
+        if (state->stop) {
+            return NULL;
+        }
+        wal_wait(state->log, wal_append(state->log, record, sizeof(record)));
+        pthread_barrier_wait(&state->done);
+    }
+}
+
+/**
+ * Eine Runde: alle Schreiber hängen gleichzeitig einen Eintrag an und warten auf das Log.
+ */
+static void op_wal_round(void *arg) {
+    wal_state *state = arg;
+    pthread_barrier_wait(&state->start);
+    pthread_barrier_wait(&state->done);
+}
+
+/**
+ * Die WAL-Benchmarks: eine Runde mit einem und mit WAL_WRITERS Schreibern, jeweils mit Group
+ * Commit und mit einem fdatasync() pro Eintrag. Ein op ist eine ganze Runde, mit Group Commit
+ * kosten WAL_WRITERS Einträge kaum mehr als einer.
+ */
+static void bench_wal(void) {
+    static const char *const names[] = {"none", "group", "sync"};
+    const wal_durability modes[] = {WAL_DURABILITY_GROUP, WAL_DURABILITY_SYNC};
+    const size_t writer_counts[] = {1, WAL_WRITERS};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        for (size_t w = 0; w < sizeof(writer_counts) / sizeof(writer_counts[0]); ++w) {
+            char name[64];
+            snprintf(name, sizeof(name), "WAL/%s_%zu", names[modes[m]], writer_counts[w]);
+            if (filter != NULL && strstr(name, filter) == NULL) {
+                continue;
+            }
+            unlink(WAL_BENCH_PATH);
+            wal_state state = {wal_open(WAL_BENCH_PATH, modes[m], 0, NULL, NULL), writer_counts[w], {{0}}, {{0}},
+                               false};
+            if (state.log == NULL) {
+                fprintf(stderr, "ERROR opening %s in the working directory\n", WAL_BENCH_PATH);
+                exit(1);
+            }
+            pthread_t threads[WAL_WRITERS];
+            pthread_barrier_init(&state.start, NULL, (unsigned int) state.writers + 1);
+            pthread_barrier_init(&state.done, NULL, (unsigned int) state.writers + 1);
+            for (size_t i = 0; i < state.writers; ++i) {
+                pthread_create(&threads[i], NULL, wal_writer, &state);
+            }
+            bench(name, op_wal_round, &state);
+            state.stop = true;
+            pthread_barrier_wait(&state.start);
+            for (size_t i = 0; i < state.writers; ++i) {
+                pthread_join(threads[i], NULL);
+            }
+            pthread_barrier_destroy(&state.start);
+            pthread_barrier_destroy(&state.done);
+            wal_close(state.log);
+        }
+    }
+    unlink(WAL_BENCH_PATH);
+}
+
+/**
+ * Misst eine Operation, die zu lange dauert, um sie wie bench wiederholt auszuführen, genau
+ * einmal und gibt sie im selben Format aus.
+ * @param name Der Name ohne "Benchmark".
+ * @param op Die Operation.
+ * @param state Wird an op übergeben.
+ */
+static void bench_once(const char *name, void (*op)(void *state), void *state) {
+    const size_t allocations = alloc_count();
+    const size_t bytes = alloc_bytes();
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    op(state);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double ns = (double) (end.tv_sec - start.tv_sec) * 1e9 + (double) (end.tv_nsec - start.tv_nsec);
+    printf("Benchmark%s\t1\t%.1f ns/op\t%.0f B/op\t%.2f allocs/op\n", name, ns, (double) (alloc_bytes() - bytes),
+           (double) (alloc_count() - allocations));
+    fflush(stdout);
+}
+
+/**
+ * Der Zustand der Startup-Benchmarks: der Store, der gerade geladen wurde.
+ */
+typedef struct startup_state {
+    booking_store *store;
+} startup_state;
+
+/**
+ * Startet wie der Server ohne Snapshot: das ganze Log wird nachgespielt.
+ */
+static void op_startup_wal(void *arg) {
+    startup_state *state = arg;
+    state->store = booking_store_new();
+    if (!booking_store_open_log(state->store, STARTUP_WAL_PATH, WAL_DURABILITY_GROUP)) {
+        exit(1);
+    }
+    booking found;
+    sink = booking_get(state->store, STARTUP_BOOKINGS / 2, &found);
+}
+
+/**
+ * Startet wie der Server: der Snapshot wird gemappt, nur die Änderungen dahinter nachgespielt.
+ */
+static void op_startup_snapshot(void *arg) {
+    startup_state *state = arg;
+    state->store = booking_store_new();
+    if (!booking_store_open_snapshot(state->store, STARTUP_SNAPSHOT_PATH)
+        || !booking_store_open_log(state->store, STARTUP_WAL_PATH, WAL_DURABILITY_GROUP)) {
+        exit(1);
+    }
+    booking found;
+    sink = booking_get(state->store, STARTUP_BOOKINGS / 2, &found);
+}
+
+static void op_snapshot_write(void *arg) {
+    startup_state *state = arg;
+    if (!booking_store_snapshot(state->store, STARTUP_SNAPSHOT_PATH)) {
+        fprintf(stderr, "ERROR writing %s in the working directory\n", STARTUP_SNAPSHOT_PATH);
+        exit(1);
+    }
+}
+
+/**
+ * Die Startup-Benchmarks: STARTUP_BOOKINGS Buchungen der vier Ressourcen stehen im Log, danach
+ * ein Snapshot und STARTUP_TAIL weitere Änderungen. Gemessen wird einmal das Schreiben des
+ * Snapshots und der Start bis zur ersten Abfrage, einmal aus dem ganzen Log und einmal aus dem
+ * Snapshot mit dem Rest des Logs. Die Dateien liegen im Arbeitsverzeichnis und im Page-Cache.
+ */
+static void bench_startup(void) {
+    if (filter != NULL && strstr(filter, "Startup") == NULL) {
+        return;
+    }
+    unlink(STARTUP_WAL_PATH);
+    unlink(STARTUP_SNAPSHOT_PATH);
+    startup_state state = {booking_store_new()};
+    if (!booking_store_open_log(state.store, STARTUP_WAL_PATH, WAL_DURABILITY_NONE)) {
+        fprintf(stderr, "ERROR opening %s in the working directory\n", STARTUP_WAL_PATH);
+        exit(1);
+    }
+    const int64_t history = 1577836800;
+    for (uint64_t i = 0; i < STARTUP_BOOKINGS; ++i) {
+        const int64_t start = history + (int64_t) (i / BOOKING_RESOURCE_COUNT) * 600;
+        booking_create(state.store, (unsigned int) (i % BOOKING_RESOURCE_COUNT), start, start + 300, "bench", 5,
+                       NULL, NULL, NULL);
+        if (i % 10 == 9) {
+            booking_cancel(state.store, i + 1, NULL, NULL);
+        }
+    }
+    bench_once("Startup/snapshot_write_10M", op_snapshot_write, &state);
+    for (int64_t i = 0; i < STARTUP_TAIL; ++i) {
+        booking_create(state.store, 0, BOOKING_MAX_END - (i + 1) * 600, BOOKING_MAX_END - i * 600, "tail", 4, NULL,
+                       NULL, NULL);
+    }
+    booking_store_free(state.store);
+
+    bench_once("Startup/wal_replay_10M", op_startup_wal, &state);
+    booking_store_free(state.store);
+    bench_once("Startup/snapshot_10M", op_startup_snapshot, &state);
+    booking_store_free(state.store);
+    unlink(STARTUP_WAL_PATH);
+    unlink(STARTUP_SNAPSHOT_PATH);
+}
+
+/**
+ * Die process()-Benchmarks. Sie lesen Dateien aus DOC_ROOT, das Programm muss also wie der
+ * Server aus dem Build-Verzeichnis gestartet werden.
+ * @param bookings Die Buchungen für die Requests an die API.
+ */
+static void bench_process(booking_store *bookings) {
+    doc_root *root = doc_root_open(DOC_ROOT);
+    if (root == NULL) {
+        fprintf(stderr, "ERROR opening document root %s, run from the build directory\n", DOC_ROOT);
+        exit(1);
+    }
+    canned_responses_init();
+    process_context ctx = {file_cache_new(FILE_CACHE_DEFAULT_BUDGET), root, MAX_HEADER_BYTES, MAX_BODY_BYTES,
+                           debug_page_open(), bookings};
+    arena *request_arena = arena_new(ARENA_DEFAULT_SIZE);
+    static const char *const cases[][2] = {
+            {"Process/cache_hit",    "GET /images/tux.jpg HTTP/1.1\r\nHost: x\r\n\r\n"},
+            {"Process/not_modified", "GET /images/tux.jpg HTTP/1.1\r\nHost: x\r\n"
+                                     "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n\r\n"},
+            {"Process/range",        "GET /images/tux.jpg HTTP/1.1\r\nHost: x\r\nRange: bytes=100-199\r\n\r\n"},
+            {"Process/multipart",    "GET /images/tux.jpg HTTP/1.1\r\nHost: x\r\nRange: bytes=0-99,-100\r\n\r\n"},
+            {"Process/not_found",    "GET /images/fehlt.png HTTP/1.1\r\nHost: x\r\n\r\n"},
+            {"Process/forbidden",    "GET /images/../../CMakeLists.txt HTTP/1.1\r\nHost: x\r\n\r\n"},
+            {"Process/redirect",     "GET / HTTP/1.1\r\nHost: x\r\n\r\n"},
+            {"Process/debug",        "GET /debug HTTP/1.1\r\nHost: x\r\n\r\n"},
+            {"Process/api_list",     "GET /api/bookings?resource=waschmaschine&from=5000000&to=5001000 HTTP/1.1\r\n"
+                                     "Host: x\r\n\r\n"},
+            {"Process/api_free",     "GET /api/free?resources=waschmaschine,kueche&from=5000000&to=5604800 HTTP/1.1\r\n"
+                                     "Host: x\r\n\r\n"},
+            {"Process/api_conflict", "POST /api/bookings HTTP/1.1\r\nHost: x\r\n"
+                                     "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 55\r\n\r\n"
+                                     "resource=waschmaschine&start=5000000&end=5000100&name=X"},
+    };
+    process_state state;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        process_state_init(&state, &ctx, request_arena, cases[i][1]);
+        bench(cases[i][0], op_process, &state);
+    }
+    arena_destroy(request_arena);
+    file_cache_free(ctx.files);
+    doc_root_close(root);
+    template_file_close(ctx.debug_page);
+}
+
+/**
+ * Micro-Benchmarks für stringstructlib, httplib, die Buchungen, das Write-Ahead-Log, den Start aus
+ * einem Snapshot und process(). Jede Zeile hat das
+ * Format der Go-Benchmarks, zum Vergleichen zweier Commits z.B.:
+ *   ./wg_buchungstool_backend_bench > bench_output.txt
+ *   benchstat alt.txt bench_output.txt
+ * Aufruf: httplib-bench [Faktor für die Mindestlaufzeit] [Teil des Namens, z.B. Process]
+ */
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        const double scale = strtod(argv[1], NULL);
+        if (scale > 0) {
+            min_seconds *= scale;
+        }
+    }
+    if (argc > 2) {
+        filter = argv[2];
+    }
+    memset(chunk, 'x', sizeof(chunk));
+    memcpy(long_uri, "/images/", 8);
+    memset(long_uri + 8, 'a', 250);
+    memcpy(long_uri + 258, ".png", 5);
+
+    static const char *const scan_names[] = {"scalar", "sse2", "avx2"};
+    const scan_level best = scan_get_level();
+    printf("pkg: wg_buchungstool_backend\nscan: %s\n", scan_names[best]);
+
+    bench("StrCat", op_str_cat, NULL);
+    bench("StrSplit", op_str_split, NULL);
+    bench("StrDecode/long", op_str_decode, long_uri);
+    bench("StrDecode/escaped", op_str_decode, (void *) escaped_uri);
+    bench("NormalizePath/long", op_normalize_path, long_uri);
+    bench("NormalizePath/escaped", op_normalize_path, (void *) escaped_uri);
+    bench("StrReplaceWith", op_str_replace_with, NULL);
+    bench("DebugPage/str_replace_with", op_debug_str_replace_with, NULL);
+    html_template *debug_template = template_parse(debug_page, sizeof(debug_page) - 1, debug_slots, 3);
+    bench("DebugPage/template", op_debug_template, debug_template);
+    template_free(debug_template);
+    bench("StrToHttpRequest", op_str_to_http_request, NULL);
+    const scan_level levels[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "ParseRequest/%s", scan_names[levels[i]]);
+        if (scan_set_level(levels[i])) {
+            bench(name, op_parse_request, NULL);
+        }
+    }
+    scan_set_level(best);
+    bench("ResponseString/404", op_response_string_404, NULL);
+    bench("ResponseString/1MiB", op_response_string_1mb, NULL);
+    bench("ResponseString/1MiB_legacy", op_response_string_1mb, (void *) "legacy");
+    bench("GetContentType", op_get_content_type, NULL);
+    bench_availability();
+    bench_wal();
+    bench_startup();
+    booking_store *bookings = bench_booking();
+    bench_process(bookings);
+    booking_store_free(bookings);
+    return 0;
+}
@@ -0,0 +1,644 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PORT 31337
+#define MAX_EVENTS 256
+#define READ_BUFFER 65536
+//Größe des Puffers für den Header einer Response, die Header des Servers sind deutlich kürzer
+#define RESPONSE_HEADER_MAX 2048
+#define REQUEST_MAX 1024
+//Maximale Anzahl an Einträgen im Request-Mix
+#define MIX_MAX 16
+#define DEFAULT_MIX "index=30,image=20,png=10,pdf=5,404=10,redirect=10,304=5,index:close=10"
+
+/*
+ * Histogramm nach dem Vorbild von HdrHistogram: Werte unter 2 * HISTOGRAM_SUB werden exakt
+ * gezählt, darüber teilt sich jede Zweierpotenz in HISTOGRAM_SUB gleich breite Buckets. Der
+ * relative Fehler ist damit kleiner als 1 / HISTOGRAM_SUB (< 0,8 %), für Werte bis 2^64 ns.
+ */
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_SUB (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (2 * HISTOGRAM_SUB + (63 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB)
+
+typedef struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} histogram;
+
+/**
+ * Eine Vorlage für einen Request: der Pfad und zusätzliche Header.
+ */
+typedef struct request_template {
+    const char *name;
+    const char *path;
+    const char *headers;
+} request_template;
+
+static const request_template builtin_templates[] = {
+        {"index", "/index.html", ""},
+        {"image", "/images/tux.jpg", ""},
+        {"png", "/images/tux.png", ""},
+        {"pdf", "/latex.pdf", ""},
+        {"404", "/gibt-es-nicht.html", ""},
+        {"redirect", "/", ""},
+        {"304", "/index.html", "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n"},
+        {"range", "/latex.pdf", "Range: bytes=0-1023\r\n"},
+};
+
+/**
+ * Ein Eintrag des Request-Mix mit dem fertigen Request und seiner Statistik.
+ */
+typedef struct mix_entry {
+    char name[64];
+    unsigned long weight;
+    //Connection: close statt keep-alive
+    bool close;
+    char request[REQUEST_MAX];
+    size_t request_len;
+    size_t bytes;
+    size_t errors;
+    histogram latency;
+} mix_entry;
+
+typedef enum response_state {
+    RESPONSE_PENDING,
+    RESPONSE_DONE,
+    RESPONSE_ERROR
+} response_state;
+
+/**
+ * Ein simulierter Client. Er sendet einen Request, wartet auf die vollständige Response und
+ * sendet erst dann den nächsten (closed loop). Bei keep-alive bleibt die Verbindung offen,
+ * das Ende einer Response wird über Content-Length erkannt.
+ */
+typedef struct client {
+    int fd;
+    mix_entry *entry;
+    size_t sent;
+    char header[RESPONSE_HEADER_MAX];
+    size_t header_len;
+    bool header_done;
+    //Response ohne Content-Length, sie endet mit der Verbindung
+    bool until_close;
+    //Der Server hat Connection: close geantwortet
+    bool server_close;
+    size_t body_left;
+    size_t received;
+    struct timespec started;
+} client;
+
+static mix_entry mix[MIX_MAX];
+static size_t mix_count;
+static unsigned long mix_total_weight;
+
+static uint64_t random_state = 1;
+static size_t connects;
+static size_t statuses[6];
+
+/**
+ * Gibt eine Fehlermeldung *msg* aus und beendet das Programm.
+ * @param msg Die Fehlermeldung.
+ */
+static void error(char *msg) {
+    fprintf(stderr, "%s", msg);
+    if (errno) {
+        fprintf(stderr, ", errno: %s", strerror(errno));
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+/**
+ * Gibt die Zeit zwischen *start* und *end* in Nanosekunden zurück.
+ */
+static uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (uint64_t) ((end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec));
+}
+
+/**
+ * Gibt den Bucket für den Wert *value* zurück.
+ */
+static size_t histogram_index(uint64_t value) {
+    if (value < 2 * HISTOGRAM_SUB) {
+        return (size_t) value;
+    }
+    const unsigned int shift = (unsigned int) (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+    const uint64_t sub = value >> shift;
+    return 2 * HISTOGRAM_SUB + (shift - 1) * HISTOGRAM_SUB + (size_t) (sub - HISTOGRAM_SUB);
+}
+
+/**
+ * Gibt den größten Wert zurück, der in den Bucket *index* fällt.
+ */
+static uint64_t histogram_value(size_t index) {
+    if (index < 2 * HISTOGRAM_SUB) {
+        return index;
+    }
+    const size_t shift = (index - 2 * HISTOGRAM_SUB) / HISTOGRAM_SUB + 1;
+    const uint64_t sub = HISTOGRAM_SUB + (index - 2 * HISTOGRAM_SUB) % HISTOGRAM_SUB;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void histogram_record(histogram *h, uint64_t value) {
+    h->counts[histogram_index(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/**
+ * Addiert das Histogramm *from* zu *to*.
+ */
+static void histogram_add(histogram *to, const histogram *from) {
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        to->counts[i] += from->counts[i];
+    }
+    to->total += from->total;
+    to->sum += from->sum;
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+}
+
+/**
+ * Gibt das p-Perzentil in Mikrosekunden zurück, auf die Genauigkeit eines Buckets.
+ */
+static double histogram_percentile(const histogram *h, double p) {
+    if (h->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (p / 100.0 * (double) h->total + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            const uint64_t value = histogram_value(i);
+            return (double) (value < h->max ? value : h->max) / 1e3;
+        }
+    }
+    return (double) h->max / 1e3;
+}
+
+/**
+ * xorshift64*, damit ein Lauf mit gleichem Seed denselben Mix sendet.
+ */
+static uint64_t next_random(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 2685821657736338717ULL;
+}
+
+/**
+ * Wählt einen Eintrag des Mix entsprechend seinem Gewicht.
+ */
+static mix_entry *pick_entry(void) {
+    unsigned long ticket = (unsigned long) (next_random() % mix_total_weight);
+    for (size_t i = 0; i < mix_count; ++i) {
+        if (ticket < mix[i].weight) {
+            return &mix[i];
+        }
+        ticket -= mix[i].weight;
+    }
+    return &mix[mix_count - 1];
+}
+
+/**
+ * Fügt einen Eintrag "name[:close]=gewicht" zum Mix hinzu. *name* ist eine der eingebauten
+ * Vorlagen oder ein Pfad, der mit / beginnt.
+ * @return 0 wenn der Eintrag ungültig ist.
+ */
+static short mix_add(const char *spec, size_t len) {
+    const char *equals = memchr(spec, '=', len);
+    size_t name_len = equals != NULL ? (size_t) (equals - spec) : len;
+    unsigned long weight = 1;
+    if (equals != NULL) {
+        char *end;
+        weight = strtoul(equals + 1, &end, 10);
+        if (end != spec + len || weight == 0) {
+            return 0;
+        }
+    }
+    if (mix_count == MIX_MAX || name_len == 0 || name_len >= sizeof(mix[0].name)) {
+        return 0;
+    }
+    mix_entry *entry = &mix[mix_count];
+    memcpy(entry->name, spec, name_len);
+    entry->name[name_len] = '\0';
+    entry->weight = weight;
+    char *suffix = strstr(entry->name, ":close");
+    entry->close = suffix != NULL && suffix[6] == '\0';
+    char base[sizeof(entry->name)];
+    snprintf(base, sizeof(base), "%.*s", (int) (entry->close ? (size_t) (suffix - entry->name) : name_len),
+             entry->name);
+
+    const request_template *template = NULL;
+    request_template custom = {base, base, ""};
+    if (base[0] == '/') {
+        template = &custom;
+    }
+    for (size_t i = 0; template == NULL && i < sizeof(builtin_templates) / sizeof(builtin_templates[0]); ++i) {
+        if (strcmp(base, builtin_templates[i].name) == 0) {
+            template = &builtin_templates[i];
+        }
+    }
+    if (template == NULL) {
+        return 0;
+    }
+    const int written = snprintf(entry->request, sizeof(entry->request),
+                                 "GET %s HTTP/1.1\r\nHost: localhost:%d\r\nUser-Agent: wg-loadgen\r\n%sConnection: %s\r\n\r\n",
+                                 template->path, PORT, template->headers, entry->close ? "close" : "keep-alive");
+    if (written < 0 || (size_t) written >= sizeof(entry->request)) {
+        return 0;
+    }
+    entry->request_len = (size_t) written;
+    mix_total_weight += weight;
+    mix_count++;
+    return 1;
+}
+
+/**
+ * Liest den Mix aus einer kommagetrennten Liste, z.B. "index=80,404=20".
+ * @return 0 wenn die Liste ungültig ist.
+ */
+static short mix_parse(const char *spec) {
+    while (*spec != '\0') {
+        const char *comma = strchr(spec, ',');
+        const size_t len = comma != NULL ? (size_t) (comma - spec) : strlen(spec);
+        if (!mix_add(spec, len)) {
+            fprintf(stderr, "invalid mix entry: %.*s\n", (int) len, spec);
+            return 0;
+        }
+        spec += len + (comma != NULL);
+    }
+    return mix_count > 0;
+}
+
+/**
+ * Startet einen neuen nicht-blockierenden Verbindungsaufbau für den Client.
+ */
+static void client_connect(client *c, int epollfd) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(PORT);
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+        error("ERROR opening socket");
+    }
+    connects++;
+    if (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        error("ERROR on connect");
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = c;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, c->fd, &event) < 0) {
+        error("ERROR on epoll_ctl");
+    }
+}
+
+/**
+ * Beginnt den nächsten Request des Clients, bei Bedarf auf einer neuen Verbindung.
+ * Die Latenz enthält bei einer neuen Verbindung auch den Verbindungsaufbau.
+ */
+static void client_start(client *c, int epollfd) {
+    clock_gettime(CLOCK_MONOTONIC, &c->started);
+    c->entry = pick_entry();
+    c->sent = 0;
+    c->header_len = 0;
+    c->header_done = false;
+    c->until_close = false;
+    c->server_close = false;
+    c->body_left = 0;
+    c->received = 0;
+    if (c->fd < 0) {
+        client_connect(c, epollfd);
+    }
+}
+
+/**
+ * Schließt die Verbindung des Clients.
+ */
+static void client_close(client *c) {
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+/**
+ * Beendet den aktuellen Request eines Clients und hält die Latenz fest.
+ * @param ok 0 wenn der Request fehlgeschlagen ist.
+ */
+static void client_finish(client *c, short ok) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (ok) {
+        histogram_record(&c->entry->latency, elapsed_ns(&c->started, &now));
+        c->entry->bytes += c->received;
+    } else {
+        c->entry->errors++;
+    }
+    if (!ok || c->entry->close || c->server_close || c->until_close) {
+        client_close(c);
+    }
+}
+
+/**
+ * Liest Status, Content-Length und Connection aus dem Header einer Response.
+ * @param len Länge des Headers inklusive der leeren Zeile
+ * @return 0 wenn der Header ungültig ist.
+ */
+static short parse_response_header(client *c, size_t len) {
+    if (len < 12 || strncmp(c->header, "HTTP/1.", 7) != 0) {
+        return 0;
+    }
+    const int status = atoi(c->header + 9);
+    if (status < 100 || status > 599) {
+        return 0;
+    }
+    statuses[status / 100]++;
+    bool has_length = false;
+    const char *line = (const char *) memchr(c->header, '\n', len) + 1;
+    const char *end = c->header + len;
+    while (line < end) {
+        const char *next = memchr(line, '\n', (size_t) (end - line));
+        if (next == NULL) {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            c->body_left = strtoul(line + 15, NULL, 10);
+            has_length = true;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char *value = line + 11;
+            while (*value == ' ') {
+                value++;
+            }
+            c->server_close = strncasecmp(value, "close", 5) == 0;
+        }
+        line = next + 1;
+    }
+    if (status == 304 || status == 204 || status < 200) {
+        c->body_left = 0;
+    } else if (!has_length) {
+        c->until_close = true;
+    }
+    return 1;
+}
+
+/**
+ * Verarbeitet empfangene Bytes einer Response.
+ */
+static response_state client_consume(client *c, const char *data, size_t len) {
+    if (!c->header_done) {
+        const size_t old_len = c->header_len;
+        size_t take = sizeof(c->header) - old_len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(c->header + old_len, data, take);
+        c->header_len += take;
+        const size_t from = old_len > 3 ? old_len - 3 : 0;
+        const char *end = memmem(c->header + from, c->header_len - from, "\r\n\r\n", 4);
+        if (end == NULL) {
+            return c->header_len == sizeof(c->header) ? RESPONSE_ERROR : RESPONSE_PENDING;
+        }
+        const size_t header_size = (size_t) (end + 4 - c->header);
+        if (!parse_response_header(c, header_size)) {
+            return RESPONSE_ERROR;
+        }
+        c->header_done = true;
+        c->received = header_size;
+        data += header_size - old_len;
+        len -= header_size - old_len;
+    }
+    c->received += len;
+    if (c->until_close) {
+        return RESPONSE_PENDING;
+    }
+    if (len > c->body_left) {
+        //Mehr Daten als angekündigt, ohne Pipelining darf das nicht passieren
+        return RESPONSE_ERROR;
+    }
+    c->body_left -= len;
+    return c->body_left == 0 ? RESPONSE_DONE : RESPONSE_PENDING;
+}
+
+/**
+ * Schreibt den Request und liest die Response, so weit der Socket es erlaubt.
+ * @return RESPONSE_PENDING solange der Request läuft, sonst RESPONSE_DONE bzw. RESPONSE_ERROR;
+ * der Request ist dann mit client_finish() abgeschlossen.
+ */
+static response_state client_progress(client *c) {
+    static char buffer[READ_BUFFER];
+    while (c->sent < c->entry->request_len) {
+        ssize_t length = send(c->fd, c->entry->request + c->sent, c->entry->request_len - c->sent, MSG_NOSIGNAL);
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return RESPONSE_PENDING;
+            }
+            client_finish(c, 0);
+            return RESPONSE_ERROR;
+        }
+        c->sent += (size_t) length;
+    }
+    while (1) {
+        ssize_t length = read(c->fd, buffer, sizeof(buffer));
+        if (length > 0) {
+            const response_state state = client_consume(c, buffer, (size_t) length);
+            if (state != RESPONSE_PENDING) {
+                client_finish(c, state == RESPONSE_DONE);
+                return state;
+            }
+        } else if (length == 0) {
+            const short ok = c->header_done && c->until_close;
+            client_finish(c, ok);
+            return ok ? RESPONSE_DONE : RESPONSE_ERROR;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return RESPONSE_PENDING;
+        } else {
+            client_finish(c, 0);
+            return RESPONSE_ERROR;
+        }
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-c connections] [-n requests | -d seconds] [-m mix] [-s seed] "
+                    "[connections] [requests]\n", program);
+    fprintf(stderr, "  mix: comma separated name[:close]=weight, default %s\n", DEFAULT_MIX);
+    fprintf(stderr, "  names:");
+    for (size_t i = 0; i < sizeof(builtin_templates) / sizeof(builtin_templates[0]); ++i) {
+        fprintf(stderr, " %s (%s)", builtin_templates[i].name, builtin_templates[i].path);
+    }
+    fprintf(stderr, " or a path starting with /\n");
+}
+
+/**
+ * Ein geschlossener Lastgenerator: *connections* Clients senden gleichzeitig Requests aus dem
+ * Mix an den Server auf localhost:PORT, bis insgesamt *requests* Requests beantwortet wurden
+ * oder *seconds* Sekunden vergangen sind.
+ * Aufruf: loadgen [-c Verbindungen] [-n Requests | -d Sekunden] [-m Mix] [-s Seed]
+ */
+int main(int argc, char *argv[]) {
+    size_t connections = 1000;
+    size_t requests = 100000;
+    double seconds_limit = 0;
+    const char *mix_spec = DEFAULT_MIX;
+    int option;
+    while ((option = getopt(argc, argv, "c:n:d:m:s:h")) != -1) {
+        switch (option) {
+            case 'c':
+                connections = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                requests = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                seconds_limit = strtod(optarg, NULL);
+                break;
+            case 'm':
+                mix_spec = optarg;
+                break;
+            case 's':
+                random_state = strtoull(optarg, NULL, 10) | 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    //Die alte Form "loadgen [Verbindungen] [Requests]" funktioniert weiterhin
+    if (optind < argc) {
+        connections = strtoul(argv[optind++], NULL, 10);
+    }
+    if (optind < argc) {
+        requests = strtoul(argv[optind++], NULL, 10);
+    }
+    if (optind < argc || connections == 0 || requests == 0 || seconds_limit < 0 || !mix_parse(mix_spec)) {
+        usage(argv[0]);
+        return 1;
+    }
+    const bool timed = seconds_limit > 0;
+    if (!timed && connections > requests) {
+        connections = requests;
+    }
+
+    client *clients = calloc(connections, sizeof(client));
+    const int epollfd = epoll_create1(0);
+    if (clients == NULL || epollfd < 0) {
+        error("ERROR on setup");
+    }
+
+    struct timespec start;
+    struct timespec now;
+    size_t started = 0;
+    size_t in_flight = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const uint64_t deadline = (uint64_t) (seconds_limit * 1e9);
+    for (size_t i = 0; i < connections; ++i) {
+        clients[i].fd = -1;
+        client_start(&clients[i], epollfd);
+        started++;
+        in_flight++;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (in_flight > 0) {
+        int count = epoll_wait(epollfd, events, MAX_EVENTS, 5000);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("ERROR on epoll_wait");
+        }
+        if (count == 0) {
+            fprintf(stderr, "timeout: no progress for 5s\n");
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const bool more = timed ? elapsed_ns(&start, &now) < deadline : started < requests;
+        for (int i = 0; i < count; ++i) {
+            client *c = events[i].data.ptr;
+            //Bei keep-alive geht es auf derselben Verbindung sofort weiter
+            while (client_progress(c) != RESPONSE_PENDING) {
+                in_flight--;
+                if (!more || (!timed && started >= requests)) {
+                    client_close(c);
+                    break;
+                }
+                const bool reconnect = c->fd < 0;
+                client_start(c, epollfd);
+                started++;
+                in_flight++;
+                if (reconnect) {
+                    break;
+                }
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    histogram *total = calloc(1, sizeof(histogram));
+    if (total == NULL) {
+        error("ERROR on setup");
+    }
+    size_t bytes = 0;
+    size_t errors = 0;
+    for (size_t i = 0; i < mix_count; ++i) {
+        histogram_add(total, &mix[i].latency);
+        bytes += mix[i].bytes;
+        errors += mix[i].errors;
+    }
+    const double seconds = (double) elapsed_ns(&start, &now) / 1e9;
+    printf("connections: %zu (%zu connects)\n", connections, connects);
+    printf("requests:    %llu (%zu errors, %zu in flight)\n", (unsigned long long) total->total, errors, in_flight);
+    printf("status:      1xx %zu, 2xx %zu, 3xx %zu, 4xx %zu, 5xx %zu\n",
+           statuses[1], statuses[2], statuses[3], statuses[4], statuses[5]);
+    printf("duration:    %.3f s\n", seconds);
+    printf("throughput:  %.0f req/s, %.2f MiB/s\n", (double) total->total / seconds,
+           (double) bytes / seconds / (1024.0 * 1024.0));
+    printf("latency:     mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+           total->total > 0 ? (double) total->sum / (double) total->total / 1e3 : 0,
+           histogram_percentile(total, 50), histogram_percentile(total, 90), histogram_percentile(total, 99),
+           histogram_percentile(total, 99.9), (double) total->max / 1e3);
+    printf("\n%-24s %10s %8s %12s %12s %12s\n", "template", "requests", "errors", "p50 us", "p99 us", "max us");
+    for (size_t i = 0; i < mix_count; ++i) {
+        const histogram *h = &mix[i].latency;
+        printf("%-24s %10llu %8zu %12.1f %12.1f %12.1f\n", mix[i].name, (unsigned long long) h->total,
+               mix[i].errors, histogram_percentile(h, 50), histogram_percentile(h, 99), (double) h->max / 1e3);
+    }
+
+    for (size_t i = 0; i < connections; ++i) {
+        client_close(&clients[i]);
+    }
+    free(total);
+    free(clients);
+    close(epollfd);
+    return errors > 0;
+}
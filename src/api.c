@@ -0,0 +1,486 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "arena.h"
+#include "http_server.h"
+
+#define API_RESOURCES_PATH API_PATH "/resources"
+#define API_BOOKINGS_PATH API_PATH "/bookings"
+#define API_FREE_PATH API_PATH "/free"
+//Höchstens so viele Buchungen liefert eine Liste, weitere werden mit "truncated":true angezeigt.
+#define API_LIST_MAX 1000
+//Länger als die längste Zahl in einem Feld, die dekodierten Werte werden auf dem Stack abgelegt.
+#define API_FIELD_MAX 32
+//Platz für alle Ressourcen, durch Kommas getrennt.
+#define API_RESOURCES_MAX 128
+
+/**
+ * Vergleicht einen Teil des Pfads mit einem festen Text.
+ */
+static bool path_equals(const char *path, size_t path_len, const char *expected) {
+    return path_len == strlen(expected) && memcmp(path, expected, path_len) == 0;
+}
+
+/**
+ * Hängt einen Text als JSON-String an, mit Anführungszeichen. Anführungszeichen, Backslashes und
+ * Steuerzeichen werden escaped, alle anderen Bytes (auch UTF-8) unverändert übernommen.
+ * @param json Das JSON, an das angehängt wird.
+ * @param value Der Text, nicht nullterminiert.
+ * @param len Die Länge des Texts.
+ */
+static void json_cat_string(string *json, const char *value, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    str_cat(json, "\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const unsigned char c = (unsigned char) value[i];
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        str_cat(json, value + start, i - start);
+        if (c == '"' || c == '\\') {
+            const char escaped[2] = {'\\', (char) c};
+            str_cat(json, escaped, 2);
+        } else {
+            const char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            str_cat(json, escaped, 6);
+        }
+        start = i + 1;
+    }
+    str_cat(json, value + start, len - start);
+    str_cat(json, "\"", 1);
+}
+
+/**
+ * Hängt eine Buchung als JSON-Objekt an.
+ */
+static void json_cat_booking(string *json, const booking *b) {
+    const char *resource = booking_resource_name(b->resource);
+    str_cat(json, "{\"id\":", 6);
+    str_cat_number(json, (size_t) b->id);
+    str_cat(json, ",\"resource\":", 12);
+    json_cat_string(json, resource, strlen(resource));
+    str_cat(json, ",\"start\":", 9);
+    str_cat_number(json, (size_t) b->start);
+    str_cat(json, ",\"end\":", 7);
+    str_cat_number(json, (size_t) b->end);
+    str_cat(json, ",\"name\":", 8);
+    json_cat_string(json, b->name, strlen(b->name));
+    str_cat(json, "}", 1);
+}
+
+/**
+ * Erstellt eine Response mit JSON-Body.
+ * @param keep_alive Ob die Verbindung offen bleibt, wählt den Connection-Header.
+ * @param code Der Statuscode, z.B. "200".
+ * @param description Die Beschreibung des Statuscodes.
+ * @param json Der Body, die Response übernimmt ihn.
+ * @return Die Response, muss mit free_response freigegeben werden.
+ */
+static http_response *json_response(bool keep_alive, char *code, char *description, string *json) {
+    http_response *resp = response_new();
+    resp->connection = char_to_string(keep_alive ? "keep-alive" : "close");
+    set_response_status(resp, char_to_string(code), char_to_string(description));
+    set_response_body(resp, json, get_content_type("json", 4));
+    return resp;
+}
+
+/**
+ * Erstellt eine Fehler-Response mit dem Body {"error":"..."}.
+ */
+static http_response *json_error(bool keep_alive, char *code, char *description, const char *message) {
+    string *json = str_with_capacity(16 + strlen(message));
+    str_cat(json, "{\"error\":", 9);
+    json_cat_string(json, message, strlen(message));
+    str_cat(json, "}", 1);
+    return json_response(keep_alive, code, description, json);
+}
+
+/**
+ * Antwortet mit 405 und den erlaubten Methoden im Allow-Header.
+ */
+static http_response *method_not_allowed(bool keep_alive, char *allow) {
+    http_response *resp = json_error(keep_alive, "405", "Method Not Allowed", "method not allowed");
+    resp->allow = char_to_string(allow);
+    return resp;
+}
+
+static bool method_is(const http_request_view *request, const char *method) {
+    return request->method.len == strlen(method) && memcmp(request->method.str, method, request->method.len) == 0;
+}
+
+/**
+ * Sucht ein Feld in einem Formular (application/x-www-form-urlencoded) oder Query-String und
+ * dekodiert seinen Wert: %XX wird zum Byte, '+' zum Leerzeichen.
+ * @param form Die Felder, durch '&' getrennt.
+ * @param key Der Name des Felds, wird nicht dekodiert.
+ * @param out Der dekodierte Wert, nicht nullterminiert.
+ * @param cap Der Platz in out.
+ * @param len Die Länge des dekodierten Werts.
+ * @return 1 wenn das Feld vorkommt, 0 wenn nicht, -1 wenn der Wert ungültig escaped ist oder nicht
+ * in out passt.
+ */
+static int form_value(str_view form, const char *key, char *out, size_t cap, size_t *len) {
+    const size_t key_len = strlen(key);
+    size_t pos = 0;
+    while (pos < form.len) {
+        const char *amp = memchr(form.str + pos, '&', form.len - pos);
+        const size_t end = amp != NULL ? (size_t) (amp - form.str) : form.len;
+        const char *field = form.str + pos;
+        const size_t field_len = end - pos;
+        pos = end + 1;
+        if (field_len <= key_len || field[key_len] != '=' || memcmp(field, key, key_len) != 0) {
+            continue;
+        }
+        size_t n = 0;
+        for (size_t i = key_len + 1; i < field_len; ++i) {
+            if (n == cap) {
+                return -1;
+            }
+            if (field[i] == '+') {
+                out[n++] = ' ';
+            } else if (field[i] == '%') {
+                const int high = i + 2 < field_len ? hex2int(field[i + 1]) : -1;
+                const int low = high >= 0 ? hex2int(field[i + 2]) : -1;
+                if (low < 0) {
+                    return -1;
+                }
+                out[n++] = (char) (high * 16 + low);
+                i += 2;
+            } else {
+                out[n++] = field[i];
+            }
+        }
+        *len = n;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Liest eine nicht negative Dezimalzahl ohne Vorzeichen, z.B. einen Zeitpunkt oder eine ID.
+ * @return true, wenn der Text nur aus Ziffern besteht und die Zahl höchstens max ist.
+ */
+static bool parse_number(const char *text, size_t len, uint64_t max, uint64_t *value) {
+    if (len == 0 || len > 19) {
+        return false;
+    }
+    uint64_t number = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        number = number * 10 + (uint64_t) (text[i] - '0');
+    }
+    if (number > max) {
+        return false;
+    }
+    *value = number;
+    return true;
+}
+
+/**
+ * Liest einen Zeitpunkt aus einem Formularfeld.
+ * @return 1 wenn vorhanden und gültig, 0 wenn das Feld fehlt, -1 wenn es ungültig ist.
+ */
+static int form_time(str_view form, const char *key, int64_t *time) {
+    char value[API_FIELD_MAX];
+    size_t len;
+    const int found = form_value(form, key, value, sizeof(value), &len);
+    uint64_t number;
+    if (found <= 0) {
+        return found;
+    }
+    if (!parse_number(value, len, INT64_MAX, &number)) {
+        return -1;
+    }
+    *time = (int64_t) number;
+    return 1;
+}
+
+/**
+ * Liest die Ressource aus einem Formularfeld.
+ * @return Der Index der Ressource, BOOKING_ALL_RESOURCES wenn das Feld fehlt, -1 wenn es keine
+ * Ressource mit dem Namen gibt.
+ */
+static int form_resource(str_view form) {
+    char value[API_FIELD_MAX];
+    size_t len;
+    const int found = form_value(form, "resource", value, sizeof(value), &len);
+    if (found == 0) {
+        return BOOKING_ALL_RESOURCES;
+    }
+    return found > 0 ? booking_resource_find(value, len) : -1;
+}
+
+/**
+ * Sucht einen Header ohne Beachtung der Groß- und Kleinschreibung.
+ * @return Der Wert, leer wenn der Header fehlt.
+ */
+static str_view request_header_value(const http_request_view *request, const char *name) {
+    const size_t len = strlen(name);
+    for (size_t i = 0; i < request->header_count; ++i) {
+        const http_header_field *field = &request->headers[i];
+        if (field->name.len == len && strncasecmp(field->name.str, name, len) == 0) {
+            return field->value;
+        }
+    }
+    return (str_view) {NULL, 0};
+}
+
+/**
+ * Gibt den Query-String der URI zurück, ohne das '?'.
+ * @return Die Query, leer wenn die URI keine hat.
+ */
+static str_view request_query(const http_request_view *request) {
+    const char *query = memchr(request->uri.str, '?', request->uri.len);
+    if (query == NULL) {
+        return (str_view) {NULL, 0};
+    }
+    return (str_view) {query + 1, request->uri.len - (size_t) (query - request->uri.str) - 1};
+}
+
+/**
+ * GET /api/resources: die buchbaren Ressourcen.
+ */
+static http_response *list_resources(bool keep_alive) {
+    string *json = str_with_capacity(64);
+    str_cat(json, "{\"resources\":[", 14);
+    for (unsigned int i = 0; i < BOOKING_RESOURCE_COUNT; ++i) {
+        const char *name = booking_resource_name(i);
+        if (i > 0) {
+            str_cat(json, ",", 1);
+        }
+        json_cat_string(json, name, strlen(name));
+    }
+    str_cat(json, "]}", 2);
+    return json_response(keep_alive, "200", "OK", json);
+}
+
+/**
+ * GET /api/bookings?resource=&from=&to=: wer eine Ressource (oder alle) zwischen from und to
+ * gebucht hat. Ohne from und to werden alle Buchungen geliefert, höchstens API_LIST_MAX.
+ */
+static http_response *list_bookings(booking_store *store, const http_request_view *request, bool keep_alive) {
+    const str_view form = request_query(request);
+    const int resource = form_resource(form);
+    int64_t from = 0;
+    int64_t to = INT64_MAX;
+    if (resource < 0) {
+        return json_error(keep_alive, "404", "Not Found", "unknown resource");
+    }
+    if (form_time(form, "from", &from) < 0 || form_time(form, "to", &to) < 0 || to <= from) {
+        return json_error(keep_alive, "400", "Bad Request", "invalid time range");
+    }
+
+    //Einer mehr als geliefert wird, um abgeschnittene Listen zu erkennen
+    booking *found = arena_malloc((API_LIST_MAX + 1) * sizeof(booking));
+    if (found == NULL) {
+        exit(2);
+    }
+    const size_t count = booking_list(store, (unsigned int) resource, from, to, found, API_LIST_MAX + 1);
+    const size_t listed = count < API_LIST_MAX ? count : API_LIST_MAX;
+    string *json = str_with_capacity(32 + listed * (96 + BOOKING_MAX_NAME));
+    str_cat(json, "{\"bookings\":[", 13);
+    for (size_t i = 0; i < listed; ++i) {
+        if (i > 0) {
+            str_cat(json, ",", 1);
+        }
+        json_cat_booking(json, &found[i]);
+    }
+    arena_free(found);
+    if (count > API_LIST_MAX) {
+        str_cat(json, "],\"truncated\":true}", 19);
+    } else {
+        str_cat(json, "],\"truncated\":false}", 20);
+    }
+    return json_response(keep_alive, "200", "OK", json);
+}
+
+/**
+ * GET /api/free?resources=gaestezimmer,kueche&from=&to=&duration=: wann alle genannten Ressourcen
+ * zugleich für mindestens duration Sekunden (Standard: eine Viertelstunde) frei sind. Die Zeiten
+ * werden auf Viertelstunden gerundet, siehe booking_free_slots.
+ */
+static http_response *list_free(booking_store *store, const http_request_view *request, bool keep_alive) {
+    const str_view form = request_query(request);
+    char names[API_RESOURCES_MAX];
+    size_t names_len;
+    unsigned int resources[BOOKING_RESOURCE_COUNT];
+    size_t count = 0;
+    if (form_value(form, "resources", names, sizeof(names), &names_len) <= 0 || names_len == 0) {
+        return json_error(keep_alive, "400", "Bad Request", "missing resources");
+    }
+    for (size_t pos = 0; pos <= names_len;) {
+        const char *comma = memchr(names + pos, ',', names_len - pos);
+        const size_t end = comma != NULL ? (size_t) (comma - names) : names_len;
+        const int resource = booking_resource_find(names + pos, end - pos);
+        if (resource < 0) {
+            return json_error(keep_alive, "404", "Not Found", "unknown resource");
+        }
+        bool listed = false;
+        for (size_t i = 0; i < count; ++i) {
+            listed = listed || resources[i] == (unsigned int) resource;
+        }
+        if (!listed) {
+            resources[count++] = (unsigned int) resource;
+        }
+        pos = end + 1;
+    }
+    int64_t from;
+    int64_t to;
+    int64_t duration = AVAILABILITY_SLOT_SECONDS;
+    if (form_time(form, "from", &from) <= 0 || form_time(form, "to", &to) <= 0 || to <= from
+        || form_time(form, "duration", &duration) < 0 || duration == 0) {
+        return json_error(keep_alive, "400", "Bad Request", "invalid time range");
+    }
+
+    //Einer mehr als geliefert wird, um abgeschnittene Listen zu erkennen
+    booking_window *windows = arena_malloc((API_LIST_MAX + 1) * sizeof(booking_window));
+    if (windows == NULL) {
+        exit(2);
+    }
+    const size_t found = booking_free_slots(store, resources, count, from, to, duration, windows, API_LIST_MAX + 1);
+    const size_t listed = found < API_LIST_MAX ? found : API_LIST_MAX;
+    string *json = str_with_capacity(32 + listed * 48);
+    str_cat(json, "{\"free\":[", 9);
+    for (size_t i = 0; i < listed; ++i) {
+        str_cat(json, i > 0 ? ",{\"start\":" : "{\"start\":", i > 0 ? 10 : 9);
+        str_cat_number(json, (size_t) windows[i].start);
+        str_cat(json, ",\"end\":", 7);
+        str_cat_number(json, (size_t) windows[i].end);
+        str_cat(json, "}", 1);
+    }
+    arena_free(windows);
+    if (found > API_LIST_MAX) {
+        str_cat(json, "],\"truncated\":true}", 19);
+    } else {
+        str_cat(json, "],\"truncated\":false}", 20);
+    }
+    return json_response(keep_alive, "200", "OK", json);
+}
+
+/**
+ * POST /api/bookings mit dem Formular resource=&start=&end=&name=: bucht eine Ressource, wenn die
+ * Zeit noch frei ist. Antwortet mit 201 und der Buchung, oder mit 409 und der Buchung, mit der
+ * sich die Zeit überschneidet.
+ */
+static http_response *create_booking(booking_store *store, const http_request_view *request, bool keep_alive) {
+    static const char form_type[] = "application/x-www-form-urlencoded";
+    const str_view content_type = request_header_value(request, "content-type");
+    if (content_type.len > 0 && (content_type.len < sizeof(form_type) - 1
+                                 || strncasecmp(content_type.str, form_type, sizeof(form_type) - 1) != 0)) {
+        return json_error(keep_alive, "415", "Unsupported Media Type", "expected a form");
+    }
+
+    const int resource = form_resource(request->body);
+    char name[BOOKING_MAX_NAME];
+    size_t name_len = 0;
+    int64_t start;
+    int64_t end;
+    if (resource == BOOKING_ALL_RESOURCES) {
+        return json_error(keep_alive, "400", "Bad Request", "missing resource");
+    }
+    if (resource < 0) {
+        return json_error(keep_alive, "404", "Not Found", "unknown resource");
+    }
+    if (form_time(request->body, "start", &start) <= 0 || form_time(request->body, "end", &end) <= 0
+        || end <= start) {
+        return json_error(keep_alive, "400", "Bad Request", "invalid time range");
+    }
+    if (form_value(request->body, "name", name, sizeof(name), &name_len) <= 0 || name_len == 0
+        || memchr(name, '\0', name_len) != NULL) {
+        return json_error(keep_alive, "400", "Bad Request", "invalid name");
+    }
+
+    booking created;
+    booking conflict;
+    uint64_t lsn;
+    switch (booking_create(store, (unsigned int) resource, start, end, name, name_len, &created, &conflict, &lsn)) {
+        case BOOKING_OK: {
+            string *json = str_with_capacity(96 + 2 * BOOKING_MAX_NAME);
+            json_cat_booking(json, &created);
+            http_response *resp = json_response(keep_alive, "201", "Created", json);
+            resp->durable_lsn = lsn;
+            resp->location = str_with_capacity(strlen(API_BOOKINGS_PATH) + 1 + number_length(created.id));
+            str_cat(resp->location, API_BOOKINGS_PATH "/", strlen(API_BOOKINGS_PATH) + 1);
+            str_cat_number(resp->location, (size_t) created.id);
+            return resp;
+        }
+        case BOOKING_CONFLICT: {
+            string *json = str_with_capacity(128 + 2 * BOOKING_MAX_NAME);
+            str_cat(json, "{\"error\":\"conflict\",\"conflict\":", 31);
+            json_cat_booking(json, &conflict);
+            str_cat(json, "}", 1);
+            return json_response(keep_alive, "409", "Conflict", json);
+        }
+        default:
+            return json_error(keep_alive, "400", "Bad Request", "invalid booking");
+    }
+}
+
+/**
+ * GET und DELETE /api/bookings/<id>: liefert oder storniert eine Buchung.
+ */
+static http_response *booking_by_id(booking_store *store, const http_request_view *request, const char *id_text,
+                                    size_t id_len, bool keep_alive) {
+    const bool get = method_is(request, "GET");
+    if (!get && !method_is(request, "DELETE")) {
+        return method_not_allowed(keep_alive, "GET, DELETE");
+    }
+    uint64_t id;
+    booking result;
+    uint64_t lsn = 0;
+    if (!parse_number(id_text, id_len, UINT64_MAX, &id)
+        || (get ? booking_get(store, id, &result) : booking_cancel(store, id, &result, &lsn)) != BOOKING_OK) {
+        return json_error(keep_alive, "404", "Not Found", "unknown booking");
+    }
+    string *json = str_with_capacity(96 + 2 * BOOKING_MAX_NAME);
+    json_cat_booking(json, &result);
+    http_response *resp = json_response(keep_alive, "200", "OK", json);
+    //die Stornierung wird erst bestätigt, wenn sie im Log auf der Platte ist
+    resp->durable_lsn = lsn;
+    return resp;
+}
+
+/**
+ * Beantwortet die Requests unter API_PATH, die Buchungen der WG. Zeiten sind Sekunden seit der
+ * Epoche, eine Buchung belegt [start, end). Fehler werden als {"error":"..."} beantwortet.
+ * @param ctx Der Zustand des Workers mit den Buchungen.
+ * @param request Der Request, die Query und der Body werden als Formular gelesen.
+ * @param path Der dekodierte und normalisierte Pfad ohne Query.
+ * @param path_len Die Länge des Pfads.
+ * @param keep_alive Ob die Verbindung offen bleibt, wählt den Connection-Header.
+ * @return Die Response, muss mit free_response freigegeben werden.
+ */
+http_response *api_process(process_context *ctx, const http_request_view *request, const char *path,
+                           size_t path_len, bool keep_alive) {
+    const size_t bookings_len = strlen(API_BOOKINGS_PATH);
+    if (ctx->bookings == NULL) {
+        return json_error(keep_alive, "404", "Not Found", "not found");
+    }
+    if (path_equals(path, path_len, API_RESOURCES_PATH)) {
+        return method_is(request, "GET") ? list_resources(keep_alive) : method_not_allowed(keep_alive, "GET");
+    }
+    if (path_equals(path, path_len, API_BOOKINGS_PATH)) {
+        if (method_is(request, "GET")) {
+            return list_bookings(ctx->bookings, request, keep_alive);
+        }
+        if (method_is(request, "POST")) {
+            return create_booking(ctx->bookings, request, keep_alive);
+        }
+        return method_not_allowed(keep_alive, "GET, POST");
+    }
+    if (path_equals(path, path_len, API_FREE_PATH)) {
+        return method_is(request, "GET") ? list_free(ctx->bookings, request, keep_alive)
+                                         : method_not_allowed(keep_alive, "GET");
+    }
+    if (path_len > bookings_len + 1 && memcmp(path, API_BOOKINGS_PATH "/", bookings_len + 1) == 0) {
+        return booking_by_id(ctx->bookings, request, path + bookings_len + 1, path_len - bookings_len - 1,
+                             keep_alive);
+    }
+    return json_error(keep_alive, "404", "Not Found", "not found");
+}
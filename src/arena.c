@@ -0,0 +1,219 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+//the arena used by the allocation functions of this thread, NULL for the heap
+static _Thread_local arena *current_arena;
+
+/**
+ * Rounds size up to the alignment of every arena allocation
+ * @param size requested size
+ * @return aligned size
+ */
+static size_t align_size(size_t size) {
+    const size_t align = _Alignof(max_align_t);
+    return (size + align - 1) & ~(align - 1);
+}
+
+/**
+ * Allocates a new chunk with room for size bytes
+ * @param size usable bytes of the chunk
+ * @return the chunk, NULL if there is no memory
+ */
+static arena_chunk *chunk_new(size_t size) {
+    arena_chunk *chunk = malloc(sizeof(arena_chunk) + size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+/**
+ * Creates an arena with a first chunk of size bytes
+ * @param size initial size, e.g. ARENA_DEFAULT_SIZE
+ * @return new arena, must be freed with arena_destroy
+ */
+arena *arena_new(size_t size) {
+    arena *a = calloc(1, sizeof(arena));
+    if (a == NULL) {
+        exit(2);
+    }
+    a->chunks = chunk_new(align_size(size));
+    if (a->chunks == NULL) {
+        exit(2);
+    }
+    return a;
+}
+
+/**
+ * Frees the arena and everything allocated in it
+ * @param a the arena, must not be in use by any thread
+ */
+void arena_destroy(arena *a) {
+    while (a->chunks != NULL) {
+        arena_chunk *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    free(a);
+}
+
+/**
+ * Releases everything allocated in the arena at once. If more than one chunk was needed,
+ * they are replaced by a single chunk of their combined size.
+ * @param a the arena
+ */
+void arena_reset(arena *a) {
+    a->last = NULL;
+    if (a->chunks->next == NULL) {
+        a->chunks->used = 0;
+        return;
+    }
+    size_t total = 0;
+    for (arena_chunk *chunk = a->chunks; chunk != NULL; chunk = chunk->next) {
+        total += chunk->size;
+    }
+    arena_chunk *merged = chunk_new(total);
+    if (merged == NULL) {
+        //keep the largest (current) chunk
+        merged = a->chunks;
+        a->chunks = a->chunks->next;
+        merged->next = NULL;
+        merged->used = 0;
+    }
+    while (a->chunks != NULL) {
+        arena_chunk *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    a->chunks = merged;
+}
+
+/**
+ * Makes a the arena of the calling thread: string, request and response constructors
+ * allocate from it, and freeing objects that belong to it does nothing.
+ * @param a the arena, NULL to use the heap
+ * @return the previously used arena, to be restored afterwards
+ */
+arena *arena_use(arena *a) {
+    arena *previous = current_arena;
+    current_arena = a;
+    return previous;
+}
+
+/**
+ * Checks whether ptr was allocated in the arena
+ * @param a the arena, may be NULL
+ * @param ptr any pointer
+ * @return true if ptr lies in one of the chunks
+ */
+bool arena_owns(const arena *a, const void *ptr) {
+    if (a == NULL || ptr == NULL) {
+        return false;
+    }
+    const uintptr_t p = (uintptr_t) ptr;
+    for (const arena_chunk *chunk = a->chunks; chunk != NULL; chunk = chunk->next) {
+        const uintptr_t start = (uintptr_t) chunk->data;
+        if (p >= start && p < start + chunk->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Allocates size bytes from the current arena of the thread, or from the heap if there is none
+ * @param size number of bytes
+ * @return the memory, NULL if there is none left
+ */
+void *arena_malloc(size_t size) {
+    arena *a = current_arena;
+    if (a == NULL) {
+        return malloc(size > 0 ? size : 1);
+    }
+    size = align_size(size > 0 ? size : 1);
+    arena_chunk *chunk = a->chunks;
+    if (chunk->size - chunk->used < size) {
+        size_t chunk_size = chunk->size * 2;
+        while (chunk_size < size) {
+            chunk_size *= 2;
+        }
+        chunk = chunk_new(chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = a->chunks;
+        a->chunks = chunk;
+    }
+    void *ptr = (unsigned char *) chunk->data + chunk->used;
+    chunk->used += size;
+    a->last = ptr;
+    return ptr;
+}
+
+/**
+ * Like arena_malloc, but the memory is zeroed (calloc)
+ * @param count number of elements
+ * @param size size of one element
+ * @return the memory, NULL if there is none left
+ */
+void *arena_calloc(size_t count, size_t size) {
+    if (current_arena == NULL) {
+        return calloc(count > 0 ? count : 1, size > 0 ? size : 1);
+    }
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr = arena_malloc(count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+/**
+ * Resizes memory from arena_malloc. Memory of the current arena grows in place if it was the
+ * last allocation, otherwise it is copied; heap memory is passed to realloc.
+ * @param ptr the memory, may be NULL
+ * @param used bytes of ptr that have to be kept
+ * @param size new size
+ * @return the resized memory, NULL if there is none left (ptr stays valid)
+ */
+void *arena_realloc(void *ptr, size_t used, size_t size) {
+    arena *a = current_arena;
+    if (ptr == NULL) {
+        return arena_malloc(size);
+    }
+    if (!arena_owns(a, ptr)) {
+        return realloc(ptr, size > 0 ? size : 1);
+    }
+    arena_chunk *chunk = a->chunks;
+    if (ptr == a->last) {
+        const size_t offset = (size_t) ((unsigned char *) ptr - (unsigned char *) chunk->data);
+        if (chunk->size - offset >= align_size(size)) {
+            chunk->used = offset + align_size(size);
+            return ptr;
+        }
+    }
+    void *resized = arena_malloc(size);
+    if (resized != NULL) {
+        memcpy(resized, ptr, used < size ? used : size);
+    }
+    return resized;
+}
+
+/**
+ * Frees memory from arena_malloc. Memory of the current arena is only released by
+ * arena_reset, so nothing happens for it.
+ * @param ptr the memory, may be NULL
+ */
+void arena_free(void *ptr) {
+    if (!arena_owns(current_arena, ptr)) {
+        free(ptr);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ARENA_DEFAULT_SIZE 4096
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} arena_chunk;
+
+/**
+ * A bump-pointer allocator for everything built while answering requests. Single objects
+ * are never freed, the whole arena is reset at once when no response built in it is
+ * still being sent. After a reset it consists of a single chunk large enough for the
+ * previous requests, so requests of the same size don't call malloc anymore.
+ */
+typedef struct arena {
+    //current chunk first
+    arena_chunk *chunks;
+    //the most recent allocation, it can grow in place
+    void *last;
+} arena;
+
+arena *arena_new(size_t size);
+
+void arena_destroy(arena *a);
+
+void arena_reset(arena *a);
+
+arena *arena_use(arena *a);
+
+bool arena_owns(const arena *a, const void *ptr);
+
+void *arena_malloc(size_t size);
+
+void *arena_calloc(size_t count, size_t size);
+
+void *arena_realloc(void *ptr, size_t used, size_t size);
+
+void arena_free(void *ptr);
+
+#endif //ARENA_H
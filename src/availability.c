@@ -0,0 +1,210 @@
+#include <stdlib.h>
+
+#include "availability.h"
+#include "scan.h"
+
+//Words combined per call of scan_bitmap_nor, the combined bitmap lives on the stack.
+#define AVAILABILITY_CHUNK_WORDS 64
+//Most resources a single availability_find combines.
+#define AVAILABILITY_MAX_QUERY 16
+
+/**
+ * Creates empty bitmaps. The memory is zeroed lazily by the kernel, untouched days cost nothing.
+ * @param resources number of resources
+ * @param slot_count slots per resource, the slots of later times are never free
+ * @return the bitmaps, must be freed with availability_free
+ */
+availability *availability_new(size_t resources, size_t slot_count) {
+    availability *a = calloc(1, sizeof(availability));
+    if (a == NULL) {
+        exit(2);
+    }
+    a->resources = resources;
+    a->slot_count = slot_count;
+    a->words = (slot_count + 255) / 256 * 4;
+    a->bitmaps = calloc(resources, sizeof(uint64_t *));
+    if (a->bitmaps == NULL) {
+        exit(2);
+    }
+    for (size_t i = 0; i < resources; ++i) {
+        a->bitmaps[i] = calloc(a->words, sizeof(uint64_t));
+        if (a->bitmaps[i] == NULL) {
+            exit(2);
+        }
+    }
+    return a;
+}
+
+/**
+ * Frees the bitmaps
+ * @param a the bitmaps, may be NULL
+ */
+void availability_free(availability *a) {
+    if (a == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < a->resources; ++i) {
+        free(a->bitmaps[i]);
+    }
+    free(a->bitmaps);
+    free(a);
+}
+
+/**
+ * Marks slots as occupied or free, whole words at once
+ * @param a the bitmaps
+ * @param resource index of the bitmap
+ * @param first first slot
+ * @param end slot behind the last one, at most slot_count
+ * @param occupied whether the slots are set or cleared
+ */
+void availability_set(availability *a, size_t resource, size_t first, size_t end, bool occupied) {
+    uint64_t *bitmap = a->bitmaps[resource];
+    end = end < a->slot_count ? end : a->slot_count;
+    while (first < end) {
+        const size_t bit = first % 64;
+        const size_t n = end - first < 64 - bit ? end - first : 64 - bit;
+        const uint64_t mask = (n == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << n) - 1)) << bit;
+        if (occupied) {
+            bitmap[first / 64] |= mask;
+        } else {
+            bitmap[first / 64] &= ~mask;
+        }
+        first += n;
+    }
+}
+
+/**
+ * Tells whether a slot is occupied
+ * @param a the bitmaps
+ * @param resource index of the bitmap
+ * @param slot the slot
+ * @return true if occupied; slots behind slot_count are always occupied
+ */
+bool availability_occupied(const availability *a, size_t resource, size_t slot) {
+    return slot >= a->slot_count || (a->bitmaps[resource][slot / 64] >> (slot % 64) & 1) != 0;
+}
+
+/**
+ * State of the run search between words
+ */
+typedef struct run_search {
+    size_t length;
+    availability_run *runs;
+    size_t max;
+    size_t count;
+    //first slot of the current run, SIZE_MAX outside of a run
+    size_t start;
+} run_search;
+
+static void run_end(run_search *search, size_t end) {
+    if (search->start != SIZE_MAX && end - search->start >= search->length && search->count < search->max) {
+        search->runs[search->count++] = (availability_run) {search->start, end - search->start};
+    }
+    search->start = SIZE_MAX;
+}
+
+/**
+ * Handles a word outside of a run that holds no run long enough for the search: only a run
+ * reaching the next word matters then, it is started without looking at every change between
+ * free and occupied.
+ * @param search the search
+ * @param word the word, a set bit is free
+ * @param base slot of the lowest bit
+ * @return false if the word has to be searched with run_word
+ */
+static bool run_skip(run_search *search, uint64_t word, size_t base) {
+    if (search->start != SIZE_MAX) {
+        return false;
+    }
+    //after the shifts bit i is set if bits i to i + length - 1 are, lengths double each step
+    uint64_t runs = word;
+    size_t missing = (search->length < 64 ? search->length : 64) - 1;
+    for (size_t run = 1; missing > 0 && runs != 0; run *= 2) {
+        const size_t shift = run < missing ? run : missing;
+        runs &= runs >> shift;
+        missing -= shift;
+    }
+    if (runs != 0) {
+        return false;
+    }
+    if (word >> 63 != 0) {
+        search->start = base + 64 - (size_t) __builtin_clzll(~word);
+    }
+    return true;
+}
+
+/**
+ * Continues the run search with one word of the combined bitmap, jumping from one change between
+ * free and occupied to the next with ctz
+ * @param search the search
+ * @param word the word, a set bit is free
+ * @param base slot of the lowest bit
+ */
+static void run_word(run_search *search, uint64_t word, size_t base) {
+    size_t bit = 0;
+    while (bit < 64) {
+        if (search->start != SIZE_MAX) {
+            const uint64_t occupied = ~word >> bit;
+            if (occupied == 0) {
+                return;
+            }
+            bit += (size_t) __builtin_ctzll(occupied);
+            run_end(search, base + bit);
+        } else {
+            const uint64_t vacant = word >> bit;
+            if (vacant == 0) {
+                return;
+            }
+            bit += (size_t) __builtin_ctzll(vacant);
+            search->start = base + bit;
+        }
+    }
+}
+
+/**
+ * Finds the times when all of several resources are free: their bitmaps are combined with the
+ * SIMD kernel of scan_bitmap_nor, then the result is searched for runs of free slots.
+ * @param a the bitmaps
+ * @param resources indices of the bitmaps, at most 16
+ * @param count number of resources
+ * @param first first slot of the search
+ * @param end slot behind the last one of the search
+ * @param length slots a run needs at least, at least 1
+ * @param runs set to the free runs in ascending order, each is cut at first and end
+ * @param max room in runs, the search stops when it is full
+ * @return number of runs
+ */
+size_t availability_find(const availability *a, const unsigned int *resources, size_t count, size_t first,
+                         size_t end, size_t length, availability_run *runs, size_t max) {
+    run_search search = {length > 0 ? length : 1, runs, max, 0, SIZE_MAX};
+    end = end < a->slot_count ? end : a->slot_count;
+    if (count > AVAILABILITY_MAX_QUERY || first >= end || max == 0) {
+        return 0;
+    }
+    const uint64_t *bitmaps[AVAILABILITY_MAX_QUERY];
+    uint64_t combined[AVAILABILITY_CHUNK_WORDS];
+    const size_t last_word = (end - 1) / 64;
+    for (size_t word = first / 64; word <= last_word && search.count < max; word += AVAILABILITY_CHUNK_WORDS) {
+        const size_t words = last_word + 1 - word < AVAILABILITY_CHUNK_WORDS ? last_word + 1 - word
+                                                                             : AVAILABILITY_CHUNK_WORDS;
+        for (size_t i = 0; i < count; ++i) {
+            bitmaps[i] = a->bitmaps[resources[i]] + word;
+        }
+        scan_bitmap_nor(bitmaps, count, words, combined);
+        //slots before first and from end on don't belong to the search
+        if (word == first / 64) {
+            combined[0] &= ~(uint64_t) 0 << (first % 64);
+        }
+        if (word + words - 1 == last_word && end % 64 != 0) {
+            combined[words - 1] &= ((uint64_t) 1 << (end % 64)) - 1;
+        }
+        for (size_t i = 0; i < words && search.count < max; ++i) {
+            if (!run_skip(&search, combined[i], (word + i) * 64)) {
+                run_word(&search, combined[i], (word + i) * 64);
+            }
+        }
+    }
+    run_end(&search, end);
+    return search.count;
+}
@@ -0,0 +1,42 @@
+#ifndef AVAILABILITY_H
+#define AVAILABILITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Granularity of the bitmaps: a booking occupies every slot it touches.
+#define AVAILABILITY_SLOT_SECONDS (15 * 60)
+#define AVAILABILITY_SLOTS_PER_DAY (24 * 60 * 60 / AVAILABILITY_SLOT_SECONDS)
+
+//A run of free slots [first, first + count).
+typedef struct availability_run {
+    size_t first;
+    size_t count;
+} availability_run;
+
+/**
+ * Occupancy bitmaps, one per resource, with one bit per slot: day d since the epoch has the bits
+ * d * AVAILABILITY_SLOTS_PER_DAY up to the next day. A set bit is occupied. Days are laid out
+ * back to back, so free runs may span midnight.
+ */
+typedef struct availability {
+    size_t resources;
+    size_t slot_count;
+    //64-bit words per bitmap, rounded up to whole AVX2 registers
+    size_t words;
+    uint64_t **bitmaps;
+} availability;
+
+availability *availability_new(size_t resources, size_t slot_count);
+
+void availability_free(availability *a);
+
+void availability_set(availability *a, size_t resource, size_t first, size_t end, bool occupied);
+
+bool availability_occupied(const availability *a, size_t resource, size_t slot);
+
+size_t availability_find(const availability *a, const unsigned int *resources, size_t count, size_t first,
+                         size_t end, size_t length, availability_run *runs, size_t max);
+
+#endif //AVAILABILITY_H
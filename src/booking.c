@@ -0,0 +1,974 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "booking.h"
+
+#define BOOKING_INITIAL_IDS 64
+//Free windows booking_free_slots looks for at once.
+#define BOOKING_FREE_CHUNK 64
+//Types of the log records, see log_change.
+#define BOOKING_RECORD_CREATE 1
+#define BOOKING_RECORD_CANCEL 2
+//type, id, resource, start, end, name length and name
+#define BOOKING_RECORD_MAX (1 + 8 + 1 + 8 + 8 + 1 + BOOKING_MAX_NAME)
+
+static const char *const resource_names[BOOKING_RESOURCE_COUNT] = {"waschmaschine", "badezimmer", "gaestezimmer",
+                                                                   "kueche"};
+
+static int node_height(const booking_node *node) {
+    return node != NULL ? node->height : 0;
+}
+
+/**
+ * Recomputes height and largest end of a node from its children
+ * @param node the node
+ */
+static void node_update(booking_node *node) {
+    const int left = node_height(node->left);
+    const int right = node_height(node->right);
+    node->height = 1 + (left > right ? left : right);
+    node->max_end = node->booking.end;
+    if (node->left != NULL && node->left->max_end > node->max_end) {
+        node->max_end = node->left->max_end;
+    }
+    if (node->right != NULL && node->right->max_end > node->max_end) {
+        node->max_end = node->right->max_end;
+    }
+}
+
+static booking_node *rotate_right(booking_node *node) {
+    booking_node *left = node->left;
+    node->left = left->right;
+    left->right = node;
+    node_update(node);
+    node_update(left);
+    return left;
+}
+
+static booking_node *rotate_left(booking_node *node) {
+    booking_node *right = node->right;
+    node->right = right->left;
+    right->left = node;
+    node_update(node);
+    node_update(right);
+    return right;
+}
+
+/**
+ * Restores the AVL balance of a node whose subtrees differ in height by at most two
+ * @param node the node
+ * @return the new root of the subtree
+ */
+static booking_node *rebalance(booking_node *node) {
+    node_update(node);
+    const int balance = node_height(node->left) - node_height(node->right);
+    if (balance > 1) {
+        if (node_height(node->left->left) < node_height(node->left->right)) {
+            node->left = rotate_left(node->left);
+        }
+        return rotate_right(node);
+    }
+    if (balance < -1) {
+        if (node_height(node->right->right) < node_height(node->right->left)) {
+            node->right = rotate_right(node->right);
+        }
+        return rotate_left(node);
+    }
+    return node;
+}
+
+/**
+ * Orders bookings by start, bookings with the same start by id
+ * @return negative if a comes first, positive if b comes first, 0 if they are the same booking
+ */
+static int booking_compare(const booking *a, const booking *b) {
+    if (a->start != b->start) {
+        return a->start < b->start ? -1 : 1;
+    }
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+static booking_node *node_insert(booking_node *root, booking_node *node) {
+    if (root == NULL) {
+        node->left = NULL;
+        node->right = NULL;
+        node_update(node);
+        return node;
+    }
+    if (booking_compare(&node->booking, &root->booking) < 0) {
+        root->left = node_insert(root->left, node);
+    } else {
+        root->right = node_insert(root->right, node);
+    }
+    return rebalance(root);
+}
+
+/**
+ * Unlinks the first node of a subtree
+ * @param root the subtree, not empty
+ * @param min set to the unlinked node
+ * @return the new root of the subtree
+ */
+static booking_node *node_remove_min(booking_node *root, booking_node **min) {
+    if (root->left == NULL) {
+        *min = root;
+        return root->right;
+    }
+    root->left = node_remove_min(root->left, min);
+    return rebalance(root);
+}
+
+static booking_node *node_remove(booking_node *root, const booking_node *node) {
+    if (root == NULL) {
+        return NULL;
+    }
+    if (root == node) {
+        if (root->left == NULL) {
+            return root->right;
+        }
+        if (root->right == NULL) {
+            return root->left;
+        }
+        //the successor takes the place of the node, nodes are relinked and never copied
+        booking_node *successor;
+        booking_node *right = node_remove_min(root->right, &successor);
+        successor->left = root->left;
+        successor->right = right;
+        return rebalance(successor);
+    }
+    if (booking_compare(&node->booking, &root->booking) < 0) {
+        root->left = node_remove(root->left, node);
+    } else {
+        root->right = node_remove(root->right, node);
+    }
+    return rebalance(root);
+}
+
+/**
+ * Inserts a node, overlapping intervals are allowed
+ * @param tree the tree
+ * @param node the node with its booking set, owned by the caller
+ */
+void interval_tree_insert(interval_tree *tree, booking_node *node) {
+    tree->root = node_insert(tree->root, node);
+    tree->count++;
+}
+
+/**
+ * Removes a node of the tree
+ * @param tree the tree
+ * @param node a node of this tree, it is not freed
+ */
+void interval_tree_remove(interval_tree *tree, booking_node *node) {
+    tree->root = node_remove(tree->root, node);
+    tree->count--;
+}
+
+/**
+ * Finds an interval that overlaps [start, end) in O(log n). If the left subtree reaches past start
+ * but holds no overlap, its interval ending after start begins at or after end, and so does every
+ * interval of the right subtree; so one path from the root decides.
+ * @param tree the tree
+ * @param start start of the time
+ * @param end end of the time, exclusive
+ * @return an overlapping node, NULL if there is none
+ */
+const booking_node *interval_tree_first_overlap(const interval_tree *tree, int64_t start, int64_t end) {
+    const booking_node *node = tree->root;
+    while (node != NULL) {
+        if (node->booking.start < end && node->booking.end > start) {
+            return node;
+        }
+        if (node->left != NULL && node->left->max_end > start) {
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Collects the overlapping bookings of a subtree in order
+ */
+static size_t node_overlaps(const booking_node *node, int64_t start, int64_t end, const booking **out, size_t max,
+                            size_t count) {
+    if (node == NULL || count == max || node->max_end <= start) {
+        return count;
+    }
+    count = node_overlaps(node->left, start, end, out, max, count);
+    if (count < max && node->booking.start < end) {
+        if (node->booking.end > start) {
+            out[count++] = &node->booking;
+        }
+        count = node_overlaps(node->right, start, end, out, max, count);
+    }
+    return count;
+}
+
+/**
+ * Lists the intervals that overlap [start, end), ordered by start. Subtrees that end before start
+ * or begin after end are skipped.
+ * @param tree the tree
+ * @param start start of the time
+ * @param end end of the time, exclusive
+ * @param out set to the bookings, valid until the tree changes
+ * @param max room in out, at most this many are listed
+ * @return number of listed bookings
+ */
+size_t interval_tree_overlaps(const interval_tree *tree, int64_t start, int64_t end, const booking **out,
+                              size_t max) {
+    return node_overlaps(tree->root, start, end, out, max, 0);
+}
+
+/**
+ * Returns the name of a resource, e.g. for URLs and JSON
+ * @param resource index of the resource, below BOOKING_RESOURCE_COUNT
+ * @return static name
+ */
+const char *booking_resource_name(unsigned int resource) {
+    return resource < BOOKING_RESOURCE_COUNT ? resource_names[resource] : NULL;
+}
+
+/**
+ * Finds a resource by name
+ * @param name the name, not null terminated
+ * @param len length of the name
+ * @return index of the resource, -1 if there is none with this name
+ */
+int booking_resource_find(const char *name, size_t len) {
+    for (int i = 0; i < BOOKING_RESOURCE_COUNT; ++i) {
+        if (strlen(resource_names[i]) == len && memcmp(resource_names[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Creates an empty store
+ * @return the store, must be freed with booking_store_free
+ */
+booking_store *booking_store_new(void) {
+    booking_store *store = calloc(1, sizeof(booking_store));
+    if (store == NULL || pthread_rwlock_init(&store->lock, NULL) != 0) {
+        exit(2);
+    }
+    store->slots = availability_new(BOOKING_RESOURCE_COUNT, BOOKING_MAX_END / AVAILABILITY_SLOT_SECONDS);
+    return store;
+}
+
+/**
+ * Frees a store and all its bookings, the log is written and closed first
+ * @param store the store
+ */
+void booking_store_free(booking_store *store) {
+    wal_close(store->log);
+    for (size_t i = 0; i < store->last_id - store->base_ids; ++i) {
+        free(store->by_id[i]);
+    }
+    free(store->by_id);
+    snapshot_close(store->base);
+    free(store->base_cancelled);
+    availability_free(store->slots);
+    pthread_rwlock_destroy(&store->lock);
+    free(store);
+}
+
+/**
+ * Returns the slot a time lies in
+ */
+static size_t first_slot(int64_t time) {
+    return (size_t) (time / AVAILABILITY_SLOT_SECONDS);
+}
+
+/**
+ * Returns the first slot that starts at or after a time
+ */
+static size_t end_slot(int64_t time) {
+    return (size_t) ((time + AVAILABILITY_SLOT_SECONDS - 1) / AVAILABILITY_SLOT_SECONDS);
+}
+
+/**
+ * Finds the records of the base that overlap [start, end). The bookings of a resource don't
+ * overlap, so ordered by start they are ordered by end as well and the overlapping ones follow
+ * each other; two binary searches find them.
+ * @param store the store
+ * @param resource index of the resource
+ * @param start start of the time
+ * @param end end of the time, exclusive
+ * @param last set to the index behind the last overlapping record
+ * @return index of the first overlapping record
+ */
+static size_t base_overlaps(const booking_store *store, unsigned int resource, int64_t start, int64_t end,
+                            size_t *last) {
+    if (store->base == NULL) {
+        *last = 0;
+        return 0;
+    }
+    const snapshot_record *records = store->base->records;
+    size_t first = (size_t) store->base->header->resource_start[resource];
+    size_t high = (size_t) store->base->header->resource_start[resource + 1];
+    const size_t limit = high;
+    while (first < high) {
+        const size_t middle = first + (high - first) / 2;
+        if (records[middle].end > start) {
+            high = middle;
+        } else {
+            first = middle + 1;
+        }
+    }
+    size_t behind = first;
+    high = limit;
+    while (behind < high) {
+        const size_t middle = behind + (high - behind) / 2;
+        if (records[middle].start < end) {
+            behind = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *last = behind;
+    return first;
+}
+
+/**
+ * Tells whether a record of the base was cancelled after the snapshot was taken
+ */
+static bool base_is_cancelled(const booking_store *store, size_t index) {
+    return (store->base_cancelled[index / 64] >> (index % 64) & 1) != 0;
+}
+
+/**
+ * Returns the resource of a record of the base, given by the section it lies in
+ */
+static unsigned int base_resource(const booking_store *store, size_t index) {
+    unsigned int resource = 0;
+    while (resource + 1 < BOOKING_RESOURCE_COUNT && index >= store->base->header->resource_start[resource + 1]) {
+        resource++;
+    }
+    return resource;
+}
+
+/**
+ * Copies a record of the base into a booking. A name that reaches past the names of the
+ * snapshot is left empty, the header check at opening doesn't cover the records.
+ */
+static void base_booking(const booking_store *store, unsigned int resource, size_t index, booking *out) {
+    const snapshot_record *record = &store->base->records[index];
+    const size_t len = record->name_len <= BOOKING_MAX_NAME
+                       && record->name_offset + record->name_len <= store->base->header->names_size
+                       ? record->name_len : 0;
+    out->id = record->id;
+    out->resource = resource;
+    out->start = record->start;
+    out->end = record->end;
+    memcpy(out->name, store->base->names + record->name_offset, len);
+    out->name[len] = '\0';
+}
+
+/**
+ * Looks up a booking of the base that was not cancelled, the lock has to be held
+ * @return index of its record, SIZE_MAX if there is none
+ */
+static size_t base_find(const booking_store *store, uint64_t id) {
+    if (id == 0 || id > store->base_ids) {
+        return SIZE_MAX;
+    }
+    const uint32_t entry = store->base->ids[id - 1];
+    if (entry == 0 || entry > store->base->header->record_count || base_is_cancelled(store, entry - 1)) {
+        return SIZE_MAX;
+    }
+    return entry - 1;
+}
+
+/**
+ * Finds a booking of a resource that overlaps [start, end), in its tree or in the base. The lock
+ * has to be held.
+ * @param store the store
+ * @param resource index of the resource
+ * @param start start of the time
+ * @param end end of the time, exclusive
+ * @param found set to the overlapping booking, may be NULL
+ * @return true if there is one
+ */
+static bool store_first_overlap(const booking_store *store, unsigned int resource, int64_t start, int64_t end,
+                                booking *found) {
+    const booking_node *node = interval_tree_first_overlap(&store->trees[resource], start, end);
+    if (node != NULL) {
+        if (found != NULL) {
+            *found = node->booking;
+        }
+        return true;
+    }
+    size_t last;
+    for (size_t i = base_overlaps(store, resource, start, end, &last); i < last; ++i) {
+        if (!base_is_cancelled(store, i)) {
+            if (found != NULL) {
+                base_booking(store, resource, i, found);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Frees the slots of a cancelled booking, already removed from its tree. The first and the last
+ * slot may be shared with the neighbouring bookings, they stay occupied if one still touches them.
+ * The write lock has to be held.
+ */
+static void slots_release(booking_store *store, const booking *cancelled) {
+    const size_t first = first_slot(cancelled->start);
+    const size_t end = end_slot(cancelled->end);
+    availability_set(store->slots, cancelled->resource, first, end, false);
+    const size_t edges[2] = {first, end - 1};
+    for (int i = 0; i < 2; ++i) {
+        const int64_t start = (int64_t) edges[i] * AVAILABILITY_SLOT_SECONDS;
+        if (store_first_overlap(store, cancelled->resource, start, start + AVAILABILITY_SLOT_SECONDS, NULL)) {
+            availability_set(store->slots, cancelled->resource, edges[i], edges[i] + 1, true);
+        }
+    }
+}
+
+/**
+ * Cancels a booking of the base, it is only marked in base_cancelled. The write lock has to be
+ * held.
+ * @param store the store
+ * @param index index of its record
+ * @param cancelled set to the booking
+ */
+static void base_cancel(booking_store *store, size_t index, booking *cancelled) {
+    base_booking(store, base_resource(store, index), index, cancelled);
+    store->base_cancelled[index / 64] |= (uint64_t) 1 << (index % 64);
+    slots_release(store, cancelled);
+}
+
+/**
+ * Looks up a booking created after the snapshot that was not cancelled, the lock has to be held
+ */
+static booking_node *find_by_id(const booking_store *store, uint64_t id) {
+    return id > store->base_ids && id <= store->last_id ? store->by_id[id - store->base_ids - 1] : NULL;
+}
+
+/**
+ * Adds a booking with its id to tree, id index and bitmaps. The write lock has to be held.
+ * @param store the store
+ * @param data the booking, valid and not overlapping another one of its resource
+ * @return the new node
+ */
+static booking_node *store_insert(booking_store *store, const booking *data) {
+    const size_t index = data->id - store->base_ids - 1;
+    if (index >= store->id_capacity) {
+        size_t capacity = store->id_capacity > 0 ? store->id_capacity : BOOKING_INITIAL_IDS;
+        while (capacity <= index) {
+            capacity *= 2;
+        }
+        booking_node **by_id = realloc(store->by_id, capacity * sizeof(booking_node *));
+        if (by_id == NULL) {
+            exit(2);
+        }
+        memset(by_id + store->id_capacity, 0, (capacity - store->id_capacity) * sizeof(booking_node *));
+        store->by_id = by_id;
+        store->id_capacity = capacity;
+    }
+    booking_node *node = calloc(1, sizeof(booking_node));
+    if (node == NULL) {
+        exit(2);
+    }
+    node->booking = *data;
+    store->by_id[index] = node;
+    if (data->id > store->last_id) {
+        store->last_id = data->id;
+    }
+    interval_tree_insert(&store->trees[data->resource], node);
+    availability_set(store->slots, data->resource, first_slot(data->start), end_slot(data->end), true);
+    return node;
+}
+
+/**
+ * Removes a booking from tree, id index and bitmaps without freeing it. The write lock has to
+ * be held.
+ */
+static void store_remove(booking_store *store, booking_node *node) {
+    interval_tree_remove(&store->trees[node->booking.resource], node);
+    slots_release(store, &node->booking);
+    store->by_id[node->booking.id - store->base_ids - 1] = NULL;
+}
+
+static void put_u64(unsigned char *dest, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        dest[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static uint64_t get_u64(const unsigned char *src) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= (uint64_t) src[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * Appends a change to the log of the store. Called under the write lock, so the log holds the
+ * changes in the order they were made.
+ * @param store the store
+ * @param type BOOKING_RECORD_CREATE (with all fields) or BOOKING_RECORD_CANCEL (only the id)
+ * @param data the booking
+ * @return the LSN of the record, 0 if the store has no log
+ */
+static uint64_t log_change(booking_store *store, unsigned char type, const booking *data) {
+    if (store->log == NULL) {
+        return 0;
+    }
+    unsigned char record[BOOKING_RECORD_MAX];
+    size_t len = 0;
+    record[len++] = type;
+    put_u64(record + len, data->id);
+    len += 8;
+    if (type == BOOKING_RECORD_CREATE) {
+        const size_t name_len = strlen(data->name);
+        record[len++] = (unsigned char) data->resource;
+        put_u64(record + len, (uint64_t) data->start);
+        put_u64(record + len + 8, (uint64_t) data->end);
+        len += 16;
+        record[len++] = (unsigned char) name_len;
+        memcpy(record + len, data->name, name_len);
+        len += name_len;
+    }
+    return wal_append(store->log, record, len);
+}
+
+/**
+ * Applies a record of the log while it is replayed by wal_open, see log_change. Records that
+ * don't fit the store (e.g. written by another version) are skipped.
+ * @param arg the store
+ * @param data the record
+ * @param len length of the record
+ */
+static void replay_change(void *arg, const char *data, size_t len) {
+    booking_store *store = arg;
+    const unsigned char *record = (const unsigned char *) data;
+    if (len < 9) {
+        return;
+    }
+    booking entry = {0};
+    entry.id = get_u64(record + 1);
+    if (record[0] == BOOKING_RECORD_CANCEL && len == 9) {
+        booking_node *node = find_by_id(store, entry.id);
+        const size_t index = base_find(store, entry.id);
+        if (node != NULL) {
+            store_remove(store, node);
+            free(node);
+        } else if (index != SIZE_MAX) {
+            base_cancel(store, index, &entry);
+        }
+        return;
+    }
+    if (record[0] != BOOKING_RECORD_CREATE || len < 27 || len != 27 + (size_t) record[26]) {
+        return;
+    }
+    entry.resource = record[9];
+    entry.start = (int64_t) get_u64(record + 10);
+    entry.end = (int64_t) get_u64(record + 18);
+    const size_t name_len = record[26];
+    if (entry.id <= store->base_ids || find_by_id(store, entry.id) != NULL || entry.resource >= BOOKING_RESOURCE_COUNT
+        || entry.start < 0 || entry.end <= entry.start || entry.end > BOOKING_MAX_END || name_len == 0
+        || name_len > BOOKING_MAX_NAME || store_first_overlap(store, entry.resource, entry.start, entry.end, NULL)) {
+        return;
+    }
+    memcpy(entry.name, record + 27, name_len);
+    store_insert(store, &entry);
+}
+
+/**
+ * Opens a store from a snapshot. The bookings are read from the mapped file where they are, only
+ * the occupancy bitmaps are copied, so this takes milliseconds for any number of bookings.
+ * Bookings cancelled later are marked in base_cancelled, new ones go into the trees.
+ * @param store a new store, booking_store_open_log follows to replay the log behind the snapshot
+ * @param path path of the snapshot, see booking_store_snapshot
+ * @return true on success, false if there is no valid snapshot (errno is set, ENOENT if the file
+ * doesn't exist)
+ */
+bool booking_store_open_snapshot(booking_store *store, const char *path) {
+    snapshot *base = snapshot_open(path, BOOKING_RESOURCE_COUNT);
+    if (base == NULL) {
+        return false;
+    }
+    const snapshot_header *header = base->header;
+    if (header->slot_words != store->slots->words) {
+        snapshot_close(base);
+        errno = EINVAL;
+        return false;
+    }
+    pthread_rwlock_wrlock(&store->lock);
+    for (size_t i = 0; i < BOOKING_RESOURCE_COUNT; ++i) {
+        memcpy(store->slots->bitmaps[i], base->bitmaps + i * store->slots->words,
+               store->slots->words * sizeof(uint64_t));
+    }
+    store->base_cancelled = calloc((size_t) header->record_count / 64 + 1, sizeof(uint64_t));
+    if (store->base_cancelled == NULL) {
+        exit(2);
+    }
+    store->base = base;
+    store->base_ids = header->last_id;
+    store->last_id = header->last_id;
+    pthread_rwlock_unlock(&store->lock);
+    return true;
+}
+
+/**
+ * Forgets the snapshot a store was opened from, before anything was replayed behind it; the store
+ * is empty again
+ */
+static void store_drop_base(booking_store *store) {
+    for (size_t i = 0; i < BOOKING_RESOURCE_COUNT; ++i) {
+        memset(store->slots->bitmaps[i], 0, store->slots->words * sizeof(uint64_t));
+    }
+    snapshot_close(store->base);
+    free(store->base_cancelled);
+    store->base = NULL;
+    store->base_cancelled = NULL;
+    store->base_ids = 0;
+    store->last_id = 0;
+}
+
+/**
+ * Makes the bookings of a store persistent: replays the log into the store, then appends every
+ * create and cancel to it. A store opened from a snapshot replays only the records behind it; if
+ * the log doesn't reach the snapshot, the snapshot is dropped and the whole log is replayed.
+ * @param store a new store, possibly opened from a snapshot
+ * @param path path of the log file, created if missing
+ * @param durability when a change counts as durable, see wal_durability
+ * @return true on success, false if the log can't be opened (errno is set)
+ */
+bool booking_store_open_log(booking_store *store, const char *path, wal_durability durability) {
+    pthread_rwlock_wrlock(&store->lock);
+    const uint64_t from = store->base != NULL ? store->base->header->lsn : 0;
+    store->log = wal_open(path, durability, from, replay_change, store);
+    if (store->log == NULL && errno == EINVAL && store->base != NULL) {
+        //the log lost records the snapshot contains, e.g. one written without syncing the log; the
+        //log is the truth, so it is replayed from its start
+        store_drop_base(store);
+        store->log = wal_open(path, durability, 0, replay_change, store);
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return store->log != NULL;
+}
+
+/**
+ * Books a resource if the time is still free
+ * @param store the store
+ * @param resource index of the resource
+ * @param start start of the time in seconds since the epoch
+ * @param end end of the time, exclusive; bookings may touch, [10, 20) and [20, 30) don't overlap
+ * @param name who books, not null terminated
+ * @param name_len length of the name, 1 to BOOKING_MAX_NAME
+ * @param created set to the new booking on BOOKING_OK, may be NULL
+ * @param conflict set to an overlapping booking on BOOKING_CONFLICT, may be NULL
+ * @param lsn set to the LSN of the log record on BOOKING_OK, 0 without a log; the booking may only
+ * be acknowledged once it is durable (see wal_is_durable). May be NULL.
+ * @return BOOKING_OK, BOOKING_CONFLICT or BOOKING_INVALID
+ */
+booking_status booking_create(booking_store *store, unsigned int resource, int64_t start, int64_t end,
+                              const char *name, size_t name_len, booking *created, booking *conflict,
+                              uint64_t *lsn) {
+    if (resource >= BOOKING_RESOURCE_COUNT || start < 0 || end <= start || end > BOOKING_MAX_END || name_len == 0
+        || name_len > BOOKING_MAX_NAME) {
+        return BOOKING_INVALID;
+    }
+    pthread_rwlock_wrlock(&store->lock);
+    if (store_first_overlap(store, resource, start, end, conflict)) {
+        pthread_rwlock_unlock(&store->lock);
+        return BOOKING_CONFLICT;
+    }
+    booking entry = {0};
+    entry.id = store->last_id + 1;
+    entry.resource = resource;
+    entry.start = start;
+    entry.end = end;
+    memcpy(entry.name, name, name_len);
+    store_insert(store, &entry);
+    const uint64_t record = log_change(store, BOOKING_RECORD_CREATE, &entry);
+    pthread_rwlock_unlock(&store->lock);
+    if (created != NULL) {
+        *created = entry;
+    }
+    if (lsn != NULL) {
+        *lsn = record;
+    }
+    return BOOKING_OK;
+}
+
+/**
+ * Cancels a booking, its time becomes free again
+ * @param store the store
+ * @param id id of the booking
+ * @param cancelled set to the cancelled booking on BOOKING_OK, may be NULL
+ * @param lsn set to the LSN of the log record on BOOKING_OK, see booking_create; may be NULL
+ * @return BOOKING_OK or BOOKING_NOT_FOUND
+ */
+booking_status booking_cancel(booking_store *store, uint64_t id, booking *cancelled, uint64_t *lsn) {
+    pthread_rwlock_wrlock(&store->lock);
+    booking_node *node = find_by_id(store, id);
+    const size_t index = node == NULL ? base_find(store, id) : SIZE_MAX;
+    if (node == NULL && index == SIZE_MAX) {
+        pthread_rwlock_unlock(&store->lock);
+        return BOOKING_NOT_FOUND;
+    }
+    booking entry;
+    if (node != NULL) {
+        store_remove(store, node);
+        entry = node->booking;
+        free(node);
+    } else {
+        base_cancel(store, index, &entry);
+    }
+    const uint64_t record = log_change(store, BOOKING_RECORD_CANCEL, &entry);
+    pthread_rwlock_unlock(&store->lock);
+    if (cancelled != NULL) {
+        *cancelled = entry;
+    }
+    if (lsn != NULL) {
+        *lsn = record;
+    }
+    return BOOKING_OK;
+}
+
+/**
+ * Returns a booking by id
+ * @param store the store
+ * @param id id of the booking
+ * @param result set to the booking on BOOKING_OK
+ * @return BOOKING_OK or BOOKING_NOT_FOUND
+ */
+booking_status booking_get(booking_store *store, uint64_t id, booking *result) {
+    pthread_rwlock_rdlock(&store->lock);
+    const booking_node *node = find_by_id(store, id);
+    const size_t index = node == NULL ? base_find(store, id) : SIZE_MAX;
+    if (node != NULL) {
+        *result = node->booking;
+    } else if (index != SIZE_MAX) {
+        base_booking(store, base_resource(store, index), index, result);
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return node != NULL || index != SIZE_MAX ? BOOKING_OK : BOOKING_NOT_FOUND;
+}
+
+/**
+ * Visits the bookings of a resource that overlap a time in the order of their start, merging
+ * its tree with the records of the base
+ */
+typedef struct store_walk {
+    const booking_store *store;
+    unsigned int resource;
+    int64_t start;
+    int64_t end;
+    //the overlapping records of the base not visited yet
+    size_t next;
+    size_t last;
+    //returns false to stop the walk
+    bool (*visit)(void *arg, const booking *visited);
+    void *arg;
+    bool stopped;
+} store_walk;
+
+/**
+ * Visits the records of the base that start before a time
+ */
+static void walk_base(store_walk *walk, int64_t before) {
+    while (!walk->stopped && walk->next < walk->last && walk->store->base->records[walk->next].start < before) {
+        if (!base_is_cancelled(walk->store, walk->next)) {
+            booking entry;
+            base_booking(walk->store, walk->resource, walk->next, &entry);
+            walk->stopped = !walk->visit(walk->arg, &entry);
+        }
+        walk->next++;
+    }
+}
+
+/**
+ * Visits the overlapping bookings of a subtree in order, each after the records of the base
+ * starting before it
+ */
+static void walk_nodes(store_walk *walk, const booking_node *node) {
+    if (node == NULL || walk->stopped || node->max_end <= walk->start) {
+        return;
+    }
+    walk_nodes(walk, node->left);
+    if (!walk->stopped && node->booking.start < walk->end) {
+        if (node->booking.end > walk->start) {
+            walk_base(walk, node->booking.start);
+            walk->stopped = walk->stopped || !walk->visit(walk->arg, &node->booking);
+        }
+        walk_nodes(walk, node->right);
+    }
+}
+
+/**
+ * Visits the bookings of a resource that overlap [start, end) in the order of their start. The
+ * lock has to be held.
+ * @param store the store
+ * @param resource index of the resource
+ * @param start start of the time
+ * @param end end of the time, exclusive
+ * @param visit called for every booking, the walk stops when it returns false
+ * @param arg passed to visit
+ */
+static void store_walk_resource(const booking_store *store, unsigned int resource, int64_t start, int64_t end,
+                                bool (*visit)(void *arg, const booking *visited), void *arg) {
+    store_walk walk = {store, resource, start, end, 0, 0, visit, arg, false};
+    walk.next = base_overlaps(store, resource, start, end, &walk.last);
+    walk_nodes(&walk, store->trees[resource].root);
+    walk_base(&walk, INT64_MAX);
+}
+
+/**
+ * Where booking_list copies the bookings to
+ */
+typedef struct list_output {
+    booking *out;
+    size_t max;
+    size_t count;
+} list_output;
+
+static bool list_visit(void *arg, const booking *visited) {
+    list_output *output = arg;
+    output->out[output->count++] = *visited;
+    return output->count < output->max;
+}
+
+/**
+ * Lists who has a resource between start and end: all bookings overlapping [start, end), ordered
+ * by resource and start
+ * @param store the store
+ * @param resource index of the resource or BOOKING_ALL_RESOURCES
+ * @param start start of the time
+ * @param end end of the time, exclusive
+ * @param out set to copies of the bookings
+ * @param max room in out, at most this many are listed
+ * @return number of listed bookings
+ */
+size_t booking_list(booking_store *store, unsigned int resource, int64_t start, int64_t end, booking *out,
+                    size_t max) {
+    //no booking reaches past BOOKING_MAX_END, the bound keeps later times out of the arithmetic
+    if (start >= BOOKING_MAX_END || end <= start) {
+        return 0;
+    }
+    if (end > BOOKING_MAX_END) {
+        end = BOOKING_MAX_END;
+    }
+    list_output output = {out, max, 0};
+    pthread_rwlock_rdlock(&store->lock);
+    for (unsigned int i = 0; i < BOOKING_RESOURCE_COUNT && output.count < max; ++i) {
+        if (resource == BOOKING_ALL_RESOURCES || resource == i) {
+            store_walk_resource(store, i, start, end, list_visit, &output);
+        }
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return output.count;
+}
+
+static bool snapshot_visit(void *arg, const booking *visited) {
+    snapshot_writer_add(arg, visited->resource, visited->id, visited->start, visited->end, visited->name,
+                        strlen(visited->name));
+    return true;
+}
+
+/**
+ * Writes all bookings into a snapshot, so the next start maps it instead of replaying the whole
+ * log. The bookings and bitmaps are only copied under the read lock, so changes wait for the
+ * copy; writing, syncing and replacing the file happen without the lock.
+ * @param store the store
+ * @param path path of the snapshot, replaced atomically
+ * @return true on success, false on an error (errno is set), the old snapshot stays then
+ */
+bool booking_store_snapshot(booking_store *store, const char *path) {
+    pthread_rwlock_rdlock(&store->lock);
+    //changes are appended under the write lock, so the log ends exactly behind the bookings
+    const uint64_t lsn = store->log != NULL ? wal_appended(store->log) : 0;
+    //at most the records of the base and the bookings of the trees
+    size_t expected = store->base != NULL ? (size_t) store->base->header->record_count : 0;
+    for (unsigned int i = 0; i < BOOKING_RESOURCE_COUNT; ++i) {
+        expected += store->trees[i].count;
+    }
+    snapshot_writer *writer = snapshot_writer_new(path, BOOKING_RESOURCE_COUNT, lsn, store->last_id,
+                                                  store->slots->words, expected);
+    if (writer == NULL) {
+        pthread_rwlock_unlock(&store->lock);
+        return false;
+    }
+    for (unsigned int i = 0; i < BOOKING_RESOURCE_COUNT; ++i) {
+        store_walk_resource(store, i, 0, BOOKING_MAX_END, snapshot_visit, writer);
+    }
+    const bool ended = snapshot_writer_end(writer, (const uint64_t *const *) store->slots->bitmaps);
+    pthread_rwlock_unlock(&store->lock);
+    if (!ended) {
+        const int saved = errno;
+        snapshot_writer_abort(writer);
+        errno = saved;
+        return false;
+    }
+    //a snapshot ahead of the log on disk couldn't be continued after a crash, so the log is synced
+    //up to its LSN first, even if the log itself is never synced
+    if (store->log != NULL && !wal_sync_to(store->log, lsn)) {
+        const int saved = errno;
+        snapshot_writer_abort(writer);
+        errno = saved;
+        return false;
+    }
+    return snapshot_writer_commit(writer);
+}
+
+/**
+ * Finds the times when all of several resources are free for at least a duration, e.g. "when are
+ * the guest room and the kitchen both free this week". Answered from the occupancy bitmaps, so
+ * times are rounded to whole slots of AVAILABILITY_SLOT_SECONDS: a slot touched by a booking is
+ * not free.
+ * @param store the store
+ * @param resources indices of the resources
+ * @param count number of resources, 1 to BOOKING_RESOURCE_COUNT
+ * @param start start of the search, rounded up to a slot
+ * @param end end of the search, rounded down to a slot
+ * @param duration seconds a window needs at least, rounded up to whole slots
+ * @param out set to the free windows in ascending order, cut at start and end
+ * @param max room in out, at most this many are listed
+ * @return number of listed windows
+ */
+size_t booking_free_slots(booking_store *store, const unsigned int *resources, size_t count, int64_t start,
+                          int64_t end, int64_t duration, booking_window *out, size_t max) {
+    //nothing is free after BOOKING_MAX_END, later starts would also overflow end_slot
+    if (count == 0 || count > BOOKING_RESOURCE_COUNT || start < 0 || start >= BOOKING_MAX_END || end <= start
+        || duration <= 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (resources[i] >= BOOKING_RESOURCE_COUNT) {
+            return 0;
+        }
+    }
+    availability_run runs[BOOKING_FREE_CHUNK];
+    size_t first = end_slot(start);
+    const size_t last = first_slot(end < BOOKING_MAX_END ? end : BOOKING_MAX_END);
+    const size_t length = end_slot(duration < BOOKING_MAX_END ? duration : BOOKING_MAX_END);
+    size_t listed = 0;
+    pthread_rwlock_rdlock(&store->lock);
+    while (listed < max) {
+        const size_t wanted = max - listed < BOOKING_FREE_CHUNK ? max - listed : BOOKING_FREE_CHUNK;
+        const size_t found = availability_find(store->slots, resources, count, first, last, length, runs, wanted);
+        for (size_t i = 0; i < found; ++i) {
+            out[listed].start = (int64_t) runs[i].first * AVAILABILITY_SLOT_SECONDS;
+            out[listed].end = (int64_t) (runs[i].first + runs[i].count) * AVAILABILITY_SLOT_SECONDS;
+            listed++;
+        }
+        if (found < wanted) {
+            break;
+        }
+        //a run ends before an occupied slot, so the search continues there without cutting one
+        first = runs[found - 1].first + runs[found - 1].count;
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return listed;
+}
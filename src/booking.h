@@ -0,0 +1,129 @@
+#ifndef BOOKING_H
+#define BOOKING_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "availability.h"
+#include "snapshot.h"
+#include "wal.h"
+
+//Longest name of the person who books, in bytes.
+#define BOOKING_MAX_NAME 64
+//Number of bookable resources, see booking_resource_name.
+#define BOOKING_RESOURCE_COUNT 4
+//Passed as resource to booking_list to list the bookings of all resources.
+#define BOOKING_ALL_RESOURCES BOOKING_RESOURCE_COUNT
+//Bookings end at the latest on 2100-01-01, this bounds the occupancy bitmaps.
+#define BOOKING_MAX_END 4102444800
+
+typedef struct booking {
+    //unique, assigned in ascending order starting at 1
+    uint64_t id;
+    unsigned int resource;
+    //the booked time [start, end) in seconds since the epoch
+    int64_t start;
+    int64_t end;
+    //null terminated
+    char name[BOOKING_MAX_NAME + 1];
+} booking;
+
+//A booking in the interval tree of its resource.
+typedef struct booking_node {
+    booking booking;
+    struct booking_node *left;
+    struct booking_node *right;
+    //the largest end in this subtree, to skip subtrees that end before a query starts
+    int64_t max_end;
+    int height;
+} booking_node;
+
+/**
+ * An interval tree: an AVL tree ordered by start (and id), every node knows the largest end in
+ * its subtree. Finding one overlapping interval takes O(log n), listing k of them O(log n + k).
+ */
+typedef struct interval_tree {
+    booking_node *root;
+    size_t count;
+} interval_tree;
+
+//A time [start, end) in seconds since the epoch, e.g. a free window of booking_free_slots.
+typedef struct booking_window {
+    int64_t start;
+    int64_t end;
+} booking_window;
+
+typedef enum booking_status {
+    BOOKING_OK,
+    //the time overlaps an existing booking of the resource
+    BOOKING_CONFLICT,
+    BOOKING_NOT_FOUND,
+    //unknown resource, empty or reversed time, ends after BOOKING_MAX_END, empty or too long name
+    BOOKING_INVALID
+} booking_status;
+
+/**
+ * All bookings of all resources, one interval tree per resource. It is shared by all workers
+ * and protected by a read-write lock; functions return copies, so callers never see a booking
+ * change underneath them. A store opened from a snapshot keeps the bookings of the snapshot in
+ * the mapped file (the base) and only the later ones in the trees.
+ */
+typedef struct booking_store {
+    pthread_rwlock_t lock;
+    interval_tree trees[BOOKING_RESOURCE_COUNT];
+    //bookings of the trees by id - base_ids - 1, NULL once cancelled
+    booking_node **by_id;
+    size_t id_capacity;
+    uint64_t last_id;
+    //which 15 minute slots of each resource are booked, kept up to date with the trees
+    availability *slots;
+    //every change is appended here before it is acknowledged, NULL keeps bookings in memory only
+    wal *log;
+    //the snapshot the store was opened from, NULL without one
+    snapshot *base;
+    //bit i is set once record i of base was cancelled
+    uint64_t *base_cancelled;
+    //the largest id in base, later ids are in by_id
+    uint64_t base_ids;
+} booking_store;
+
+void interval_tree_insert(interval_tree *tree, booking_node *node);
+
+void interval_tree_remove(interval_tree *tree, booking_node *node);
+
+const booking_node *interval_tree_first_overlap(const interval_tree *tree, int64_t start, int64_t end);
+
+size_t interval_tree_overlaps(const interval_tree *tree, int64_t start, int64_t end, const booking **out,
+                              size_t max);
+
+const char *booking_resource_name(unsigned int resource);
+
+int booking_resource_find(const char *name, size_t len);
+
+booking_store *booking_store_new(void);
+
+void booking_store_free(booking_store *store);
+
+bool booking_store_open_snapshot(booking_store *store, const char *path);
+
+bool booking_store_open_log(booking_store *store, const char *path, wal_durability durability);
+
+bool booking_store_snapshot(booking_store *store, const char *path);
+
+booking_status booking_create(booking_store *store, unsigned int resource, int64_t start, int64_t end,
+                              const char *name, size_t name_len, booking *created, booking *conflict,
+                              uint64_t *lsn);
+
+booking_status booking_cancel(booking_store *store, uint64_t id, booking *cancelled, uint64_t *lsn);
+
+booking_status booking_get(booking_store *store, uint64_t id, booking *result);
+
+size_t booking_list(booking_store *store, unsigned int resource, int64_t start, int64_t end, booking *out,
+                    size_t max);
+
+size_t booking_free_slots(booking_store *store, const unsigned int *resources, size_t count, int64_t start,
+                          int64_t end, int64_t duration, booking_window *out, size_t max);
+
+#endif //BOOKING_H
@@ -0,0 +1,493 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "connection.h"
+#include "http_server.h"
+
+#define CONNECTION_INITIAL_BUFFER 4096
+//Solange mehr Bytes auf das Senden warten, werden keine weiteren Pipeline-Requests verarbeitet.
+#define CONNECTION_OUTPUT_LIMIT (64*1024)
+//Höchstens so viele Puffer werden mit einem writev() geschrieben.
+#define CONNECTION_MAX_IOV 64
+
+/**
+ * Bereitet eine Response zum Senden vor, indem ihr Header serialisiert wird.
+ * Das outgoing wird wie die Response in der Arena des Threads angelegt (siehe arena_use).
+ * @param response Die Response, sie gehört danach dem outgoing.
+ * @return Das neue outgoing, muss mit outgoing_free freigegeben werden.
+ */
+outgoing *outgoing_new(http_response *response) {
+    outgoing *out = arena_calloc(1, sizeof(outgoing));
+    if (out == NULL) {
+        exit(2);
+    }
+    out->response = response;
+    if (response->prepared_header != NULL) {
+        out->header = response->prepared_header;
+    } else {
+        out->serialized = response_header_string(response);
+        out->header = out->serialized;
+    }
+    return out;
+}
+
+/**
+ * Gibt ein outgoing samt Response frei. Eine Datei der Response wird dabei geschlossen.
+ * @param out Das freizugebende outgoing.
+ */
+void outgoing_free(outgoing *out) {
+    if (out->serialized != NULL) {
+        str_free(out->serialized);
+    }
+    free_response(out->response);
+    arena_free(out);
+}
+
+/**
+ * Kopiert einen Teil der Datei über einen Puffer, falls *fd* kein Ziel für sendfile() ist.
+ * @param fd Das Ziel.
+ * @param file Die zu sendende Datei, offset und length werden fortgeschrieben.
+ * @return Anzahl geschriebener Bytes, -1 bei einem Fehler (errno ist gesetzt).
+ */
+static ssize_t copy_file(int fd, http_file *file) {
+    char buffer[65536];
+    size_t chunk = file->length < sizeof(buffer) ? file->length : sizeof(buffer);
+    ssize_t length = pread(file->fd, buffer, chunk, file->offset);
+    if (length <= 0) {
+        return length;
+    }
+    return write(fd, buffer, (size_t) length);
+}
+
+/**
+ * Gibt die Anzahl der Bytes aus dem Speicher (Header und Body) zurück, die noch nicht gesendet wurden.
+ * @param out Die Response.
+ * @return Anzahl der ausstehenden Bytes ohne eine Datei.
+ */
+static size_t outgoing_memory_remaining(const outgoing *out) {
+    const string *body = out->response->body;
+    const size_t body_len = body != NULL && body->str != NULL ? body->len : 0;
+    return out->header->len + body_len - out->sent;
+}
+
+/**
+ * Trägt die noch nicht gesendeten Teile aus dem Speicher in *iov* ein, ohne sie zu kopieren.
+ * @param out Die Response.
+ * @param iov Platz für mindestens zwei Einträge.
+ * @return Anzahl der eingetragenen Einträge (0 bis 2).
+ */
+static int outgoing_iovec(const outgoing *out, struct iovec *iov) {
+    const string *header = out->header;
+    const string *body = out->response->body;
+    int count = 0;
+    if (out->sent < header->len) {
+        iov[count].iov_base = header->str + out->sent;
+        iov[count].iov_len = header->len - out->sent;
+        count++;
+    }
+    if (body != NULL && body->str != NULL && body->len > 0) {
+        const size_t body_sent = out->sent > header->len ? out->sent - header->len : 0;
+        if (body_sent < body->len) {
+            iov[count].iov_base = body->str + body_sent;
+            iov[count].iov_len = body->len - body_sent;
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Sendet so viel der Response wie möglich auf *fd*: erst Header und Body aus dem Speicher
+ * gemeinsam per writev(), dann eine Datei direkt per sendfile() ohne Umweg über den Userspace.
+ * Bei einem nicht-blockierenden Socket kann das in mehreren Aufrufen geschehen.
+ * @param fd Socket oder Datei, auf die geschrieben wird.
+ * @param out Die zu sendende Response.
+ * @return 1 wenn die Response vollständig gesendet wurde, 0 wenn *fd* voll ist, -1 bei einem Fehler.
+ */
+short outgoing_send(int fd, outgoing *out) {
+    while (outgoing_memory_remaining(out) > 0) {
+        struct iovec iov[2];
+        ssize_t length = writev(fd, iov, outgoing_iovec(out, iov));
+        if (length >= 0) {
+            out->sent += (size_t) length;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    http_file *file = out->response->file;
+    bool use_sendfile = true;
+    while (file != NULL && file->length > 0) {
+        ssize_t length = use_sendfile ? sendfile(fd, file->fd, &file->offset, file->length) : copy_file(fd, file);
+        if (length > 0) {
+            if (!use_sendfile) {
+                file->offset += length;
+            }
+            file->length -= (size_t) length;
+        } else if (length == 0) {
+            //Die Datei ist kürzer geworden, der angekündigte Content-Length kann nicht mehr eingehalten werden.
+            return -1;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (use_sendfile && (errno == EINVAL || errno == ENOSYS)) {
+            use_sendfile = false;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Erstellt eine neue Verbindung für den bereits nicht-blockierenden Socket *fd*.
+ * Im Fehlerfall (kein Speicher verfügbar) wird das Programm beendet.
+ * @param fd Der Socket des Clients.
+ * @param ctx Der Zustand des Workers, an process() weitergereicht.
+ * @return Die neue Verbindung im Zustand CONNECTION_READING.
+ */
+connection *connection_new(int fd, process_context *ctx) {
+    connection *conn = calloc(1, sizeof(connection));
+    if (conn == NULL) {
+        exit(2);
+    }
+    conn->fd = fd;
+    conn->ctx = ctx;
+    conn->arena = arena_new(ARENA_DEFAULT_SIZE);
+    conn->parser.max_header = ctx->max_header_bytes;
+    conn->parser.max_body = ctx->max_body_bytes;
+    conn->state = CONNECTION_READING;
+    conn->last_active = connection_now();
+    return conn;
+}
+
+/**
+ * Schließt den Socket der Verbindung und gibt alle Puffer frei.
+ * Durch das Schließen wird der Socket auch aus dem epoll-Set entfernt.
+ * @param conn Die freizugebende Verbindung.
+ */
+void connection_free(connection *conn) {
+    close(conn->fd);
+    free(conn->in);
+    //Ausstehende Responses halten evtl. noch Dateien oder Cache-Einträge.
+    arena *previous = arena_use(conn->arena);
+    while (conn->out_head != NULL) {
+        outgoing *next = conn->out_head->next;
+        outgoing_free(conn->out_head);
+        conn->out_head = next;
+    }
+    arena_use(previous);
+    arena_destroy(conn->arena);
+    free(conn);
+}
+
+/**
+ * Gibt die größte Länge des Lesepuffers zurück: ein Request mit maximalem Header und Body.
+ * Größere Requests lehnt der Parser ab, bevor der Puffer voll ist.
+ * @param conn Die Verbindung.
+ * @return Die Länge in Bytes.
+ */
+static size_t buffer_limit(const connection *conn) {
+    return conn->ctx->max_header_bytes + conn->ctx->max_body_bytes;
+}
+
+/**
+ * Liest so viele Daten wie verfügbar vom Socket in den Lesepuffer. Der Puffer beginnt
+ * klein und wird bei Bedarf verdoppelt, maximal aber auf buffer_limit().
+ * @param conn Die Verbindung.
+ * @return 1 wenn Daten gelesen wurden oder der Client seine Seite geschlossen hat,
+ * 0 wenn nichts gelesen werden konnte, -1 bei einem Fehler.
+ */
+static short fill_buffer(connection *conn) {
+    short progress = 0;
+    while (!conn->eof) {
+        if (conn->in_len == conn->in_cap) {
+            if (conn->in_cap >= buffer_limit(conn)) {
+                return progress;
+            }
+            size_t cap = conn->in_cap == 0 ? CONNECTION_INITIAL_BUFFER : conn->in_cap * 2;
+            if (cap > buffer_limit(conn)) {
+                cap = buffer_limit(conn);
+            }
+            char *in = realloc(conn->in, cap);
+            if (in == NULL) {
+                return -1;
+            }
+            conn->in = in;
+            conn->in_cap = cap;
+        }
+        ssize_t length = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (length > 0) {
+            conn->in_len += (size_t) length;
+            progress = 1;
+        } else if (length == 0) {
+            conn->eof = true;
+            progress = 1;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return progress;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return progress;
+}
+
+/**
+ * Beantwortet alle vollständig empfangenen Requests im Lesepuffer der Reihe nach
+ * und hängt die Responses an den Schreibpuffer an.
+ * @param conn Die Verbindung.
+ * @return 1 wenn mindestens ein Request verarbeitet wurde, sonst 0.
+ */
+static short dispatch_requests(connection *conn) {
+    size_t offset = 0;
+    while (!conn->close_after_write && conn->out_pending < CONNECTION_OUTPUT_LIMIT) {
+        size_t remaining = conn->in_len - offset;
+        http_request_view request;
+        http_parse_status status = http_parse_request(&conn->parser, conn->in + offset, remaining, &request);
+        if (status == HTTP_PARSE_INCOMPLETE) {
+            if (remaining == 0 || (!conn->eof && conn->in_len < buffer_limit(conn))) {
+                break;
+            }
+            //Der Client sendet nichts mehr oder der Puffer ist voll, der Request wird nie vollständig.
+            status = HTTP_PARSE_INVALID;
+        }
+        bool keep_alive = !conn->close_after_write && conn->requests + 1 < KEEP_ALIVE_MAX_REQUESTS;
+        outgoing *out;
+        if (status == HTTP_PARSE_COMPLETE) {
+            out = outgoing_new(process(conn->ctx, &request, &keep_alive));
+            offset += request.length;
+        } else {
+            //Ohne gültigen Request ist nicht klar, wo der nächste beginnt, der Rest wird verworfen.
+            out = outgoing_new(reject(status, &keep_alive));
+            offset = conn->in_len;
+        }
+        conn->requests++;
+        if (!keep_alive) {
+            conn->close_after_write = true;
+        }
+
+        conn->out_pending += out->header->len;
+        if (out->response->body != NULL) {
+            conn->out_pending += out->response->body->len;
+        }
+        if (conn->out_tail == NULL) {
+            conn->out_head = out;
+        } else {
+            conn->out_tail->next = out;
+        }
+        conn->out_tail = out;
+    }
+    if (offset == 0) {
+        return 0;
+    }
+    //Entferne die beantworteten Requests aus dem Lesepuffer.
+    memmove(conn->in, conn->in + offset, conn->in_len - offset);
+    conn->in_len -= offset;
+    return 1;
+}
+
+/**
+ * Prüft, ob eine Response gesendet werden darf: eine Response, die eine Änderung der Buchungen
+ * bestätigt, erst wenn deren Eintrag im Write-Ahead-Log auf der Platte ist.
+ * @param conn Die Verbindung.
+ * @param out Die wartende Response.
+ * @return true wenn sie gesendet werden darf.
+ */
+static bool outgoing_ready(const connection *conn, const outgoing *out) {
+    const booking_store *store = conn->ctx->bookings;
+    return out->response->durable_lsn == 0 || store == NULL || store->log == NULL
+           || wal_is_durable(store->log, out->response->durable_lsn);
+}
+
+/**
+ * Schreibt Header und Bodies aus dem Speicher mehrerer wartender Responses mit einem
+ * einzigen writev(). Eine Response mit Datei beendet die Sammlung, da ihre Datei direkt
+ * nach ihrem Header gesendet werden muss, eine noch nicht dauerhafte Response (siehe
+ * outgoing_ready) beendet sie vor sich.
+ * @param conn Die Verbindung.
+ * @return 1 wenn alles Gesammelte geschrieben wurde, 0 wenn der Socket voll ist, -1 bei einem Fehler.
+ */
+static short write_queued(connection *conn) {
+    struct iovec iov[CONNECTION_MAX_IOV];
+    int count = 0;
+    size_t total = 0;
+    for (outgoing *out = conn->out_head; out != NULL && count + 2 <= CONNECTION_MAX_IOV; out = out->next) {
+        if (out != conn->out_head && !outgoing_ready(conn, out)) {
+            break;
+        }
+        count += outgoing_iovec(out, iov + count);
+        total += outgoing_memory_remaining(out);
+        if (out->response->file != NULL) {
+            break;
+        }
+    }
+    ssize_t length;
+    do {
+        length = writev(conn->fd, iov, count);
+    } while (length < 0 && errno == EINTR);
+    if (length < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    //Verteile die geschriebenen Bytes der Reihe nach auf die Responses.
+    size_t written = (size_t) length;
+    for (outgoing *out = conn->out_head; written > 0; out = out->next) {
+        const size_t part = written < outgoing_memory_remaining(out) ? written : outgoing_memory_remaining(out);
+        out->sent += part;
+        written -= part;
+    }
+    return (size_t) length == total;
+}
+
+/**
+ * Schreibt so viele der ausstehenden Responses wie möglich auf den Socket. Die Reihenfolge der
+ * Responses bleibt erhalten, daher hält eine noch nicht dauerhafte Response auch alle folgenden
+ * zurück; die Verbindung wird dann als waiting_durable markiert.
+ * @param conn Die Verbindung.
+ * @return 1 wenn mindestens eine Response vollständig geschrieben wurde, 0 wenn der Socket
+ * voll ist oder auf das Log gewartet wird, -1 bei einem Fehler.
+ */
+static short flush_output(connection *conn) {
+    short progress = 0;
+    conn->waiting_durable = false;
+    while (conn->out_head != NULL) {
+        if (!outgoing_ready(conn, conn->out_head)) {
+            conn->waiting_durable = true;
+            return progress;
+        }
+        if (outgoing_memory_remaining(conn->out_head) > 0) {
+            short result = write_queued(conn);
+            if (result <= 0) {
+                return result < 0 ? -1 : progress;
+            }
+        }
+        outgoing *out = conn->out_head;
+        //Schickt noch eine Datei, falls vorhanden, sonst ist die Response schon vollständig.
+        short result = outgoing_send(conn->fd, out);
+        if (result <= 0) {
+            return result < 0 ? -1 : progress;
+        }
+        conn->out_pending -= out->header->len;
+        if (out->response->body != NULL) {
+            conn->out_pending -= out->response->body->len;
+        }
+        conn->out_head = out->next;
+        if (conn->out_head == NULL) {
+            conn->out_tail = NULL;
+        }
+        outgoing_free(out);
+        progress = 1;
+    }
+    return progress;
+}
+
+/**
+ * Liest, beantwortet vollständige Requests und schreibt, bis weder Lesen noch Schreiben
+ * weiterkommen. Sobald alle Responses geschrieben sind, wird die Arena der Verbindung
+ * zurückgesetzt, alles für die bisherigen Requests Angelegte ist damit auf einmal frei.
+ * @param conn Die Verbindung, ihre Arena ist die des Threads.
+ * @return Der neue Zustand.
+ */
+static connection_state connection_advance(connection *conn) {
+    while (1) {
+        short received = conn->close_after_write ? 0 : fill_buffer(conn);
+        if (received < 0) {
+            return CONNECTION_CLOSING;
+        }
+        short dispatched = dispatch_requests(conn);
+        short written = flush_output(conn);
+        if (written < 0) {
+            return CONNECTION_CLOSING;
+        }
+        if (conn->out_head == NULL && (conn->close_after_write || (conn->eof && conn->in_len == 0))) {
+            //Alles ist geschrieben und es kommt kein weiterer Request mehr.
+            return CONNECTION_CLOSING;
+        }
+        if (conn->out_head == NULL) {
+            arena_reset(conn->arena);
+        }
+        if (received == 0 && dispatched == 0 && written == 0) {
+            break;
+        }
+    }
+    return conn->out_head != NULL ? CONNECTION_WRITING : CONNECTION_READING;
+}
+
+/**
+ * Treibt die Zustandsmaschine der Verbindung so weit wie möglich voran: lesen,
+ * vollständige Requests beantworten, schreiben. Da epoll flankengesteuert (EPOLLET)
+ * verwendet wird, wird das wiederholt, bis weder Lesen noch Schreiben weiterkommen.
+ * @param conn Die Verbindung.
+ * @return Der neue Zustand. Bei CONNECTION_CLOSING muss die Verbindung freigegeben werden.
+ */
+connection_state connection_handle(connection *conn) {
+    arena *previous = arena_use(conn->arena);
+    conn->state = connection_advance(conn);
+    arena_use(previous);
+    return conn->state;
+}
+
+/**
+ * Fügt eine Verbindung vorne (zuletzt aktiv) in die Liste ein.
+ * @param list Die Liste der offenen Verbindungen.
+ * @param conn Die neue Verbindung.
+ */
+void connection_list_push(connection_list *list, connection *conn) {
+    conn->prev = NULL;
+    conn->next = list->head;
+    if (list->head != NULL) {
+        list->head->prev = conn;
+    } else {
+        list->tail = conn;
+    }
+    list->head = conn;
+}
+
+/**
+ * Entfernt eine Verbindung aus der Liste, ohne sie freizugeben.
+ * @param list Die Liste der offenen Verbindungen.
+ * @param conn Die zu entfernende Verbindung.
+ */
+void connection_list_remove(connection_list *list, connection *conn) {
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        list->head = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    } else {
+        list->tail = conn->prev;
+    }
+    conn->prev = NULL;
+    conn->next = NULL;
+}
+
+/**
+ * Markiert eine Verbindung als gerade aktiv und schiebt sie an den Anfang der Liste.
+ * So liegen die am längsten untätigen Verbindungen immer am Ende.
+ * @param list Die Liste der offenen Verbindungen.
+ * @param conn Die aktive Verbindung.
+ */
+void connection_list_touch(connection_list *list, connection *conn) {
+    conn->last_active = connection_now();
+    if (list->head != conn) {
+        connection_list_remove(list, conn);
+        connection_list_push(list, conn);
+    }
+}
+
+/**
+ * Gibt die aktuelle Zeit in Sekunden zurück. Die Uhr ist monoton, damit Zeitsprünge
+ * der Systemuhr keine Verbindungen vorzeitig schließen.
+ * @return Sekunden seit einem beliebigen, festen Zeitpunkt.
+ */
+time_t connection_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec;
+}
@@ -0,0 +1,96 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "http_server.h"
+
+/**
+ * Zustände einer Client-Verbindung in der Event-Loop.
+ */
+typedef enum connection_state {
+    CONNECTION_READING,
+    CONNECTION_WRITING,
+    CONNECTION_CLOSING
+} connection_state;
+
+/**
+ * Eine Response, die auf das Senden wartet: der serialisierte Header, danach der Body
+ * aus dem Speicher oder direkt aus der Datei (sendfile).
+ */
+typedef struct outgoing {
+    http_response *response;
+    //Entweder der vorbereitete Header der Response oder serialized.
+    const string *header;
+    string *serialized;
+    //Bereits gesendete Bytes von Header und Body im Speicher.
+    size_t sent;
+    struct outgoing *next;
+} outgoing;
+
+/**
+ * Eine nicht-blockierende, persistente Client-Verbindung mit eigenem Lesepuffer und
+ * einer Warteschlange ausstehender Responses. Im Lesepuffer können mehrere Requests
+ * (Pipelining) liegen, die der Reihe nach beantwortet werden.
+ */
+typedef struct connection {
+    int fd;
+    connection_state state;
+    process_context *ctx;
+    //Alle Requests und Responses der Verbindung, zurückgesetzt sobald nichts mehr zu senden ist.
+    struct arena *arena;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    //Zustand des Parsers für einen erst teilweise empfangenen Request.
+    http_parser parser;
+    outgoing *out_head;
+    outgoing *out_tail;
+    //Bytes aus dem Speicher, die in der Warteschlange auf das Senden warten.
+    size_t out_pending;
+    //Anzahl der bereits beantworteten Requests.
+    unsigned int requests;
+    //Der Client hat seine Seite geschlossen (read() == 0).
+    bool eof;
+    //Nach der ausstehenden Response wird die Verbindung geschlossen.
+    bool close_after_write;
+    //Die erste ausstehende Response wartet darauf, dass ihre Änderung im Log dauerhaft ist.
+    bool waiting_durable;
+    //Zeitpunkt der letzten Aktivität in Sekunden (CLOCK_MONOTONIC).
+    time_t last_active;
+    struct connection *prev;
+    struct connection *next;
+} connection;
+
+/**
+ * Die offenen Verbindungen einer Event-Loop, sortiert nach der letzten Aktivität:
+ * vorne die zuletzt aktive, hinten die am längsten untätige Verbindung.
+ */
+typedef struct connection_list {
+    connection *head;
+    connection *tail;
+} connection_list;
+
+outgoing *outgoing_new(http_response *response);
+
+void outgoing_free(outgoing *out);
+
+short outgoing_send(int fd, outgoing *out);
+
+connection *connection_new(int fd, process_context *ctx);
+
+void connection_free(connection *conn);
+
+connection_state connection_handle(connection *conn);
+
+void connection_list_push(connection_list *list, connection *conn);
+
+void connection_list_remove(connection_list *list, connection *conn);
+
+void connection_list_touch(connection_list *list, connection *conn);
+
+time_t connection_now(void);
+
+#endif //CONNECTION_H
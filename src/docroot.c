@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/openat2.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "docroot.h"
+
+//Flags for files that are served, O_NONBLOCK keeps a FIFO from blocking the worker.
+#define DOC_ROOT_OPEN_FLAGS (O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK)
+
+/**
+ * Returns the current time in seconds, cheap enough for every lookup
+ * @return seconds of a monotonic clock
+ */
+static time_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec;
+}
+
+/**
+ * Opens a file relative to the root with openat2(). The kernel resolves the whole path in one
+ * walk and fails with EXDEV instead of leaving the root, also through ".." or symlinks.
+ * @param root the document root
+ * @param relative null terminated path relative to the root
+ * @return file descriptor, -1 on failure (errno is set)
+ */
+static int open_beneath(const doc_root *root, const char *relative) {
+    struct open_how how = {.flags = DOC_ROOT_OPEN_FLAGS, .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS};
+    return (int) syscall(SYS_openat2, root->fd, relative, &how, sizeof(how));
+}
+
+/**
+ * Opens a file relative to the root on kernels without openat2(): the path is resolved with
+ * realpath() and has to stay below the root.
+ * @param root the document root
+ * @param relative null terminated path relative to the root
+ * @return file descriptor, -1 on failure (errno is set, EXDEV if the path leaves the root)
+ */
+static int open_checked(const doc_root *root, const char *relative) {
+    char path[PATH_MAX];
+    char resolved[PATH_MAX];
+    const int length = snprintf(path, sizeof(path), "%s/%s", root->real_path, relative);
+    if (length < 0 || (size_t) length >= sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (realpath(path, resolved) == NULL) {
+        return -1;
+    }
+    const size_t root_len = strlen(root->real_path);
+    if (strncmp(resolved, root->real_path, root_len) != 0 || (resolved[root_len] != '/' && resolved[root_len] != '\0')) {
+        errno = EXDEV;
+        return -1;
+    }
+    return open(resolved, DOC_ROOT_OPEN_FLAGS);
+}
+
+/**
+ * Opens the document root
+ * @param path path of the document root, e.g. DOC_ROOT
+ * @return the handle, must be closed with doc_root_close; NULL if the directory can't be opened
+ */
+doc_root *doc_root_open(const char *path) {
+    doc_root *root = calloc(1, sizeof(doc_root));
+    if (root == NULL) {
+        exit(2);
+    }
+    root->fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (root->fd < 0) {
+        free(root);
+        return NULL;
+    }
+    int probe = open_beneath(root, ".");
+    if (probe >= 0) {
+        close(probe);
+    } else if (errno == ENOSYS) {
+        root->fallback = true;
+        root->real_path = realpath(path, NULL);
+        if (root->real_path == NULL) {
+            doc_root_close(root);
+            return NULL;
+        }
+    }
+    return root;
+}
+
+/**
+ * Closes the document root
+ * @param root the handle
+ */
+void doc_root_close(doc_root *root) {
+    close(root->fd);
+    free(root->real_path);
+    free(root);
+}
+
+/**
+ * Finds the slot of the negative cache for a path
+ * @param root the document root
+ * @param path path relative to the root
+ * @param len length of the path, at most DOC_ROOT_NEGATIVE_MAX_PATH
+ * @return the slot, it may hold another path
+ */
+static doc_root_negative *negative_slot(doc_root *root, const char *path, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char) path[i]) * 16777619u;
+    }
+    return &root->negative[hash & (DOC_ROOT_NEGATIVE_ENTRIES - 1)];
+}
+
+/**
+ * Opens a regular file in the document root for reading. Checking the path and opening the file
+ * are a single syscall, so there is no window in which the path could be swapped. Paths that did
+ * not exist are remembered for DOC_ROOT_NEGATIVE_TTL seconds and answered without a syscall.
+ * @param root the document root
+ * @param path path from the document root, e.g. /images/tux.png; not null terminated
+ * @param len length of the path
+ * @param fd set to the opened file on DOC_ROOT_FILE
+ * @param st set to the fstat() data of the file on DOC_ROOT_FILE, e.g. for its size and validators
+ * @return DOC_ROOT_FILE, DOC_ROOT_NOT_FOUND if the file is missing or not a regular file (e.g. a
+ * directory), DOC_ROOT_FORBIDDEN if the path leaves the root or the file can't be read
+ */
+doc_root_status doc_root_open_file(doc_root *root, const char *path, size_t len, int *fd, struct stat *st) {
+    root->stats.lookups++;
+    while (len > 0 && path[0] == '/') {
+        path++;
+        len--;
+    }
+    if (len == 0 || len >= PATH_MAX || memchr(path, '\0', len) != NULL) {
+        return DOC_ROOT_NOT_FOUND;
+    }
+    doc_root_negative *slot = len <= DOC_ROOT_NEGATIVE_MAX_PATH ? negative_slot(root, path, len) : NULL;
+    if (slot != NULL && slot->len == len && memcmp(slot->path, path, len) == 0 && slot->expires > now()) {
+        root->stats.negative_hits++;
+        return DOC_ROOT_NOT_FOUND;
+    }
+
+    char relative[PATH_MAX];
+    memcpy(relative, path, len);
+    relative[len] = '\0';
+    const int file = root->fallback ? open_checked(root, relative) : open_beneath(root, relative);
+    if (file < 0) {
+        if (errno != ENOENT && errno != ENOTDIR && errno != ENAMETOOLONG) {
+            //EXDEV: the path leaves the root, ELOOP: magic link or symlink loop, EACCES
+            return DOC_ROOT_FORBIDDEN;
+        }
+        if (slot != NULL) {
+            slot->len = len;
+            memcpy(slot->path, path, len);
+            slot->expires = now() + DOC_ROOT_NEGATIVE_TTL;
+        }
+        return DOC_ROOT_NOT_FOUND;
+    }
+    if (fstat(file, st) < 0 || !S_ISREG(st->st_mode)) {
+        close(file);
+        return DOC_ROOT_NOT_FOUND;
+    }
+    *fd = file;
+    return DOC_ROOT_FILE;
+}
@@ -0,0 +1,58 @@
+#ifndef DOCROOT_H
+#define DOCROOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+
+//Number of remembered missing paths, a power of two.
+#define DOC_ROOT_NEGATIVE_ENTRIES 64
+//Longer paths are looked up every time.
+#define DOC_ROOT_NEGATIVE_MAX_PATH 255
+//Seconds a missing path is answered from memory, so new files show up quickly.
+#define DOC_ROOT_NEGATIVE_TTL 1
+
+typedef enum doc_root_status {
+    DOC_ROOT_FILE,
+    //missing or not a regular file (404)
+    DOC_ROOT_NOT_FOUND,
+    //outside of the document root or not readable (403)
+    DOC_ROOT_FORBIDDEN
+} doc_root_status;
+
+//A path that recently did not exist.
+typedef struct doc_root_negative {
+    size_t len;
+    time_t expires;
+    char path[DOC_ROOT_NEGATIVE_MAX_PATH];
+} doc_root_negative;
+
+typedef struct doc_root_stats {
+    unsigned long lookups;
+    //404s answered from the negative cache without a syscall
+    unsigned long negative_hits;
+} doc_root_stats;
+
+/**
+ * The document root, opened once as a directory. Files are resolved relative to it with a
+ * single openat2() that refuses to leave it, so checking and opening a path is one step.
+ * Every worker owns its own handle, it is not synchronized.
+ */
+typedef struct doc_root {
+    int fd;
+    //openat2() is missing (Linux < 5.6), paths are checked with realpath() instead
+    bool fallback;
+    //absolute path of the root, only for the fallback
+    char *real_path;
+    doc_root_negative negative[DOC_ROOT_NEGATIVE_ENTRIES];
+    doc_root_stats stats;
+} doc_root;
+
+doc_root *doc_root_open(const char *path);
+
+void doc_root_close(doc_root *root);
+
+doc_root_status doc_root_open_file(doc_root *root, const char *path, size_t len, int *fd, struct stat *st);
+
+#endif //DOCROOT_H
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "filecache.h"
+
+#define FILE_CACHE_INITIAL_BUCKETS 64
+
+/**
+ * FNV-1a hash of a path
+ * @param key path
+ * @param len length of path
+ * @return hash value
+ */
+static size_t hash_path(const char *key, size_t len) {
+    size_t hash = 14695981039346656037UL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) key[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/**
+ * Creates an empty file cache
+ * @param budget maximum number of bytes (file contents and headers) held by the cache
+ * @return new cache, must be freed with file_cache_free
+ */
+file_cache *file_cache_new(size_t budget) {
+    file_cache *cache = calloc(1, sizeof(file_cache));
+    if (cache == NULL) {
+        exit(2);
+    }
+    cache->bucket_count = FILE_CACHE_INITIAL_BUCKETS;
+    cache->buckets = calloc(cache->bucket_count, sizeof(file_cache_entry *));
+    if (cache->buckets == NULL) {
+        exit(2);
+    }
+    cache->budget = budget;
+    return cache;
+}
+
+static void entry_free(file_cache_entry *entry) {
+    free(entry->key);
+    free(entry->path);
+    free(entry->body.str);
+    str_free(entry->etag);
+    str_free(entry->last_modified);
+    str_free(entry->header_keep_alive);
+    str_free(entry->header_close);
+    str_free(entry->not_modified_keep_alive);
+    str_free(entry->not_modified_close);
+    free(entry);
+}
+
+static size_t entry_bytes(file_cache_entry *entry) {
+    return entry->body.len + entry->header_keep_alive->len + entry->header_close->len
+           + entry->not_modified_keep_alive->len + entry->not_modified_close->len;
+}
+
+static void lru_unlink(file_cache *cache, file_cache_entry *entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void lru_push_front(file_cache *cache, file_cache_entry *entry) {
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head != NULL) {
+        cache->lru_head->lru_prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+/**
+ * Removes an entry from the cache. It is freed right away, or by the last response
+ * still sending it.
+ * @param cache the cache
+ * @param entry entry to remove
+ */
+static void entry_remove(file_cache *cache, file_cache_entry *entry) {
+    file_cache_entry **link = &cache->buckets[hash_path(entry->key, entry->key_len) & (cache->bucket_count - 1)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    lru_unlink(cache, entry);
+    cache->stats.entries--;
+    cache->stats.bytes -= entry_bytes(entry);
+    if (entry->refs == 0) {
+        entry_free(entry);
+    } else {
+        entry->evicted = true;
+    }
+}
+
+/**
+ * Hands an entry back after its response was sent (http_response.release)
+ * @param owner the file_cache_entry
+ */
+static void entry_release(void *owner) {
+    file_cache_entry *entry = owner;
+    entry->refs--;
+    if (entry->evicted && entry->refs == 0) {
+        entry_free(entry);
+    }
+}
+
+/**
+ * Lets a response send a part of the entry without copying it
+ * @param entry cached file
+ * @param response response to be set
+ */
+static void entry_borrow(file_cache_entry *entry, http_response *response) {
+    entry->refs++;
+    response->body = &entry->body;
+    response->release = entry_release;
+    response->owner = entry;
+}
+
+/**
+ * Answers a Range request from the entry: a single range is sent from the cached body,
+ * several ranges are copied into a multipart/byteranges body.
+ * @param entry cached file
+ * @param status result of request_ranges
+ * @param ranges the satisfiable ranges
+ * @param count number of ranges
+ * @param response response to be set, its Connection header is already set
+ * @return 1 on success, 0 if the whole file has to be sent instead
+ */
+static short entry_attach_ranges(file_cache_entry *entry, http_range_status status, const http_byte_range *ranges,
+                                 size_t count, http_response *response) {
+    if (status == HTTP_RANGE_UNSATISFIABLE) {
+        set_response_unsatisfiable(response, entry->body.len);
+        return 1;
+    }
+    response->entity_header->content_type = entry->content_type;
+    if (count > 1 && !set_response_multipart(response, ranges, count, entry->body.len, entry->body.str, -1)) {
+        return 0;
+    }
+    if (count == 1) {
+        entry_borrow(entry, response);
+        set_response_partial(response, ranges[0], entry->body.len);
+    }
+    response->entity_header->etag = str_cpy(entry->etag->str, entry->etag->len);
+    response->entity_header->last_modified = str_cpy(entry->last_modified->str, entry->last_modified->len);
+    response->accept_ranges = true;
+    return 1;
+}
+
+/**
+ * Lets a response send the cached header block and body without copying them. If the
+ * request's validators match, only the 304 header block is sent. Range requests get a
+ * 206 or 416 response built for them.
+ * @param cache the cache
+ * @param entry cached file
+ * @param request the request for its conditional headers, NULL to always send the file
+ * @param keep_alive selects the header with the matching Connection header
+ * @param response response to be set
+ */
+static void entry_attach(file_cache *cache, file_cache_entry *entry, const http_request_view *request,
+                         bool keep_alive, http_response *response) {
+    if (request != NULL && request_not_modified(request, entry->etag, entry->mtime.tv_sec)) {
+        cache->stats.not_modified++;
+        entry_borrow(entry, response);
+        response->body = NULL;
+        response->prepared_header = keep_alive ? entry->not_modified_keep_alive : entry->not_modified_close;
+        return;
+    }
+    if (request != NULL && request->range.len > 0) {
+        http_byte_range ranges[HTTP_MAX_RANGES];
+        size_t count;
+        const http_range_status status = request_ranges(request, entry->etag, entry->mtime.tv_sec, entry->body.len,
+                                                        ranges, &count);
+        if (status != HTTP_RANGE_NONE && entry_attach_ranges(entry, status, ranges, count, response)) {
+            cache->stats.partial++;
+            return;
+        }
+    }
+    entry_borrow(entry, response);
+    response->prepared_header = keep_alive ? entry->header_keep_alive : entry->header_close;
+    response->entity_header->content_length = entry->body.len;
+}
+
+static void rehash(file_cache *cache) {
+    size_t bucket_count = cache->bucket_count * 2;
+    file_cache_entry **buckets = calloc(bucket_count, sizeof(file_cache_entry *));
+    if (buckets == NULL) {
+        //keep the smaller table, lookups just get a bit slower
+        return;
+    }
+    for (size_t i = 0; i < cache->bucket_count; ++i) {
+        file_cache_entry *entry = cache->buckets[i];
+        while (entry != NULL) {
+            file_cache_entry *next = entry->hash_next;
+            size_t bucket = hash_path(entry->key, entry->key_len) & (bucket_count - 1);
+            entry->hash_next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = bucket_count;
+}
+
+/**
+ * Answers a request for *path* from the cache. The entry is revalidated with a single
+ * stat(): if inode, size or modification time changed, it is dropped.
+ * @param cache the cache
+ * @param path requested path from document root
+ * @param request the request for its conditional headers, NULL to always send the file
+ * @param keep_alive whether the response keeps the connection open
+ * @param response response to be set on a hit
+ * @return 1 on a hit, 0 if the file has to be loaded (see file_cache_store)
+ */
+short file_cache_respond(file_cache *cache, string *path, const http_request_view *request, bool keep_alive,
+                         http_response *response) {
+    file_cache_entry *entry = cache->buckets[hash_path(path->str, path->len) & (cache->bucket_count - 1)];
+    while (entry != NULL && (entry->key_len != path->len || memcmp(entry->key, path->str, path->len) != 0)) {
+        entry = entry->hash_next;
+    }
+    if (entry == NULL) {
+        cache->stats.misses++;
+        return 0;
+    }
+    struct stat st;
+    if (stat(entry->path, &st) < 0 || st.st_ino != entry->ino || st.st_dev != entry->dev || st.st_size != entry->size
+        || st.st_mtim.tv_sec != entry->mtime.tv_sec || st.st_mtim.tv_nsec != entry->mtime.tv_nsec) {
+        cache->stats.invalidations++;
+        cache->stats.misses++;
+        entry_remove(cache, entry);
+        return 0;
+    }
+    cache->stats.hits++;
+    lru_unlink(cache, entry);
+    lru_push_front(cache, entry);
+    entry_attach(cache, entry, request, keep_alive, response);
+    return 1;
+}
+
+/**
+ * Reads the file into a new entry, see file_cache_store
+ */
+static short entry_store(file_cache *cache, string *path, int fd, const http_request_view *request,
+                         bool keep_alive, http_response *response) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > FILE_CACHE_MAX_FILE
+        || (size_t) st.st_size > cache->budget / 2) {
+        return 0;
+    }
+    const size_t size = (size_t) st.st_size;
+    char *data = malloc(size > 0 ? size : 1);
+    if (data == NULL) {
+        return 0;
+    }
+    size_t read_total = 0;
+    while (read_total < size) {
+        ssize_t length = pread(fd, data + read_total, size - read_total, (off_t) read_total);
+        if (length <= 0) {
+            free(data);
+            return 0;
+        }
+        read_total += (size_t) length;
+    }
+
+    file_cache_entry *entry = calloc(1, sizeof(file_cache_entry));
+    if (entry == NULL) {
+        free(data);
+        return 0;
+    }
+    entry->key = malloc(path->len);
+    entry->key_len = path->len;
+    memcpy(entry->key, path->str, path->len);
+    string *full_path = str_cpy(DOC_ROOT, strlen(DOC_ROOT));
+    str_cat(full_path, path->str, path->len);
+    entry->path = get_nullterminated_char_str(full_path);
+    str_free(full_path);
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->body.str = data;
+    entry->body.len = size;
+
+    //serialize the header blocks once for each Connection variant
+    http_response *template = response_new();
+    set_response_status(template, char_to_string("200"), char_to_string("OK"));
+    set_response_body(template, &entry->body, content_type_for_path(path));
+    set_response_validators(template, &st);
+    template->accept_ranges = true;
+    template->connection = char_to_string("keep-alive");
+    entry->header_keep_alive = response_header_string(template);
+    str_free(template->connection);
+    template->connection = char_to_string("close");
+    entry->header_close = response_header_string(template);
+    entry->content_type = template->entity_header->content_type;
+    entry->etag = template->entity_header->etag;
+    entry->last_modified = template->entity_header->last_modified;
+    template->entity_header->etag = NULL;
+    template->entity_header->last_modified = NULL;
+    template->body = NULL;
+    free_response(template);
+
+    template = response_new();
+    set_response_validators(template, &st);
+    set_response_not_modified(template);
+    template->connection = char_to_string("keep-alive");
+    entry->not_modified_keep_alive = response_header_string(template);
+    str_free(template->connection);
+    template->connection = char_to_string("close");
+    entry->not_modified_close = response_header_string(template);
+    free_response(template);
+
+    while (cache->lru_tail != NULL && cache->stats.bytes + entry_bytes(entry) > cache->budget) {
+        cache->stats.evictions++;
+        entry_remove(cache, cache->lru_tail);
+    }
+    if (cache->stats.entries >= cache->bucket_count) {
+        rehash(cache);
+    }
+    size_t bucket = hash_path(entry->key, entry->key_len) & (cache->bucket_count - 1);
+    entry->hash_next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    lru_push_front(cache, entry);
+    cache->stats.entries++;
+    cache->stats.bytes += entry_bytes(entry);
+
+    close(fd);
+    entry_attach(cache, entry, request, keep_alive, response);
+    return 1;
+}
+
+/**
+ * Loads an opened file into the cache and answers the request from the new entry.
+ * Least recently used entries are evicted until the file fits into the budget.
+ * @param cache the cache
+ * @param path requested path from document root, already validated
+ * @param fd the opened file, closed on success
+ * @param request the request for its conditional headers, NULL to always send the file
+ * @param keep_alive whether the response keeps the connection open
+ * @param response response to be set
+ * @return 1 if the file was cached, 0 if it is too large or can't be read (fd stays open)
+ */
+short file_cache_store(file_cache *cache, string *path, int fd, const http_request_view *request, bool keep_alive,
+                       http_response *response) {
+    //the entry outlives the request, so nothing of it may come from the request's arena
+    arena *previous = arena_use(NULL);
+    short stored = entry_store(cache, path, fd, request, keep_alive, response);
+    arena_use(previous);
+    return stored;
+}
+
+/**
+ * Frees the cache. Entries still referenced by unsent responses are freed when those
+ * responses are freed.
+ * @param cache the cache
+ */
+void file_cache_free(file_cache *cache) {
+    while (cache->lru_head != NULL) {
+        entry_remove(cache, cache->lru_head);
+    }
+    free(cache->buckets);
+    free(cache);
+}
@@ -0,0 +1,83 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "httplib.h"
+
+//Larger files are not cached but sent with sendfile.
+#define FILE_CACHE_MAX_FILE (256*1024)
+#define FILE_CACHE_DEFAULT_BUDGET (16*1024*1024)
+
+/**
+ * A cached file: its content, the precomputed Content-Type and the serialized header
+ * blocks of the 200 and 304 responses for keep-alive and close. stat() data is kept for
+ * revalidation. Responses to Range requests are built per request.
+ */
+typedef struct file_cache_entry {
+    //path from document root as requested, e.g. /images/tux.png
+    char *key;
+    size_t key_len;
+    //path for stat(), including DOC_ROOT and null terminated
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    string body;
+    const string *content_type;
+    //validators, see set_response_validators; the entity tag includes the quotes
+    string *etag;
+    string *last_modified;
+    string *header_keep_alive;
+    string *header_close;
+    string *not_modified_keep_alive;
+    string *not_modified_close;
+    //responses still sending this entry, it is freed after the last one even if evicted
+    unsigned int refs;
+    bool evicted;
+    struct file_cache_entry *hash_next;
+    struct file_cache_entry *lru_prev;
+    struct file_cache_entry *lru_next;
+} file_cache_entry;
+
+typedef struct file_cache_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    //entries dropped because the file changed on disk
+    unsigned long invalidations;
+    //hits answered with 304 Not Modified
+    unsigned long not_modified;
+    //hits answered with 206 Partial Content or 416 Range Not Satisfiable
+    unsigned long partial;
+    size_t entries;
+    size_t bytes;
+} file_cache_stats;
+
+/**
+ * A bounded LRU cache of static files. Every worker owns its own cache, so it is not
+ * synchronized.
+ */
+typedef struct file_cache {
+    file_cache_entry **buckets;
+    size_t bucket_count;
+    //most recently used entry first
+    file_cache_entry *lru_head;
+    file_cache_entry *lru_tail;
+    size_t budget;
+    file_cache_stats stats;
+} file_cache;
+
+file_cache *file_cache_new(size_t budget);
+
+void file_cache_free(file_cache *cache);
+
+short file_cache_respond(file_cache *cache, string *path, const http_request_view *request, bool keep_alive,
+                         http_response *response);
+
+short file_cache_store(file_cache *cache, string *path, int fd, const http_request_view *request, bool keep_alive,
+                       http_response *response);
+
+#endif //FILECACHE_H
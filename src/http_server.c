@@ -1,22 +1,78 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <netinet/ip.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#include "httplib.h"
+#include "arena.h"
+#include "connection.h"
+#include "http_server.h"
 
-#define PORT 31337
-#define BUFFER_SIZE (1024*1024)
-#define FRONTEND_LOCATION "http://localhost:4200"
+#define MAX_EVENTS 256
+//Anfangsgröße des Lesepuffers im stdin-Modus, er wächst bei Bedarf.
+#define STDIN_INITIAL_BUFFER 4096
+#define MAX_WORKERS 256
+//Standardanzahl der Durchläufe durch das Korpus im replay-Modus.
+#define REPLAY_DEFAULT_ITERATIONS 100
+//Länge, auf die der Name einer Route (Methode und URI) in der Ausgabe gekürzt wird.
+#define REPLAY_ROUTE_NAME 40
+//Standardpfad des Write-Ahead-Logs der Buchungen, relativ zum Arbeitsverzeichnis.
+#define WAL_DEFAULT_PATH "bookings.wal"
+//Standardpfad des Snapshots der Buchungen und Sekunden zwischen zwei Snapshots.
+#define SNAPSHOT_DEFAULT_PATH "bookings.snap"
+#define SNAPSHOT_DEFAULT_INTERVAL 300
 
-string *process(string *request);
+/**
+ * Die Einstellungen des Servers aus der Kommandozeile.
+ */
+typedef struct server_config {
+    unsigned long workers;
+    //Bytes, die der Datei-Cache eines Workers höchstens belegt.
+    unsigned long cache_bytes;
+    unsigned long max_header_bytes;
+    unsigned long max_body_bytes;
+    //Nur im replay-Modus: Durchläufe durch das Korpus und ob die Responses geprüft werden.
+    unsigned long iterations;
+    bool checksum;
+    //Die Buchungen, einmal angelegt und von allen Workern geteilt (siehe booking_store).
+    booking_store *bookings;
+    //Das Write-Ahead-Log der Buchungen und wann eine Änderung als dauerhaft gilt.
+    const char *wal_path;
+    wal_durability durability;
+    //Der Snapshot, aus dem die Buchungen beim Start gelesen werden, und wie oft er neu geschrieben wird.
+    const char *snapshot_path;
+    unsigned long snapshot_interval;
+} server_config;
 
-static bool run = true;
+/**
+ * Ein Worker-Thread mit eigenem Listen-Socket, eigener epoll-Instanz, eigenen
+ * Verbindungen und eigenem Datei-Cache. Worker teilen sich keinen veränderlichen Zustand.
+ */
+typedef struct worker {
+    pthread_t thread;
+    unsigned int id;
+    //Die CPU, an die der Worker gebunden wird, oder -1 für keine Bindung.
+    int cpu;
+    const server_config *config;
+} worker;
+
+//Wird nur vom Signal-Handler geschrieben, alle Worker lesen es.
+static volatile sig_atomic_t run = true;
+//Seine Adresse markiert in epoll das Event-fd des Write-Ahead-Logs (siehe wal_subscribe).
+static char wal_event;
 
 /**
  * Gibt eine Fehlermeldung *msg* aus und beendet das Programm.
@@ -45,6 +101,8 @@ static void handle_signal(int signum) {
 
 /**
  * Registriert das SIGINT-Signal (Strg+C) um den Server beenden zu können.
+ * SIGPIPE wird ignoriert, damit ein Client, der die Verbindung vorzeitig schließt,
+ * nicht den ganzen Server beendet.
  */
 static void register_signal(void) {
     struct sigaction action;
@@ -56,11 +114,16 @@ static void register_signal(void) {
     if (sigaction(SIGINT, &action, NULL) < 0) {
         error("ERROR registering signal handler");
     }
+    action.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &action, NULL) < 0) {
+        error("ERROR registering signal handler");
+    }
 }
 
 /**
  * Erstellt und konfiguriert den Netzwerk-Socket, über den die Verbindungen
- * angenommen werden.
+ * angenommen werden. Dank SO_REUSEPORT kann jeder Worker seinen eigenen Socket
+ * auf denselben Port binden, der Kernel verteilt neue Verbindungen auf sie.
  */
 static int setup_socket(void) {
     int opt = 1;
@@ -73,8 +136,8 @@ static int setup_socket(void) {
     serv_addr.sin_addr.s_addr = INADDR_ANY;
     serv_addr.sin_port = htons(PORT);
 
-    //Erstelle den Socket.
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    //Erstelle den Socket. Er ist nicht-blockierend, damit accept() die Event-Loop nie anhält.
+    sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0) {
         error("ERROR opening socket");
     }
@@ -82,239 +145,903 @@ static int setup_socket(void) {
     //Verwende den Socket, selbst wenn er aus einer vorigen Ausführung im TIME_WAIT Status ist.
     if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char *) &opt, sizeof(int)) < 0)
         error("ERROR on setsockopt");
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (const char *) &opt, sizeof(int)) < 0)
+        error("ERROR on setsockopt");
 
     //Melde, dass der Socket eingehende Verbindungen akzeptieren soll.
     if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
         error("ERROR on binding");
     }
 
-    //Horche auf dem Socket nach eingehenden Verbindungen. Es werden maximal fünf gleichzeitige Verbindungen erlaubt.
-    if (listen(sockfd, 5) < 0) {
+    //Horche auf dem Socket nach eingehenden Verbindungen. Die Warteschlange ist so groß wie vom Kernel erlaubt.
+    if (listen(sockfd, SOMAXCONN) < 0) {
         error("listen");
     }
     return sockfd;
 }
 
-static void main_loop_stdin(void) {
-    void *const buffer = malloc(BUFFER_SIZE);
+/**
+ * Gibt die Zähler eines Datei-Caches auf stderr aus.
+ * @param name Bezeichnung des Caches, z.B. der Worker.
+ * @param cache Der Cache.
+ */
+static void print_cache_stats(const char *name, file_cache *cache) {
+    fprintf(stderr, "%s file cache: %lu hits (%lu not modified, %lu partial), %lu misses, %lu evictions, "
+                    "%lu invalidations, %zu entries, %zu bytes\n",
+            name, cache->stats.hits, cache->stats.not_modified, cache->stats.partial, cache->stats.misses,
+            cache->stats.evictions, cache->stats.invalidations, cache->stats.entries, cache->stats.bytes);
+}
+
+/**
+ * Öffnet das doc-root für einen Worker oder den stdin-Modus.
+ * @return Das doc-root, das Programm wird beendet, wenn es nicht geöffnet werden kann.
+ */
+static doc_root *open_doc_root(void) {
+    doc_root *root = doc_root_open(DOC_ROOT);
+    if (root == NULL) {
+        error("ERROR opening document root");
+    }
+    return root;
+}
+
+/**
+ * Gibt die Zähler eines doc-root auf stderr aus.
+ * @param name Bezeichnung des Besitzers, z.B. der Worker.
+ * @param root Das doc-root.
+ */
+static void print_doc_root_stats(const char *name, doc_root *root) {
+    fprintf(stderr, "%s doc root: %lu lookups, %lu negative hits%s\n", name, root->stats.lookups,
+            root->stats.negative_hits, root->fallback ? " (realpath fallback)" : "");
+}
+
+/**
+ * Gibt die Zähler des Write-Ahead-Logs auf stderr aus.
+ * @param log Das Log, bei NULL wird nichts ausgegeben.
+ */
+static void print_wal_stats(wal *log) {
+    if (log == NULL) {
+        return;
+    }
+    const wal_stats stats = wal_get_stats(log);
+    fprintf(stderr, "write-ahead log: %lu records recovered (%lu bytes truncated), %lu records appended in "
+                    "%lu batches, %lu syncs\n",
+            stats.recovered, stats.truncated, stats.records, stats.batches, stats.syncs);
+}
+
+/**
+ * Lädt die Buchungen: der letzte Snapshot wird nur gemappt, aus dem Write-Ahead-Log werden nur
+ * die Änderungen hinter ihm nachgespielt. Ohne gültigen Snapshot wird das ganze Log gelesen.
+ * @param config Die Einstellungen mit den Pfaden von Snapshot und Log.
+ * @return Die Dauer in Millisekunden.
+ */
+static double open_bookings(const server_config *config) {
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const bool snapshot = booking_store_open_snapshot(config->bookings, config->snapshot_path);
+    if (!snapshot && errno != ENOENT) {
+        fprintf(stderr, "WARNING ignoring the snapshot %s, errno: %s\n", config->snapshot_path, strerror(errno));
+    }
+    if (!booking_store_open_log(config->bookings, config->wal_path, config->durability)) {
+        error("ERROR opening the write-ahead log");
+    }
+    //Das Log reicht nicht bis zum Snapshot, es wurde daher ganz eingespielt
+    if (snapshot && config->bookings->base == NULL) {
+        fprintf(stderr, "WARNING the write-ahead log %s ends before the snapshot %s, replayed the whole log\n",
+                config->wal_path, config->snapshot_path);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+/**
+ * Der Thread, der regelmäßig einen Snapshot der Buchungen schreibt.
+ */
+typedef struct snapshotter {
+    pthread_t thread;
+    const server_config *config;
+    //LSN des Logs beim letzten Snapshot, ohne neue Änderungen wird keiner geschrieben.
+    uint64_t written;
+} snapshotter;
+
+/**
+ * Schreibt einen Snapshot, falls sich die Buchungen seit dem letzten geändert haben. Ein Fehler
+ * beendet den Server nicht, das Log enthält ja alle Änderungen.
+ * @param self Der Snapshot-Thread.
+ */
+static void write_snapshot(snapshotter *self) {
+    const uint64_t lsn = wal_appended(self->config->bookings->log);
+    if (lsn == self->written) {
+        return;
+    }
+    if (!booking_store_snapshot(self->config->bookings, self->config->snapshot_path)) {
+        fprintf(stderr, "ERROR writing the snapshot %s, errno: %s\n", self->config->snapshot_path, strerror(errno));
+        return;
+    }
+    self->written = lsn;
+}
+
+/**
+ * Schreibt alle snapshot_interval Sekunden einen Snapshot, damit der nächste Start nur wenig vom
+ * Log nachspielen muss. Das Beenden bemerkt er wie die Worker an run.
+ * @param arg Der Snapshot-Thread (snapshotter *).
+ * @return Immer NULL.
+ */
+static void *snapshot_loop(void *arg) {
+    snapshotter *self = arg;
+    unsigned long waited = 0;
+    while (run) {
+        sleep(1);
+        if (++waited >= self->config->snapshot_interval && run) {
+            write_snapshot(self);
+            waited = 0;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Beantwortet genau einen Request von stdin auf stdout. Eine Änderung der Buchungen wird erst
+ * ausgegeben, wenn sie im Write-Ahead-Log dauerhaft ist.
+ * @param config Die Einstellungen.
+ */
+static void main_loop_stdin(const server_config *config) {
+    process_context ctx = {file_cache_new(config->cache_bytes), open_doc_root(), config->max_header_bytes,
+                           config->max_body_bytes, debug_page_open(), config->bookings};
+    arena *request_arena = arena_new(ARENA_DEFAULT_SIZE);
+    arena_use(request_arena);
+
+    //Lies, bis der Request samt Body vollständig ist. Der Puffer wächst nur bei Bedarf,
+    //die Grenzen des Parsers beschränken seine Größe.
+    http_parser parser = {0};
+    parser.max_header = ctx.max_header_bytes;
+    parser.max_body = ctx.max_body_bytes;
+    http_request_view request;
+    http_parse_status status = HTTP_PARSE_INCOMPLETE;
+    size_t capacity = STDIN_INITIAL_BUFFER;
+    size_t length = 0;
+    char *buffer = malloc(capacity);
     if (buffer == NULL) {
         error("ERROR at malloc.");
     }
-
-    //Lies die ankommenden Daten von dem Socket in das Array buffer.
-    memset(buffer, 0, BUFFER_SIZE);
-    ssize_t length = read(STDIN_FILENO, buffer, BUFFER_SIZE - 1);
-    if (length < 0) {
-        if (errno != EINTR) {
-            error("ERROR reading from socket");
+    while (status == HTTP_PARSE_INCOMPLETE) {
+        if (length == capacity) {
+            capacity *= 2;
+            char *grown = realloc(buffer, capacity);
+            if (grown == NULL) {
+                error("ERROR at realloc.");
+            }
+            buffer = grown;
         }
+        ssize_t received = read(STDIN_FILENO, buffer + length, capacity - length);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("ERROR reading from stdin");
+        }
+        if (received == 0) {
+            //stdin endet vor dem Ende des Requests.
+            status = HTTP_PARSE_INVALID;
+            break;
+        }
+        length += (size_t) received;
+        status = http_parse_request(&parser, buffer, length, &request);
+    }
+    bool keep_alive = false;
+    http_response *resp = status == HTTP_PARSE_COMPLETE ? process(&ctx, &request, &keep_alive)
+                                                        : reject(status, &keep_alive);
+    outgoing *response = outgoing_new(resp);
+    if (resp->durable_lsn != 0) {
+        wal_wait(config->bookings->log, resp->durable_lsn);
     }
-    string *request = str_cpy(buffer, (size_t) length);
-    string *response = process(request);
 
-    size_t response_len = get_length(response);
-    char *response_char = get_char_str(response);
     //Schreibe die ausgehenden Daten auf stdout.
-    if (write(STDOUT_FILENO, response_char, response_len) < 0) {
+    if (outgoing_send(STDOUT_FILENO, response) != 1) {
         error("ERROR writing to STDOUT");
     }
-    str_free(response);
+    outgoing_free(response);
+    arena_use(NULL);
+    arena_destroy(request_arena);
+    file_cache_free(ctx.files);
+    doc_root_close(ctx.root);
+    template_file_close(ctx.debug_page);
     free(buffer);
 }
 
 /**
- * Die Hauptschleife, in der eingehende Verbindungen angenommen werden.
+ * Nimmt alle wartenden Verbindungen an und registriert sie flankengesteuert bei epoll.
+ * @param sockfd Der Listen-Socket.
+ * @param epollfd Die epoll-Instanz der Event-Loop.
+ * @param connections Die Liste der offenen Verbindungen.
+ * @param ctx Der Zustand des Workers für process().
  */
-static void main_loop(void) {
-    const int sockfd = setup_socket();
-    int newsockfd;
-    ssize_t length;
+static void accept_connections(int sockfd, int epollfd, connection_list *connections, process_context *ctx) {
+    while (run) {
+        int newsockfd = accept4(sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newsockfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return;
+            }
+            if (errno == ECONNABORTED) {
+                continue;
+            }
+            //Zum Beispiel EMFILE: die Verbindung bleibt in der Warteschlange, bis wieder ein Deskriptor frei ist.
+            fprintf(stderr, "ERROR on accept, errno: %s\n", strerror(errno));
+            return;
+        }
+        connection *conn = connection_new(newsockfd, ctx);
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, newsockfd, &event) < 0) {
+            error("ERROR on epoll_ctl");
+        }
+        connection_list_push(connections, conn);
+    }
+}
 
-    struct sockaddr_in cli_addr;
-    socklen_t clilen = sizeof(cli_addr);
+/**
+ * Entfernt eine Verbindung aus der Liste und gibt sie frei.
+ * @param connections Die Liste der offenen Verbindungen.
+ * @param conn Die zu schließende Verbindung.
+ */
+static void close_connection(connection_list *connections, connection *conn) {
+    connection_list_remove(connections, conn);
+    connection_free(conn);
+}
 
-    void *const buffer = malloc(BUFFER_SIZE);
-    if (buffer == NULL) {
-        error("ERROR at malloc.");
+/**
+ * Schließt alle Verbindungen, die länger als KEEP_ALIVE_TIMEOUT Sekunden untätig waren.
+ * Die Liste ist nach der letzten Aktivität sortiert, daher genügt ein Blick auf ihr Ende.
+ * @param connections Die Liste der offenen Verbindungen.
+ */
+static void close_idle_connections(connection_list *connections) {
+    const time_t now = connection_now();
+    while (connections->tail != NULL && now - connections->tail->last_active >= KEEP_ALIVE_TIMEOUT) {
+        close_connection(connections, connections->tail);
+    }
+}
+
+/**
+ * Sendet die Responses, die auf das Write-Ahead-Log gewartet haben, nachdem dessen Flusher einen
+ * Batch dauerhaft geschrieben hat.
+ * @param walfd Das Event-fd des Logs.
+ * @param connections Die Liste der offenen Verbindungen.
+ */
+static void resume_durable(int walfd, connection_list *connections) {
+    uint64_t batches;
+    //Setzt den Zähler zurück; auch ohne das kommt das flankengesteuerte Event beim nächsten Batch wieder.
+    (void) !read(walfd, &batches, sizeof(batches));
+    connection *conn = connections->head;
+    while (conn != NULL) {
+        connection *next = conn->next;
+        if (conn->waiting_durable) {
+            if (connection_handle(conn) == CONNECTION_CLOSING) {
+                close_connection(connections, conn);
+            } else {
+                connection_list_touch(connections, conn);
+            }
+        }
+        conn = next;
+    }
+}
+
+/**
+ * Die Event-Loop eines Workers, in der eingehende Verbindungen angenommen werden.
+ * Alle Sockets sind nicht-blockierend und werden über eine epoll-Instanz gemeinsam
+ * überwacht, sodass ein langsamer Client die anderen nicht aufhält. Verbindungen
+ * bleiben für weitere Requests offen, bis der Client sie schließt oder sie zu lange
+ * untätig sind. Responses auf Änderungen der Buchungen warten, bis der Flusher des
+ * Write-Ahead-Logs sie dauerhaft geschrieben hat; er weckt die Event-Loop über ein Event-fd.
+ * @param arg Der Worker (worker *).
+ * @return Immer NULL.
+ */
+static void *worker_loop(void *arg) {
+    worker *self = arg;
+    if (self->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((size_t) self->cpu, &cpus);
+        //Ohne Bindung läuft der Worker einfach auf einer beliebigen CPU weiter.
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    const int sockfd = setup_socket();
+    connection_list connections = {NULL, NULL};
+    process_context ctx = {file_cache_new(self->config->cache_bytes), open_doc_root(),
+                           self->config->max_header_bytes, self->config->max_body_bytes, debug_page_open(),
+                           self->config->bookings};
+    struct epoll_event events[MAX_EVENTS];
+
+    const int epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd < 0) {
+        error("ERROR on epoll_create");
+    }
+    //Der Listen-Socket wird mit data.ptr == NULL registriert, alle anderen mit ihrer Verbindung.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+        error("ERROR on epoll_ctl");
     }
+    wal *log = ctx.bookings != NULL ? ctx.bookings->log : NULL;
+    const int walfd = log != NULL ? wal_subscribe(log) : -1;
+    if (log != NULL && walfd < 0) {
+        error("ERROR subscribing to the write-ahead log");
+    }
+    if (walfd >= 0) {
+        event.data.ptr = &wal_event;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, walfd, &event) < 0) {
+            error("ERROR on epoll_ctl");
+        }
+    }
+
     //Die Hauptschleife des Programms.
     while (run) {
-        //Der accept()-Aufruf blockiert, bis eine neue Verbindung hereinkommt.
-        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
-        if (newsockfd < 0) {
-            //Wenn der Server mit dem SIGINT-Signal beendet wird, schlägt accept mit EINTR (interrupted) fehl.
+        //Der epoll_wait()-Aufruf blockiert, bis auf einem der Sockets etwas passiert, höchstens
+        //aber eine Sekunde, damit untätige Verbindungen rechtzeitig geschlossen werden.
+        int count = epoll_wait(epollfd, events, MAX_EVENTS, 1000);
+        if (count < 0) {
+            //Wenn der Server mit dem SIGINT-Signal beendet wird, schlägt epoll_wait mit EINTR (interrupted) fehl.
             if (errno == EINTR) {
-                break;
+                continue;
             }
-            error("ERROR on accept");
+            error("ERROR on epoll_wait");
         }
-
-        //Lies die ankommenden Daten von dem Socket in das Array buffer.
-        memset(buffer, 0, BUFFER_SIZE);
-        length = read(newsockfd, buffer, BUFFER_SIZE - 1);
-        if (length < 0) {
-            if (errno == EINTR) {
-                break;
+        for (int i = 0; i < count; ++i) {
+            connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                accept_connections(sockfd, epollfd, &connections, &ctx);
+            } else if (events[i].data.ptr == &wal_event) {
+                resume_durable(walfd, &connections);
+            } else if (connection_handle(conn) == CONNECTION_CLOSING) {
+                close_connection(&connections, conn);
+            } else {
+                connection_list_touch(&connections, conn);
             }
-            error("ERROR reading from socket");
         }
-        string *request = str_cpy(buffer, (size_t) length);
-        string *response = process(request);
-
-        //Schreibe die ausgehenden Daten auf den Socket.
-        size_t response_len = get_length(response);
-        char *response_char = get_char_str(response);
-        length = write(newsockfd, response_char, response_len);
-        if (length < 0) {
-            error("ERROR writing to socket");
+        close_idle_connections(&connections);
+    }
+    while (connections.head != NULL) {
+        close_connection(&connections, connections.head);
+    }
+    if (close(epollfd) < 0 || close(sockfd) < 0) {
+        error("ERROR on close");
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "worker %u", self->id);
+    print_cache_stats(name, ctx.files);
+    print_doc_root_stats(name, ctx.root);
+    file_cache_free(ctx.files);
+    doc_root_close(ctx.root);
+    template_file_close(ctx.debug_page);
+    return NULL;
+}
+
+/**
+ * Ermittelt die CPU, an die der Worker *id* gebunden wird. Die Worker werden reihum
+ * auf die CPUs verteilt, auf denen der Prozess laufen darf (z.B. durch taskset).
+ * @param id Die Nummer des Workers.
+ * @return Die CPU oder -1, wenn sie nicht ermittelt werden kann.
+ */
+static int worker_cpu(unsigned int id) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return -1;
+    }
+    const int count = CPU_COUNT(&allowed);
+    int index = (int) (id % (unsigned int) count);
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && index-- == 0) {
+            return (int) cpu;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Startet die Worker, jeder mit eigenem Listen-Socket auf PORT. Der erste Worker
+ * läuft im Haupt-Thread, damit dieser das SIGINT-Signal empfängt; in den übrigen
+ * Threads ist SIGINT blockiert, sie bemerken das Beenden über den epoll-Timeout.
+ * Daneben schreibt ein Thread regelmäßig Snapshots der Buchungen, beim Beenden einen letzten.
+ * @param config Die Einstellungen, u.a. die Anzahl der Worker.
+ */
+static void main_loop(const server_config *config) {
+    const unsigned int count = (unsigned int) config->workers;
+    worker *workers = calloc(count, sizeof(worker));
+    if (workers == NULL) {
+        error("ERROR at calloc.");
+    }
+    const booking_store *store = config->bookings;
+    snapshotter snapshots = {0};
+    snapshots.config = config;
+    snapshots.written = wal_appended(store->log);
+    sigset_t block;
+    sigset_t old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    if (config->snapshot_interval > 0 && pthread_create(&snapshots.thread, NULL, snapshot_loop, &snapshots) != 0) {
+        error("ERROR on pthread_create");
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+        workers[i].id = i;
+        workers[i].config = config;
+        workers[i].cpu = count > 1 ? worker_cpu(i) : -1;
+        if (i > 0 && pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]) != 0) {
+            error("ERROR on pthread_create");
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    worker_loop(&workers[0]);
+    for (unsigned int i = 1; i < count; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    if (config->snapshot_interval > 0) {
+        pthread_join(snapshots.thread, NULL);
+    }
+    write_snapshot(&snapshots);
+    free(workers);
+}
+
+/**
+ * Ein Request aus dem Korpus des replay-Modus, er zeigt in die eingelesene Datei. Requests mit
+ * gleicher Route (Methode und URI) und gleichem Status werden in der Statistik zusammengefasst.
+ */
+typedef struct replay_request {
+    const char *data;
+    size_t len;
+    char route[REPLAY_ROUTE_NAME + 1];
+    //Status-Code der Response im ersten Durchlauf, z.B. "200".
+    char status[4];
+} replay_request;
+
+/**
+ * Die Requests einer Korpus-Datei, hintereinander abgelegt wie auf einer Verbindung mit Pipelining.
+ */
+typedef struct replay_corpus {
+    char *data;
+    replay_request *requests;
+    size_t count;
+} replay_corpus;
+
+/**
+ * Ein Thread des replay-Modus mit eigenem Kontext wie ein Worker, aber ohne Sockets.
+ */
+typedef struct replay_thread {
+    pthread_t thread;
+    unsigned int id;
+    int cpu;
+    const server_config *config;
+    replay_corpus *corpus;
+    //Dauer jedes Requests in Nanosekunden, je config->iterations Werte pro Request des Korpus.
+    uint64_t *samples;
+    uint64_t checksum;
+} replay_thread;
+
+/**
+ * Liest eine ganze Datei in den Speicher.
+ * @param path Der Pfad der Datei.
+ * @param len Wird auf die Länge gesetzt.
+ * @return Der Inhalt, muss mit free freigegeben werden.
+ */
+static char *read_file(const char *path, size_t *len) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        error("ERROR opening replay corpus");
+    }
+    char *data = malloc((size_t) st.st_size + 1);
+    if (data == NULL) {
+        error("ERROR at malloc.");
+    }
+    size_t length = 0;
+    while (length < (size_t) st.st_size) {
+        ssize_t received = read(fd, data + length, (size_t) st.st_size - length);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            error("ERROR reading replay corpus");
         }
-        str_free(request);
-        str_free(response);
+        length += (size_t) received;
+    }
+    close(fd);
+    *len = length;
+    return data;
+}
 
-        //Schließe die Verbindung.
-        if (close(newsockfd) < 0) {
-            error("ERROR on close");
+/**
+ * Liest ein Korpus aus aufgezeichneten Requests. Die Requests stehen roh hintereinander, Leerzeilen
+ * zwischen ihnen werden übersprungen. Ab dem ersten ungültigen Request wird der Rest der Datei als
+ * ein Request behandelt, der mit reject() beantwortet wird.
+ * @param path Der Pfad der Datei.
+ * @param config Die Grenzen des Parsers.
+ * @param corpus Wird mit den Requests gefüllt.
+ */
+static void replay_corpus_load(const char *path, const server_config *config, replay_corpus *corpus) {
+    size_t len;
+    corpus->data = read_file(path, &len);
+    corpus->requests = calloc(len / 4 + 1, sizeof(replay_request));
+    if (corpus->requests == NULL) {
+        error("ERROR at calloc.");
+    }
+    size_t offset = 0;
+    while (offset < len) {
+        if (corpus->data[offset] == '\r' || corpus->data[offset] == '\n') {
+            offset++;
+            continue;
+        }
+        http_parser parser = {0};
+        parser.max_header = config->max_header_bytes;
+        parser.max_body = config->max_body_bytes;
+        http_request_view request;
+        replay_request *entry = &corpus->requests[corpus->count++];
+        entry->data = corpus->data + offset;
+        if (http_parse_request(&parser, entry->data, len - offset, &request) == HTTP_PARSE_COMPLETE) {
+            snprintf(entry->route, sizeof(entry->route), "%.*s %.*s", (int) request.method.len,
+                     request.method.str, (int) request.uri.len, request.uri.str);
+            entry->len = request.length;
+        } else {
+            snprintf(entry->route, sizeof(entry->route), "(invalid)");
+            entry->len = len - offset;
         }
+        offset += entry->len;
     }
-    free(buffer);
-    if (close(sockfd) < 0) {
-        error("ERROR on close");
+    if (corpus->count == 0) {
+        errno = 0;
+        error("ERROR replay corpus contains no requests");
     }
 }
 
 /**
- * Die Funktion akzeptiert den eingehenden Request und gibt eine entsprechende Response zurück.
- * @param request Der eingehende Request.
- * @return Die ausgehende Response.
+ * Eine Prüfsumme nach dem Muster von FNV-1a über *len* Bytes, fortgesetzt von *hash*. Sie verarbeitet
+ * acht Bytes auf einmal, damit große Bodies die gemessene Latenz nicht dominieren.
  */
-string *process(string *request) {
-    //Validate Request-Line
-    short space_counter = 0;
-    for (unsigned int i = 0; i < request->len; ++i) {
-        if (request->str[i] == '\n') {
-            break;
-        } else if (request->str[i] == ' ') {
-            if (i > 0 && request->str[i - 1] == ' ') {
-                space_counter = 0;
-                break;
-            }
-            space_counter++;
+static uint64_t checksum_bytes(uint64_t hash, const char *data, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < len; ++i) {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Beantwortet einen Request des Korpus wie eine Verbindung: parsen, process() bzw. reject() und
+ * den Header serialisieren. Die Response wird verworfen, eine Datei wird nicht gesendet.
+ * @param ctx Der Kontext des Threads.
+ * @param config Die Grenzen des Parsers und ob eine Prüfsumme gebildet wird.
+ * @param entry Der Request.
+ * @param checksum Ein- und Ausgabe: Die Prüfsumme über Header, Body im Speicher und Dateibereich.
+ * @param status Wenn nicht NULL, wird der Status-Code der Response hineinkopiert.
+ */
+static void replay_request_run(process_context *ctx, const server_config *config, const replay_request *entry,
+                               uint64_t *checksum, char status[4]) {
+    http_parser parser = {0};
+    parser.max_header = config->max_header_bytes;
+    parser.max_body = config->max_body_bytes;
+    http_request_view request;
+    http_parse_status parsed = http_parse_request(&parser, entry->data, entry->len, &request);
+    if (parsed == HTTP_PARSE_INCOMPLETE) {
+        //Die Datei endet vor dem Ende des Requests.
+        parsed = HTTP_PARSE_INVALID;
+    }
+    bool keep_alive = true;
+    outgoing *out = outgoing_new(parsed == HTTP_PARSE_COMPLETE ? process(ctx, &request, &keep_alive)
+                                                               : reject(parsed, &keep_alive));
+    if (config->checksum) {
+        uint64_t hash = checksum_bytes(*checksum, out->header->str, out->header->len);
+        const http_response *resp = out->response;
+        if (resp->body != NULL && resp->body->str != NULL) {
+            hash = checksum_bytes(hash, resp->body->str, resp->body->len);
+        }
+        if (resp->file != NULL) {
+            const uint64_t range[2] = {(uint64_t) resp->file->offset, resp->file->length};
+            hash = checksum_bytes(hash, (const char *) range, sizeof(range));
         }
+        *checksum = hash;
     }
-    short line_break_counter = 0;
-    for (unsigned int i = 0; i < request->len; ++i) {
-        if (i > 0 && request->str[i] == '\n' && request->str[i - 1] == '\r') {
-            line_break_counter++;
+    if (status != NULL && out->header->len >= 12) {
+        memcpy(status, out->header->str + 9, 3);
+    }
+    outgoing_free(out);
+}
+
+/**
+ * Die Schleife eines replay-Threads: jeder Request des Korpus wird config->iterations Mal beantwortet
+ * und einzeln gemessen. Außer beim Öffnen von Dateien, die nicht im Cache liegen, und dem stat() eines
+ * Cache-Treffers fallen dabei keine Syscalls an.
+ * @param arg Der Thread (replay_thread *).
+ * @return Immer NULL.
+ */
+static void *replay_loop(void *arg) {
+    replay_thread *self = arg;
+    if (self->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((size_t) self->cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    const server_config *config = self->config;
+    const replay_corpus *corpus = self->corpus;
+    process_context ctx = {file_cache_new(config->cache_bytes), open_doc_root(), config->max_header_bytes,
+                           config->max_body_bytes, debug_page_open(), config->bookings};
+    arena *request_arena = arena_new(ARENA_DEFAULT_SIZE);
+    arena_use(request_arena);
+    self->checksum = 14695981039346656037ULL;
+
+    struct timespec before;
+    struct timespec after;
+    for (unsigned long iteration = 0; iteration < config->iterations; ++iteration) {
+        for (size_t i = 0; i < corpus->count; ++i) {
+            const replay_request *entry = &corpus->requests[i];
+            //Nur der erste Thread hält im ersten Durchlauf den Status fest, die übrigen lesen ihn nicht.
+            char *status = self->id == 0 && iteration == 0 ? corpus->requests[i].status : NULL;
+            clock_gettime(CLOCK_MONOTONIC, &before);
+            replay_request_run(&ctx, config, entry, &self->checksum, status);
+            arena_reset(request_arena);
+            clock_gettime(CLOCK_MONOTONIC, &after);
+            self->samples[i * config->iterations + iteration] =
+                    (uint64_t) ((after.tv_sec - before.tv_sec) * 1000000000L + (after.tv_nsec - before.tv_nsec));
         }
     }
 
-    http_request *req;
-    string *response_str;
+    arena_use(NULL);
+    arena_destroy(request_arena);
+    char name[32];
+    snprintf(name, sizeof(name), "replay %u", self->id);
+    print_cache_stats(name, ctx.files);
+    print_doc_root_stats(name, ctx.root);
+    file_cache_free(ctx.files);
+    doc_root_close(ctx.root);
+    template_file_close(ctx.debug_page);
+    return NULL;
+}
+
+/**
+ * Sortiert die Requests des Korpus nach Route und Status, siehe print_replay_routes.
+ */
+static int compare_routes(const void *a, const void *b) {
+    const replay_request *x = *(const replay_request *const *) a;
+    const replay_request *y = *(const replay_request *const *) b;
+    const int route = strcmp(x->route, y->route);
+    return route != 0 ? route : strcmp(x->status, y->status);
+}
 
-    if (space_counter == 2 && line_break_counter >= 2) {
-        req = str_to_http_request(request);
+static int compare_samples(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a;
+    const uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
 
-        http_response *resp = calloc(1, sizeof(http_response));
-        resp->entity_header = calloc(1, sizeof(entity_header));
-        for (unsigned int i = 0; i < req->uri->len; i++) {
-            if (req->uri->str[i] == '\0') {
-                set_response_status(resp, char_to_string("400"), char_to_string("Bad Request"));
-                set_response_default_html_body(resp);
-                response_str = response_string(resp);
-                free_request(req);
-                free_response(resp);
-                return response_str;
+/**
+ * Gibt die Statistik pro Route auf stdout aus: Anzahl, Mittelwert, Perzentile und Maximum.
+ * @param corpus Das Korpus.
+ * @param threads Die beendeten Threads mit ihren Messwerten.
+ * @param count Anzahl der Threads.
+ * @param iterations Durchläufe pro Thread.
+ */
+static void print_replay_routes(const replay_corpus *corpus, const replay_thread *threads, unsigned int count,
+                                unsigned long iterations) {
+    const replay_request **sorted = malloc(corpus->count * sizeof(replay_request *));
+    uint64_t *samples = malloc(corpus->count * iterations * count * sizeof(uint64_t));
+    if (sorted == NULL || samples == NULL) {
+        error("ERROR at malloc.");
+    }
+    for (size_t i = 0; i < corpus->count; ++i) {
+        sorted[i] = &corpus->requests[i];
+    }
+    qsort(sorted, corpus->count, sizeof(replay_request *), compare_routes);
+    printf("%-*s %6s %10s %10s %10s %10s %10s\n", REPLAY_ROUTE_NAME, "route", "status", "requests", "mean ns",
+           "p50 ns", "p99 ns", "max ns");
+    for (size_t first = 0; first < corpus->count;) {
+        size_t n = 0;
+        size_t last = first;
+        for (; last < corpus->count && compare_routes(&sorted[first], &sorted[last]) == 0; ++last) {
+            const size_t index = (size_t) (sorted[last] - corpus->requests);
+            for (unsigned int t = 0; t < count; ++t) {
+                memcpy(samples + n, threads[t].samples + index * iterations, iterations * sizeof(uint64_t));
+                n += iterations;
             }
         }
-        string *http_version = char_to_string("HTTP/1.1");
-        if (req->uri->len > 0 && req->uri->len < 256 &&
-            str_start_with_chars(req->uri, "/", strlen("/"))) {
-
-            string *get = char_to_string("GET");
-            string *post = char_to_string("POST");
-            if (str_equals(req->method, get)) {
-                //Get File
-                if (req->uri->len == 1) {
-                    set_response_status(resp, char_to_string("308"), char_to_string("Permanent Redirect"));
-                    resp->location = char_to_string(FRONTEND_LOCATION);
-                } else {
-                    string *file_path = str_cpy(req->uri->str, req->uri->len);
-
-                    string *file;
-                    switch (validate_file_access(file_path->str, (unsigned int) file_path->len)) {
-                        case 1: //File exists
-                            file = read_file_into_string(file_path->str, (unsigned int) file_path->len);
-                            if (file == NULL) {
-                                //Filepath is directory, not a file
-                                set_response_status(resp, char_to_string("404"), char_to_string("Not Found"));
-                                set_response_default_html_body(resp);
-                                break;
-                            }
-
-                        //Get File Type
-                            string **split_pathsplit_str = str_split(file_path, '.');
-                            int i = 0;
-                            for (i = 0; split_pathsplit_str[i]; ++i) {
-                                ;
-                            }
-                            string *ending = split_pathsplit_str[i - 1];
-                            for (int j = 0; j < i - 1; ++j) {
-                                str_print(split_pathsplit_str[j]);
-                                str_free(split_pathsplit_str[j]);
-                            }
-                            free(split_pathsplit_str);
-
-                            set_response_status(resp, char_to_string("200"), char_to_string("OK"));
-                            set_response_body(resp, file, get_content_type(ending));
-
-                            break;
-                        case 2: //File not found
-                            set_response_status(resp, char_to_string("404"), char_to_string("Not Found"));
-                            set_response_default_html_body(resp);
-                            break;
-                        default: //File not in doc-root
-                            set_response_status(resp, char_to_string("403"), char_to_string("Forbidden"));
-                            set_response_default_html_body(resp);
-                            break;
-                    }
-                    str_free(file_path);
-                }
-                str_free(get);
-                str_free(post);
-            } else if (str_equals(req->method, post)) {
-                set_response_status(resp, char_to_string("501"), char_to_string("Not Implemented"));
-                set_response_default_html_body(resp);
-            }
-        } else if (req->uri->len > 255) {
-            set_response_status(resp, char_to_string("414"), char_to_string("URI too long"));
-            set_response_default_html_body(resp);
-        } else {
-            set_response_status(resp, char_to_string("501"), char_to_string("Not Implemented"));
-            set_response_default_html_body(resp);
+        qsort(samples, n, sizeof(uint64_t), compare_samples);
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += samples[i];
+        }
+        printf("%-*s %6s %10zu %10.0f %10llu %10llu %10llu\n", REPLAY_ROUTE_NAME, sorted[first]->route,
+               sorted[first]->status, n, (double) sum / (double) n, (unsigned long long) samples[(n - 1) / 2],
+               (unsigned long long) samples[(n - 1) * 99 / 100], (unsigned long long) samples[n - 1]);
+        first = last;
+    }
+    free(samples);
+    free(sorted);
+}
+
+/**
+ * Der replay-Modus: beantwortet die Requests einer Korpus-Datei wiederholt ohne Netzwerk, mit
+ * config->workers Threads, die je das ganze Korpus abarbeiten. Gedacht zum Profilen des Parsers und
+ * der Serialisierung (perf) und als Trainingslauf für PGO-Builds.
+ * @param path Der Pfad des Korpus.
+ * @param config Die Einstellungen.
+ * @return true, wenn alle Threads dieselbe Prüfsumme berechnet haben (oder keine berechnet wurde).
+ */
+static bool main_loop_replay(const char *path, const server_config *config) {
+    replay_corpus corpus = {0};
+    replay_corpus_load(path, config, &corpus);
+    const unsigned int count = (unsigned int) config->workers;
+    replay_thread *threads = calloc(count, sizeof(replay_thread));
+    if (threads == NULL) {
+        error("ERROR at calloc.");
+    }
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < count; ++i) {
+        threads[i].id = i;
+        threads[i].cpu = count > 1 ? worker_cpu(i) : -1;
+        threads[i].config = config;
+        threads[i].corpus = &corpus;
+        threads[i].samples = malloc(corpus.count * config->iterations * sizeof(uint64_t));
+        if (threads[i].samples == NULL) {
+            error("ERROR at malloc.");
+        }
+        if (pthread_create(&threads[i].thread, NULL, replay_loop, &threads[i]) != 0) {
+            error("ERROR on pthread_create");
         }
-        response_str = response_string(resp);
-        str_free(http_version);
-        free_request(req);
-        free_response(resp);
-        return response_str;
-    }
-    //Bad Request
-    http_response *resp = calloc(1, sizeof(http_response));
-    resp->entity_header = calloc(1, sizeof(entity_header));
-    set_response_status(resp, char_to_string("400"), char_to_string("Bad Request"));
-    set_response_default_html_body(resp);
-    response_str = response_string(resp);
-
-    free_response(resp);
-    return response_str;
+    }
+    bool consistent = true;
+    for (unsigned int i = 0; i < count; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        consistent = consistent && threads[i].checksum == threads[0].checksum;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    const double total = (double) corpus.count * (double) config->iterations * count;
+    printf("replay: %zu requests x %lu iterations x %u threads\n", corpus.count, config->iterations, count);
+    printf("total:  %.0f requests in %.3f s, %.0f req/s\n", total, seconds, total / seconds);
+    if (config->checksum) {
+        printf("checksum: %016llx%s\n", (unsigned long long) threads[0].checksum,
+               consistent ? "" : " (threads differ)");
+    }
+    print_replay_routes(&corpus, threads, count, config->iterations);
+
+    for (unsigned int i = 0; i < count; ++i) {
+        free(threads[i].samples);
+    }
+    free(threads);
+    free(corpus.requests);
+    free(corpus.data);
+    return consistent;
+}
+
+/**
+ * Liest eine Zahl aus einem Kommandozeilen-Argument.
+ * @param arg Das Argument.
+ * @param min Kleinster erlaubter Wert.
+ * @param max Größter erlaubter Wert.
+ * @param value Wird auf die Zahl gesetzt.
+ * @return true, wenn das Argument eine Zahl zwischen min und max ist.
+ */
+static bool parse_number(const char *arg, unsigned long min, unsigned long max, unsigned long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoul(arg, &end, 10);
+    return errno == 0 && end != arg && *end == '\0' && *value >= min && *value <= max;
 }
 
+/**
+ * Aufruf: wg_buchungstool_backend [stdin | replay KORPUS] [--workers N] [--cache-bytes N]
+ *         [--max-header-bytes N] [--max-body-bytes N] [--iterations N] [--checksum]
+ *         [--wal PFAD] [--durability none|group|sync] [--snapshot PFAD] [--snapshot-interval N]
+ * Mit "stdin" wird genau ein Request von stdin gelesen und beantwortet, sonst lauscht
+ * der Server mit N Worker-Threads (Standard: 1) auf PORT. --cache-bytes legt das
+ * Budget des Datei-Caches pro Worker fest (0 schaltet ihn praktisch ab). Größere
+ * Header werden mit 431, größere Bodies mit 413 abgelehnt.
+ * Mit "replay" beantworten N Threads die Requests aus KORPUS je --iterations Mal (Standard:
+ * REPLAY_DEFAULT_ITERATIONS) ohne Netzwerk und geben die Latenz pro Route aus; --checksum
+ * bildet dabei eine Prüfsumme über alle Responses.
+ * Die Buchungen werden im Write-Ahead-Log PFAD (Standard: WAL_DEFAULT_PATH) gespeichert und beim
+ * Start daraus gelesen; der replay-Modus arbeitet nur im Speicher. Mit --durability group
+ * (Standard) werden gleichzeitige Änderungen mit einem fdatasync() geschrieben, mit sync jede
+ * einzeln, mit none gar nicht. Alle --snapshot-interval Sekunden (Standard:
+ * SNAPSHOT_DEFAULT_INTERVAL, 0 nur beim Beenden) werden die Buchungen in den Snapshot PFAD
+ * (Standard: SNAPSHOT_DEFAULT_PATH) geschrieben; beim Start wird er gemappt und nur das Log
+ * dahinter nachgespielt.
+ */
 int main(int argc, char *argv[]) {
     register_signal();
-    if (argc == 2 && strcmp("stdin", argv[1]) == 0) {
-        main_loop_stdin();
+    server_config config = {1, FILE_CACHE_DEFAULT_BUDGET, MAX_HEADER_BYTES, MAX_BODY_BYTES,
+                            REPLAY_DEFAULT_ITERATIONS, false, NULL, WAL_DEFAULT_PATH, WAL_DURABILITY_GROUP,
+                            SNAPSHOT_DEFAULT_PATH, SNAPSHOT_DEFAULT_INTERVAL};
+    bool stdin_mode = false;
+    const char *corpus = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp("stdin", argv[i]) == 0) {
+            stdin_mode = true;
+        } else if (strcmp("replay", argv[i]) == 0 && i + 1 < argc) {
+            corpus = argv[++i];
+        } else if (strcmp("--iterations", argv[i]) == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, ULONG_MAX, &config.iterations)) {
+                fprintf(stderr, "ERROR --iterations expects a positive number\n");
+                return 1;
+            }
+        } else if (strcmp("--checksum", argv[i]) == 0) {
+            config.checksum = true;
+        } else if (strcmp("--wal", argv[i]) == 0 && i + 1 < argc) {
+            config.wal_path = argv[++i];
+        } else if (strcmp("--snapshot", argv[i]) == 0 && i + 1 < argc) {
+            config.snapshot_path = argv[++i];
+        } else if (strcmp("--snapshot-interval", argv[i]) == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 0, UINT_MAX, &config.snapshot_interval)) {
+                fprintf(stderr, "ERROR --snapshot-interval expects a number of seconds\n");
+                return 1;
+            }
+        } else if (strcmp("--durability", argv[i]) == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "none") == 0) {
+                config.durability = WAL_DURABILITY_NONE;
+            } else if (strcmp(mode, "group") == 0) {
+                config.durability = WAL_DURABILITY_GROUP;
+            } else if (strcmp(mode, "sync") == 0) {
+                config.durability = WAL_DURABILITY_SYNC;
+            } else {
+                fprintf(stderr, "ERROR --durability expects none, group or sync\n");
+                return 1;
+            }
+        } else if (strcmp("--workers", argv[i]) == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, MAX_WORKERS, &config.workers)) {
+                fprintf(stderr, "ERROR --workers expects a number between 1 and %d\n", MAX_WORKERS);
+                return 1;
+            }
+        } else if (strcmp("--max-header-bytes", argv[i]) == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, (unsigned long) SSIZE_MAX / 2, &config.max_header_bytes)) {
+                fprintf(stderr, "ERROR --max-header-bytes expects a number of bytes\n");
+                return 1;
+            }
+        } else if (strcmp("--max-body-bytes", argv[i]) == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, (unsigned long) SSIZE_MAX / 2, &config.max_body_bytes)) {
+                fprintf(stderr, "ERROR --max-body-bytes expects a number of bytes\n");
+                return 1;
+            }
+        } else if (strcmp("--cache-bytes", argv[i]) == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 0, (unsigned long) SSIZE_MAX, &config.cache_bytes)) {
+                fprintf(stderr, "ERROR --cache-bytes expects a number of bytes\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [stdin | replay CORPUS] [--workers N] [--cache-bytes N] "
+                            "[--max-header-bytes N] [--max-body-bytes N] [--iterations N] [--checksum] [--wal PATH] "
+                            "[--durability none|group|sync] [--snapshot PATH] [--snapshot-interval N]\n", argv[0]);
+            return 1;
+        }
+    }
+    canned_responses_init();
+    config.bookings = booking_store_new();
+    bool ok = true;
+    if (corpus != NULL) {
+        ok = main_loop_replay(corpus, &config);
+    } else if (stdin_mode) {
+        open_bookings(&config);
+        main_loop_stdin(&config);
     } else {
-        main_loop();
+        const double startup = open_bookings(&config);
+        const booking_store *store = config.bookings;
+        fprintf(stderr, "bookings ready in %.1f ms: %llu from the snapshot, %lu log records replayed\n", startup,
+                (unsigned long long) (store->base != NULL ? store->base->header->record_count : 0),
+                wal_get_stats(store->log).recovered);
+        main_loop(&config);
+        print_wal_stats(config.bookings->log);
     }
-    return 0;
+    booking_store_free(config.bookings);
+    return ok ? 0 : 1;
 }
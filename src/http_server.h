@@ -0,0 +1,57 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <stdbool.h>
+
+#include "booking.h"
+#include "docroot.h"
+#include "filecache.h"
+#include "httplib.h"
+#include "template.h"
+
+#define PORT 31337
+//Standardgrenzen für Request-Line plus Header (sonst 431) und für den Body (sonst 413) in Bytes.
+#define MAX_HEADER_BYTES (16*1024)
+#define MAX_BODY_BYTES (1024*1024)
+//Maximale Länge des dekodierten Pfads einer URI (sonst 414).
+#define MAX_URI_LENGTH 255
+#define FRONTEND_LOCATION "http://localhost:4200"
+//Die Vorlage der Seite unter /debug, sie zeigt Methode, Ressource und Protokoll des Requests.
+#define DEBUG_PATH "/debug"
+#define DEBUG_TEMPLATE DOC_ROOT "debug.html"
+//Unter diesem Pfad liegt die Buchungs-API (siehe api_process).
+#define API_PATH "/api"
+//Sekunden, die eine Verbindung ohne Aktivität offen bleibt.
+#define KEEP_ALIVE_TIMEOUT 5
+//Maximale Anzahl an Requests pro Verbindung, danach wird sie geschlossen.
+#define KEEP_ALIVE_MAX_REQUESTS 1000
+
+/**
+ * Der Zustand, den process() braucht. Jeder Worker hat seinen eigenen, damit sich
+ * Worker keinen veränderlichen Zustand teilen.
+ */
+typedef struct process_context {
+    file_cache *files;
+    //Das einmal geöffnete doc-root, Dateien werden relativ dazu geöffnet.
+    doc_root *root;
+    //Grenzen für eingehende Requests, siehe http_parser.
+    size_t max_header_bytes;
+    size_t max_body_bytes;
+    //Die Vorlage für DEBUG_PATH (siehe debug_page_open), ohne sie antwortet /debug mit 404.
+    template_file *debug_page;
+    //Die Buchungen, die sich alle Worker teilen; ohne sie antwortet API_PATH mit 404.
+    booking_store *bookings;
+} process_context;
+
+void canned_responses_init(void);
+
+template_file *debug_page_open(void);
+
+http_response *process(process_context *ctx, const http_request_view *request, bool *keep_alive);
+
+http_response *api_process(process_context *ctx, const http_request_view *request, const char *path,
+                           size_t path_len, bool keep_alive);
+
+http_response *reject(http_parse_status status, bool *keep_alive);
+
+#endif //HTTP_SERVER_H
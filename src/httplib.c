@@ -1,30 +1,59 @@
 #include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <linux/limits.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "httplib.h"
+#include "scan.h"
 
-#define DOC_ROOT "../resources/"
+typedef struct mime_type {
+    const char *extension;
+    size_t extension_len;
+    string type;
+} mime_type;
+
+#include "mimetable.h"
+
+static const string octet_stream = {24, "application/octet-stream", 0};
+
+//Static resources don't contain this boundary, so it does not have to be generated per response
+#define BYTERANGES_BOUNDARY "wg-byteranges-5c1e0b7d9a4f2368"
+static const string multipart_byteranges = {sizeof("multipart/byteranges; boundary=" BYTERANGES_BOUNDARY) - 1,
+                                            "multipart/byteranges; boundary=" BYTERANGES_BOUNDARY, 0};
 
 void free_request_header(request_header *header) {
     if (header->user_agent != NULL)
         str_free(header->user_agent);
-    free(header);
+    arena_free(header);
 }
 
 void free_entity_header(entity_header *header) {
     assert(header != NULL);
-    if (header->content_type != NULL)
-        str_free(header->content_type);
-    free(header);
+    //content types are static, see get_content_type
+    if (header->etag != NULL)
+        str_free(header->etag);
+    if (header->last_modified != NULL)
+        str_free(header->last_modified);
+    if (header->content_range != NULL)
+        str_free(header->content_range);
+    arena_free(header);
 }
 
 void free_request(http_request *request) {
     assert(request != NULL);
     if (request->host != NULL)
         str_free(request->host);
+    if (request->connection != NULL)
+        str_free(request->connection);
     if (request->body != NULL)
         str_free(request->body);
     if (request->method != NULL)
@@ -35,7 +64,7 @@ void free_request(http_request *request) {
         str_free(request->protocol);
     if (request->header != NULL)
         free_request_header(request->header);
-    free(request);
+    arena_free(request);
 }
 
 void free_response(http_response *response) {
@@ -48,9 +77,52 @@ void free_response(http_response *response) {
         str_free(response->status_description);
     if (response->entity_header != NULL)
         free_entity_header(response->entity_header);
-    if (response->body != NULL && response->body->str != NULL)
+    if (response->location != NULL)
+        str_free(response->location);
+    if (response->allow != NULL)
+        str_free(response->allow);
+    if (response->connection != NULL)
+        str_free(response->connection);
+    if (response->release != NULL)
+        response->release(response->owner);
+    else if (response->body != NULL && response->body->str != NULL)
         str_free(response->body);
-    free(response);
+    if (response->file != NULL) {
+        close(response->file->fd);
+        arena_free(response->file);
+    }
+    arena_free(response);
+}
+
+/**
+ * Creates an empty response with its entity header
+ * @return new response, must be freed with free_response
+ */
+http_response *response_new(void) {
+    http_response *response = arena_calloc(1, sizeof(http_response));
+    if (response == NULL) {
+        exit(2);
+    }
+    response->entity_header = arena_calloc(1, sizeof(entity_header));
+    if (response->entity_header == NULL) {
+        exit(2);
+    }
+    return response;
+}
+
+/**
+ * Creates a response that sends an already serialized response (header and body) unchanged.
+ * Nothing is built or copied, only the response itself is allocated.
+ * @param serialized the complete response, must stay valid and unchanged until the response is freed
+ * @return new response, must be freed with free_response
+ */
+http_response *response_prepared(const string *serialized) {
+    http_response *response = arena_calloc(1, sizeof(http_response));
+    if (response == NULL) {
+        exit(2);
+    }
+    response->prepared_header = serialized;
+    return response;
 }
 
 /**
@@ -77,8 +149,8 @@ int hex2int(char c) {
  * @return http_request dargestellt im struct
  */
 http_request *str_to_http_request(string *str) {
-    http_request *req = calloc(1, sizeof(http_request));
-    req->header = calloc(1, sizeof(request_header));
+    http_request *req = arena_calloc(1, sizeof(http_request));
+    req->header = arena_calloc(1, sizeof(request_header));
     string **split_req = str_split(str, '\n');
 
     //Set Request Line
@@ -90,28 +162,36 @@ http_request *str_to_http_request(string *str) {
         str_free(request_line[2]);
     }
     str_free(request_line[1]);
-    free(request_line);
+    arena_free(request_line);
 
     for (int i = 0; split_req[i]; ++i) {
         str_to_lower_case(split_req[i]);
         string *host_str = char_to_string("host:");
         string *user_agent_str = char_to_string("user_agent");
+        string *connection_str = char_to_string("connection:");
 
         if (str_start_with(split_req[i], host_str)) {
             string **host = str_split_at_index(split_req[i], (int) host_str->len);
             req->host = host[1];
             str_format(host[1]);
             str_free(host[0]);
-            free(host);
+            arena_free(host);
         } else if (str_start_with(split_req[i], user_agent_str)) {
             string **ua = str_split_at_index(split_req[i], (int) user_agent_str->len);
             req->header->user_agent = ua[1];
             str_trim(ua[1]);
             str_free(ua[0]);
-            free(ua);
+            arena_free(ua);
+        } else if (str_start_with(split_req[i], connection_str)) {
+            string **connection = str_split_at_index(split_req[i], (int) connection_str->len);
+            req->connection = connection[1];
+            str_format(connection[1]);
+            str_free(connection[0]);
+            arena_free(connection);
         }
         str_free(host_str);
         str_free(user_agent_str);
+        str_free(connection_str);
     }
     //Set body
     for (unsigned int i = 0; split_req[i]; ++i) {
@@ -132,10 +212,644 @@ http_request *str_to_http_request(string *str) {
     for (int i = 0; split_req[i]; ++i) {
         str_free(split_req[i]);
     }
-    free(split_req);
+    arena_free(split_req);
     return req;
 }
 
+/**
+ * Compares a view case-insensitively with a lower case literal
+ * @param view view to compare
+ * @param lower lower case literal
+ * @param len length of lower
+ * @return 1 if equal, 0 if not
+ */
+static short view_equals_lower(str_view view, const char *lower, size_t len) {
+    if (view.len != len) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if ((view.str[i] | 0x20) != lower[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Checks whether a view contains a lower case token, ignoring case (e.g. "close" in "Keep-Alive, Close")
+ * @param view view to search in
+ * @param lower lower case token
+ * @param len length of lower
+ * @return 1 if contained, 0 if not
+ */
+static short view_contains_lower(str_view view, const char *lower, size_t len) {
+    for (size_t i = 0; i + len <= view.len; ++i) {
+        str_view part = {view.str + i, len};
+        if (view_equals_lower(part, lower, len)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Parses a Content-Length value. Numbers too large for size_t are set to SIZE_MAX, so they
+ * exceed every body limit.
+ * @param value header value without surrounding whitespace
+ * @param length set to the parsed number
+ * @return 1 on success, 0 if the value is no number
+ */
+static short parse_content_length(str_view value, size_t *length) {
+    if (value.len == 0) {
+        return 0;
+    }
+    size_t number = 0;
+    for (size_t i = 0; i < value.len; ++i) {
+        if (value.str[i] < '0' || value.str[i] > '9') {
+            return 0;
+        }
+        const size_t digit = (size_t) (value.str[i] - '0');
+        number = number > (SIZE_MAX - digit) / 10 ? SIZE_MAX : number * 10 + digit;
+    }
+    *length = number;
+    return 1;
+}
+
+/**
+ * Parses the request line "METHOD SP URI SP PROTOCOL"
+ * @param line the line without CRLF
+ * @param len length of the line
+ * @param space offset of the first space found by scan_line, len or more if there is none
+ * @param request method, uri and protocol are set
+ * @return 1 on success, 0 if the line is malformed
+ */
+static short parse_request_line(const char *line, size_t len, size_t space, http_request_view *request) {
+    if (space >= len || space == 0) {
+        return 0;
+    }
+    const char *uri = line + space + 1;
+    const char *end = line + len;
+    const char *protocol = memchr(uri, ' ', (size_t) (end - uri));
+    if (protocol == NULL || protocol == uri) {
+        return 0;
+    }
+    protocol++;
+    if (protocol == end || memchr(protocol, ' ', (size_t) (end - protocol)) != NULL) {
+        return 0;
+    }
+    request->method = (str_view) {line, (size_t) (uri - 1 - line)};
+    request->uri = (str_view) {uri, (size_t) (protocol - 1 - uri)};
+    request->protocol = (str_view) {protocol, (size_t) (end - protocol)};
+    return 1;
+}
+
+/**
+ * Parses a header line "name: value" and remembers the headers the server needs
+ * @param line the line without CRLF
+ * @param len length of the line
+ * @param separator offset of the first ':' found by scan_line, len or more if there is none
+ * @param request the header is added to request
+ * @return 1 on success, 0 if the line is malformed, -1 if there are too many headers
+ */
+static short parse_header_line(const char *line, size_t len, size_t separator, http_request_view *request) {
+    if (separator >= len || separator == 0) {
+        return 0;
+    }
+    const char *colon = line + separator;
+    if (request->header_count == HTTP_MAX_HEADERS) {
+        return -1;
+    }
+    str_view name = {line, (size_t) (colon - line)};
+    //no whitespace in names, this also rejects obsolete line folding
+    for (size_t i = 0; i < name.len; ++i) {
+        if (name.str[i] == ' ' || name.str[i] == '\t') {
+            return 0;
+        }
+    }
+    const char *value = colon + 1;
+    const char *end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    http_header_field *field = &request->headers[request->header_count++];
+    field->name = name;
+    field->value = (str_view) {value, (size_t) (end - value)};
+
+    if (view_equals_lower(name, "host", 4)) {
+        request->host = field->value;
+    } else if (view_equals_lower(name, "connection", 10)) {
+        request->connection = field->value;
+    } else if (view_equals_lower(name, "user-agent", 10)) {
+        request->user_agent = field->value;
+    } else if (view_equals_lower(name, "if-none-match", 13)) {
+        request->if_none_match = field->value;
+    } else if (view_equals_lower(name, "if-modified-since", 17)) {
+        request->if_modified_since = field->value;
+    } else if (view_equals_lower(name, "range", 5)) {
+        request->range = field->value;
+    } else if (view_equals_lower(name, "if-range", 8)) {
+        request->if_range = field->value;
+    } else if (view_equals_lower(name, "content-length", 14)) {
+        //a repeated Content-Length has to agree, otherwise it is unclear where the body ends
+        size_t length;
+        if (!parse_content_length(field->value, &length)
+            || (request->has_content_length && length != request->content_length)) {
+            return 0;
+        }
+        request->content_length = length;
+        request->has_content_length = true;
+    } else if (view_equals_lower(name, "transfer-encoding", 17)) {
+        request->transfer_encoding = true;
+    }
+    return 1;
+}
+
+/**
+ * Resets the parser for the next request, its limits are kept
+ * @param parser the parser
+ * @param status result of the request
+ * @return status
+ */
+static http_parse_status parser_finish(http_parser *parser, http_parse_status status) {
+    parser->scanned = 0;
+    parser->header_length = 0;
+    parser->content_length = 0;
+    return status;
+}
+
+/**
+ * Parses the first request in a receive buffer in a single pass, without copying or allocating:
+ * all fields of *request* are views into *buf* and only valid as long as it is unchanged.
+ * If the request is not complete yet, *parser* remembers how far the buffer was searched, so the
+ * next call with more bytes only looks at the new ones until the header block is complete.
+ * A header block larger than parser->max_header or a Content-Length above parser->max_body is
+ * rejected as soon as it is known, without waiting for the rest of the request.
+ * @param parser state between calls for the same request, zero initialized for a new one
+ * @param buf received bytes, starting with the request, may contain further (pipelined) requests
+ * @param len number of received bytes
+ * @param request set on HTTP_PARSE_COMPLETE, request->length is the length of the request incl. body
+ * @return HTTP_PARSE_COMPLETE, HTTP_PARSE_INCOMPLETE if more bytes are needed, HTTP_PARSE_INVALID
+ * if the request is malformed (including differing Content-Length headers, or Transfer-Encoding
+ * together with Content-Length), HTTP_PARSE_HEADER_TOO_LARGE, HTTP_PARSE_BODY_TOO_LARGE or
+ * HTTP_PARSE_NOT_IMPLEMENTED for Transfer-Encoding. parser is reset unless more bytes are needed.
+ */
+http_parse_status http_parse_request(http_parser *parser, const char *buf, size_t len, http_request_view *request) {
+    const size_t max_header = parser->max_header > 0 ? parser->max_header : SIZE_MAX;
+    if (parser->header_length > 0) {
+        //header block already complete, waiting for the body
+        if (len - parser->header_length < parser->content_length) {
+            return HTTP_PARSE_INCOMPLETE;
+        }
+    } else if (parser->scanned > 0) {
+        //only search the new bytes for the empty line that ends the header block
+        const size_t start = parser->scanned < 3 ? 0 : parser->scanned - 3;
+        if (start + scan_header_end(buf + start, len - start) == len) {
+            parser->scanned = len;
+            return len > max_header ? parser_finish(parser, HTTP_PARSE_HEADER_TOO_LARGE) : HTTP_PARSE_INCOMPLETE;
+        }
+    }
+
+    //the header array is filled up to header_count, everything in front of it is reset
+    memset(request, 0, offsetof(http_request_view, headers));
+    size_t pos = 0;
+    bool request_line = true;
+    while (1) {
+        //the line end and the first separator of the line are found in the same pass
+        size_t separator;
+        const size_t end = pos + scan_line(buf + pos, len - pos, request_line ? ' ' : ':', &separator);
+        if (end == len) {
+            parser->scanned = len;
+            return len > max_header ? parser_finish(parser, HTTP_PARSE_HEADER_TOO_LARGE) : HTTP_PARSE_INCOMPLETE;
+        }
+        if (end >= max_header) {
+            return parser_finish(parser, HTTP_PARSE_HEADER_TOO_LARGE);
+        }
+        if (end == pos || buf[end - 1] != '\r') {
+            //lines have to end with CRLF
+            return parser_finish(parser, HTTP_PARSE_INVALID);
+        }
+        const size_t line_len = end - 1 - pos;
+        if (line_len == 0 && !request_line) {
+            pos = end + 1;
+            break;
+        }
+        short ok = request_line ? parse_request_line(buf + pos, line_len, separator, request)
+                                : parse_header_line(buf + pos, line_len, separator, request);
+        if (ok <= 0) {
+            return parser_finish(parser, ok < 0 ? HTTP_PARSE_HEADER_TOO_LARGE : HTTP_PARSE_INVALID);
+        }
+        request_line = false;
+        pos = end + 1;
+    }
+
+    if (request->transfer_encoding) {
+        //the body isn't framed by Content-Length, reading on would take its bytes for the next request
+        return parser_finish(parser, request->has_content_length ? HTTP_PARSE_INVALID : HTTP_PARSE_NOT_IMPLEMENTED);
+    }
+    if (parser->max_body > 0 && request->content_length > parser->max_body) {
+        return parser_finish(parser, HTTP_PARSE_BODY_TOO_LARGE);
+    }
+    if (len - pos < request->content_length) {
+        parser->scanned = len;
+        parser->header_length = pos;
+        parser->content_length = request->content_length;
+        return HTTP_PARSE_INCOMPLETE;
+    }
+    request->body = (str_view) {buf + pos, request->content_length};
+    request->length = pos + request->content_length;
+    return parser_finish(parser, HTTP_PARSE_COMPLETE);
+}
+
+/**
+ * Decides whether the client wants to keep the connection open after this request.
+ * An explicit Connection header wins, otherwise HTTP/1.1 defaults to keep-alive and
+ * older versions to close.
+ * @param request parsed request
+ * @return 1 for a persistent connection, 0 if it should be closed
+ */
+short request_keep_alive(const http_request_view *request) {
+    if (view_contains_lower(request->connection, "close", 5)) {
+        return 0;
+    }
+    if (view_contains_lower(request->connection, "keep-alive", 10)) {
+        return 1;
+    }
+    return request->protocol.len == 8 && memcmp(request->protocol.str, "HTTP/1.1", 8) == 0;
+}
+
+static const char day_names[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char month_names[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/**
+ * Parses a number of exactly *digits* decimal digits
+ * @param str the digits
+ * @param digits number of digits
+ * @param number set to the parsed number
+ * @return 1 on success, 0 if one of the characters is no digit
+ */
+static short parse_digits(const char *str, size_t digits, int *number) {
+    *number = 0;
+    for (size_t i = 0; i < digits; ++i) {
+        if (str[i] < '0' || str[i] > '9') {
+            return 0;
+        }
+        *number = *number * 10 + (str[i] - '0');
+    }
+    return 1;
+}
+
+/**
+ * Parses an HTTP date in the preferred format, e.g. "Sun, 06 Nov 1994 08:49:37 GMT" (RFC 9110, 5.6.7).
+ * The obsolete formats are not accepted, clients send back the Last-Modified value they got.
+ * @param value the header value
+ * @param time set to the parsed time
+ * @return 1 on success, 0 if the value is no valid date
+ */
+static short http_date_parse(str_view value, time_t *time) {
+    const char *v = value.str;
+    if (value.len != 29 || v[3] != ',' || v[4] != ' ' || v[7] != ' ' || v[11] != ' ' || v[16] != ' '
+        || v[19] != ':' || v[22] != ':' || v[25] != ' ' || memcmp(v + 26, "GMT", 3) != 0) {
+        return 0;
+    }
+    struct tm tm = {0};
+    int month = 0;
+    while (month < 12 && memcmp(v + 8, month_names[month], 3) != 0) {
+        month++;
+    }
+    if (month == 12 || !parse_digits(v + 5, 2, &tm.tm_mday) || !parse_digits(v + 12, 4, &tm.tm_year)
+        || !parse_digits(v + 17, 2, &tm.tm_hour) || !parse_digits(v + 20, 2, &tm.tm_min)
+        || !parse_digits(v + 23, 2, &tm.tm_sec)) {
+        return 0;
+    }
+    if (tm.tm_mday < 1 || tm.tm_mday > 31 || tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60) {
+        return 0;
+    }
+    tm.tm_mon = month;
+    tm.tm_year -= 1900;
+    *time = timegm(&tm);
+    return 1;
+}
+
+/**
+ * Checks whether an If-None-Match value matches an entity tag. The weak comparison is used
+ * (RFC 9110, 13.1.2), a "W/" prefix is ignored.
+ * @param value header value, "*" or a comma separated list of entity tags
+ * @param etag the entity tag of the file including the quotes
+ * @return 1 if one of the tags matches, 0 if none does
+ */
+static short etag_list_matches(str_view value, const string *etag) {
+    if (value.len == 1 && value.str[0] == '*') {
+        return 1;
+    }
+    size_t i = 0;
+    while (i < value.len) {
+        while (i < value.len && (value.str[i] == ' ' || value.str[i] == '\t' || value.str[i] == ',')) {
+            i++;
+        }
+        if (i + 1 < value.len && value.str[i] == 'W' && value.str[i + 1] == '/') {
+            i += 2;
+        }
+        if (i >= value.len || value.str[i] != '"') {
+            return 0;
+        }
+        const char *close = memchr(value.str + i + 1, '"', value.len - i - 1);
+        if (close == NULL) {
+            return 0;
+        }
+        const size_t len = (size_t) (close - (value.str + i)) + 1;
+        if (len == etag->len && memcmp(value.str + i, etag->str, len) == 0) {
+            return 1;
+        }
+        i += len;
+    }
+    return 0;
+}
+
+/**
+ * Evaluates the conditional headers of a GET request (RFC 9110, 13.2.2). If-None-Match takes
+ * precedence, If-Modified-Since is only used without it.
+ * @param request parsed request
+ * @param etag entity tag of the file, see set_response_validators
+ * @param last_modified modification time of the file
+ * @return 1 if the client's copy is current and 304 Not Modified can be sent, 0 otherwise
+ */
+short request_not_modified(const http_request_view *request, const string *etag, time_t last_modified) {
+    if (request->if_none_match.len > 0) {
+        return etag_list_matches(request->if_none_match, etag);
+    }
+    time_t since;
+    if (request->if_modified_since.len > 0 && http_date_parse(request->if_modified_since, &since)) {
+        return last_modified <= since;
+    }
+    return 0;
+}
+
+/**
+ * Removes whitespace around a part of a header value
+ * @param str start of the part
+ * @param len length of the part
+ * @return the part without leading and trailing spaces and tabs
+ */
+static str_view view_trim(const char *str, size_t len) {
+    while (len > 0 && (str[0] == ' ' || str[0] == '\t')) {
+        str++;
+        len--;
+    }
+    while (len > 0 && (str[len - 1] == ' ' || str[len - 1] == '\t')) {
+        len--;
+    }
+    return (str_view) {str, len};
+}
+
+/**
+ * Adds a range to a list that is sorted by start, see http_parse_range
+ * @param ranges the list
+ * @param count number of ranges in the list, incremented
+ * @param range range to add
+ */
+static void range_insert(http_byte_range *ranges, size_t *count, http_byte_range range) {
+    size_t i = *count;
+    while (i > 0 && ranges[i - 1].start > range.start) {
+        ranges[i] = ranges[i - 1];
+        i--;
+    }
+    ranges[i] = range;
+    (*count)++;
+}
+
+/**
+ * Parses the ranges of a Range header, see http_parse_range
+ * @return the result; on HTTP_RANGE_NONE *count may be set to the ranges parsed so far
+ */
+static http_range_status parse_range_specs(str_view value, size_t size, http_byte_range *ranges, size_t *count) {
+    if (value.len < 6 || !view_equals_lower((str_view) {value.str, 6}, "bytes=", 6)) {
+        return HTTP_RANGE_NONE;
+    }
+    size_t specs = 0;
+    size_t pos = 6;
+    while (pos <= value.len) {
+        const char *comma = memchr(value.str + pos, ',', value.len - pos);
+        const size_t end = comma != NULL ? (size_t) (comma - value.str) : value.len;
+        const str_view spec = view_trim(value.str + pos, end - pos);
+        pos = end + 1;
+        if (spec.len == 0) {
+            //empty list elements are allowed
+            continue;
+        }
+        if (++specs > HTTP_MAX_RANGES) {
+            return HTTP_RANGE_NONE;
+        }
+        const char *dash = memchr(spec.str, '-', spec.len);
+        if (dash == NULL) {
+            return HTTP_RANGE_NONE;
+        }
+        const str_view first_view = {spec.str, (size_t) (dash - spec.str)};
+        const str_view last_view = {dash + 1, spec.len - first_view.len - 1};
+        size_t first;
+        size_t last = SIZE_MAX;
+        if (first_view.len == 0) {
+            //suffix range "-500": the last 500 bytes
+            size_t suffix;
+            if (!parse_content_length(last_view, &suffix)) {
+                return HTTP_RANGE_NONE;
+            }
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            first = suffix < size ? size - suffix : 0;
+        } else {
+            if (!parse_content_length(first_view, &first)
+                || (last_view.len > 0 && (!parse_content_length(last_view, &last) || last < first))) {
+                return HTTP_RANGE_NONE;
+            }
+            if (first >= size) {
+                continue;
+            }
+        }
+        if (last >= size) {
+            last = size - 1;
+        }
+        range_insert(ranges, count, (http_byte_range) {first, last - first + 1});
+    }
+    if (specs == 0) {
+        return HTTP_RANGE_NONE;
+    }
+    if (*count == 0) {
+        return HTTP_RANGE_UNSATISFIABLE;
+    }
+    size_t merged = 0;
+    for (size_t i = 1; i < *count; ++i) {
+        http_byte_range *current = &ranges[merged];
+        if (ranges[i].start <= current->start + current->length) {
+            const size_t end = ranges[i].start + ranges[i].length;
+            if (end > current->start + current->length) {
+                current->length = end - current->start;
+            }
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    *count = merged + 1;
+    return HTTP_RANGE_SATISFIABLE;
+}
+
+/**
+ * Parses a Range header for a file (RFC 9110, 14.2), e.g. "bytes=0-499, -500, 1000-".
+ * Ranges that start behind the end of the file are dropped, ranges reaching over it are shortened.
+ * The result is sorted and overlapping or adjacent ranges are coalesced, so every byte is sent once.
+ * @param value the header value
+ * @param size size of the file
+ * @param ranges room for HTTP_MAX_RANGES ranges, set to the satisfiable ones
+ * @param count set to the number of ranges
+ * @return HTTP_RANGE_NONE if the header is invalid or has more than HTTP_MAX_RANGES ranges,
+ * HTTP_RANGE_UNSATISFIABLE if none of the ranges lies in the file
+ */
+http_range_status http_parse_range(str_view value, size_t size, http_byte_range *ranges, size_t *count) {
+    *count = 0;
+    const http_range_status status = parse_range_specs(value, size, ranges, count);
+    if (status == HTTP_RANGE_NONE) {
+        *count = 0;
+    }
+    return status;
+}
+
+/**
+ * Evaluates Range and If-Range of a GET request for a file. With If-Range the ranges are only
+ * sent if the client's copy is still current: the entity tag has to match exactly (strong
+ * comparison) or the date has to be the modification time.
+ * @param request parsed request
+ * @param etag entity tag of the file, see set_response_validators
+ * @param last_modified modification time of the file
+ * @param size size of the file
+ * @param ranges room for HTTP_MAX_RANGES ranges, see http_parse_range
+ * @param count set to the number of ranges
+ * @return see http_parse_range
+ */
+http_range_status request_ranges(const http_request_view *request, const string *etag, time_t last_modified,
+                                 size_t size, http_byte_range *ranges, size_t *count) {
+    *count = 0;
+    if (request->range.len == 0) {
+        return HTTP_RANGE_NONE;
+    }
+    const str_view if_range = request->if_range;
+    if (if_range.len > 0) {
+        time_t date;
+        if (if_range.str[0] == '"') {
+            if (if_range.len != etag->len || memcmp(if_range.str, etag->str, etag->len) != 0) {
+                return HTTP_RANGE_NONE;
+            }
+        } else if (!http_date_parse(if_range, &date) || date != last_modified) {
+            //weak entity tags never match
+            return HTTP_RANGE_NONE;
+        }
+    }
+    return http_parse_range(request->range, size, ranges, count);
+}
+
+/**
+ * Removes the last segment of a path that is being normalized if it is "." or ".."
+ * (RFC 3986, 5.2.4), ".." also removes the segment in front of it
+ * @param path the normalized path so far, starting with '/'
+ * @param end length of the normalized path
+ * @param segment offset of the last segment, path[segment - 1] is '/'
+ * @return the new length, path[result - 1] is '/' if a segment was removed;
+ * SIZE_MAX if ".." leads above the root
+ */
+static size_t remove_dot_segment(const char *path, size_t end, size_t segment) {
+    const size_t len = end - segment;
+    if (len == 1 && path[segment] == '.') {
+        return segment;
+    }
+    if (len != 2 || path[segment] != '.' || path[segment + 1] != '.') {
+        return end;
+    }
+    if (segment == 1) {
+        return SIZE_MAX;
+    }
+    size_t parent = segment - 1;
+    while (path[parent - 1] != '/') {
+        parent--;
+    }
+    return parent;
+}
+
+/**
+ * Decodes and normalizes the path of a request URI in place, without allocating: %XX escapes are
+ * decoded, "." and ".." segments removed and a query ("?...") is cut off. Runs without any special
+ * character are found with the SIMD scanner and moved at once. Escaped characters count like
+ * literal ones, so "%2e%2e%2f" is a ".." segment as well. Paths leading above the root are
+ * rejected here, before the file system is asked.
+ * @param path the path, starts with '/', is overwritten with the result (never longer)
+ * @param len length of the path, set to the length of the result
+ * @return HTTP_PATH_OK, HTTP_PATH_INVALID for malformed escapes, NUL bytes or a missing leading
+ * '/', HTTP_PATH_OUTSIDE_ROOT if ".." leaves the root
+ */
+http_path_status http_normalize_path(char *path, size_t *len) {
+    static const char special[4] = {'%', '/', '?', '\0'};
+    const size_t n = *len;
+    if (n == 0 || path[0] != '/') {
+        return HTTP_PATH_INVALID;
+    }
+    size_t r = 1;
+    size_t w = 1;
+    size_t segment = 1;
+    while (r < n) {
+        //escapes often follow each other directly, then there is no run to search for
+        const char next = path[r];
+        const size_t run = next == '%' || next == '/' ? 0 : scan_find_any(path + r, n - r, special);
+        if (w != r) {
+            memmove(path + w, path + r, run);
+        }
+        r += run;
+        w += run;
+        if (r == n || path[r] == '?') {
+            break;
+        }
+        char c = path[r];
+        if (c == '\0') {
+            return HTTP_PATH_INVALID;
+        }
+        if (c == '%') {
+            if (n - r < 3) {
+                return HTTP_PATH_INVALID;
+            }
+            const int hi = hex2int(path[r + 1]);
+            const int lo = hex2int(path[r + 2]);
+            if (hi < 0 || lo < 0 || (hi == 0 && lo == 0)) {
+                return HTTP_PATH_INVALID;
+            }
+            c = (char) (hi << 4 | lo);
+            r += 3;
+            if (c != '/') {
+                path[w++] = c;
+                continue;
+            }
+        } else {
+            r++;
+        }
+        //end of a segment
+        const size_t end = w;
+        w = remove_dot_segment(path, end, segment);
+        if (w == SIZE_MAX) {
+            return HTTP_PATH_OUTSIDE_ROOT;
+        }
+        if (w == end) {
+            path[w++] = '/';
+        }
+        segment = w;
+    }
+    w = remove_dot_segment(path, w, segment);
+    if (w == SIZE_MAX) {
+        return HTTP_PATH_OUTSIDE_ROOT;
+    }
+    *len = w;
+    return HTTP_PATH_OK;
+}
+
 /**
  * Returns the given file's content as string struct
  * @param filepath path to file from document root (resources directory)
@@ -150,94 +864,233 @@ string *read_file_into_string(char *filepath, unsigned int len) {
     fseek(file, 0, SEEK_END);
     unsigned long file_size = (unsigned long) ftell(file) - 1;
     fseek(file, 0, SEEK_SET);
-    string *str = calloc(1, sizeof(string));
-    str->str = calloc(file_size, sizeof(char));
+    string *str = arena_calloc(1, sizeof(string));
+    str->str = arena_calloc(file_size, sizeof(char));
     fread(str->str, sizeof(char), file_size, file);
     str->len = file_size;
+    str->cap = file_size;
     fclose(file);
     free(c);
     str_free(doc_root);
     return str;
 }
 
+/**
+ * Writes the null terminated path DOC_ROOT + filepath into buffer, without allocating
+ * @param filepath path from document root
+ * @param len length of filepath
+ * @param buffer at least PATH_MAX bytes
+ * @return 1 on success, 0 if the path is too long
+ */
+static short doc_root_path(const char *filepath, size_t len, char *buffer) {
+    const size_t root_len = strlen(DOC_ROOT);
+    if (root_len + len >= PATH_MAX) {
+        return 0;
+    }
+    memcpy(buffer, DOC_ROOT, root_len);
+    memcpy(buffer + root_len, filepath, len);
+    buffer[root_len + len] = '\0';
+    return 1;
+}
+
 /**
  * Checks whether or not a file exists in document root (src/resources)
  * @param filepath path to file from document root (resources directory)
  * @return 1 if file is in document root, 2 if there is no file but you are in document root, else 0
  */
 short validate_file_access(char *filepath, unsigned int len) {
-    short i;
     //build absolute path to file
-    string *abs_path = str_cpy(DOC_ROOT, strlen(DOC_ROOT));
-    str_cat(abs_path, filepath, len);
-    char *c = get_nullterminated_char_str(abs_path);
+    char path[PATH_MAX];
+    if (!doc_root_path(filepath, len, path)) {
+        return 0;
+    }
 
-    //resolve path
-    char *resolved = calloc(PATH_MAX, sizeof(char));
-    realpath(c, resolved);
-    free(abs_path->str);
-    abs_path->str = resolved;
-    abs_path->len = strlen(resolved);
+    //resolve path, on failure realpath leaves the part resolved so far
+    char resolved[PATH_MAX];
+    resolved[0] = '\0';
+    realpath(path, resolved);
 
     //build document root absolute path
-    char *doc_root = realpath(DOC_ROOT, NULL);
-    if (str_start_with_chars(abs_path, doc_root, (unsigned int) strlen(doc_root)) == 1) {
-        char *file = realpath(abs_path->str, NULL);
-        if (file != NULL) {
-            //file exists in document root
-            free(file);
-            i = 1;
-        } else {
-            //file does not exist, but we are in document root (404)
-            i = 2;
-        }
-    } else {
+    char doc_root[PATH_MAX];
+    if (realpath(DOC_ROOT, doc_root) == NULL || strncmp(resolved, doc_root, strlen(doc_root)) != 0) {
         //left document root, access denied (403)
-        i = 0;
+        return 0;
     }
-    free(c);
-    free(doc_root);
-    str_free(abs_path);
-    return i;
+    char file[PATH_MAX];
+    if (realpath(resolved, file) != NULL) {
+        //file exists in document root
+        return 1;
+    }
+    //file does not exist, but we are in document root (404)
+    return 2;
 }
 
 /**
- * takes the http_response struct and puts the contents into a string.
+ * Opens a regular file in document root (src/resources) for reading
+ * @param filepath path to file from document root (resources directory)
+ * @param len length of the filepath in chars
+ * @param size is set to the file's size in bytes
+ * @return file descriptor, -1 if the file can't be opened or is no regular file (e.g. a directory)
+ */
+int open_file(char *filepath, unsigned int len, size_t *size) {
+    char path[PATH_MAX];
+    if (!doc_root_path(filepath, len, path)) {
+        return -1;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    *size = (size_t) st.st_size;
+    return fd;
+}
+
+/**
+ * Returns the length of the body announced in Content-Length
  * @param src the http_response struct
- * @return string with the contents of the src struct
+ * @return length of the body in memory or of the file
  */
-string *response_string(http_response *src) {
-    string *temp = str_cpy(src->protocol->str, src->protocol->len);
+static size_t response_body_length(http_response *src) {
+    if (src->body != NULL && src->body->str != NULL) {
+        return src->body->len;
+    }
+    if (src->file != NULL) {
+        return src->file->length;
+    }
+    return 0;
+}
+
+/**
+ * Appends a header line "name: value" to dest
+ * @param dest header block
+ * @param name header name including ": "
+ * @param name_len length of name
+ * @param value header value
+ */
+static void header_cat(string *dest, const char *name, size_t name_len, const string *value) {
+    str_cat(dest, name, name_len);
+    str_cat(dest, value->str, value->len);
+    str_append_new_line(dest);
+}
+
+/**
+ * Serializes status line and headers into one allocation that has room for extra more bytes.
+ * The size of the header block is computed beforehand, so nothing is reallocated.
+ * @param src the http_response struct
+ * @param extra bytes reserved behind the header block, e.g. for the body
+ * @return string with status line and headers of the src struct
+ */
+static string *response_header_build(http_response *src, size_t extra) {
+    const size_t body_len = response_body_length(src);
+    const bool has_location = src->location != NULL && src->location->str != NULL;
+    const bool has_allow = src->allow != NULL && src->allow->str != NULL;
+    const bool has_connection = src->connection != NULL && src->connection->str != NULL;
+    const bool has_content_type = src->entity_header->content_type != NULL
+                                  && src->entity_header->content_type->str != NULL;
+    const bool has_etag = src->entity_header->etag != NULL;
+    const bool has_last_modified = src->entity_header->last_modified != NULL;
+    const bool has_content_range = src->entity_header->content_range != NULL;
+    //a 304 describes the client's copy, it has no body and thus no Content-Length
+    const bool has_content_length = src->status_code->len != 3 || memcmp(src->status_code->str, "304", 3) != 0;
+
+    //status line and the empty line
+    size_t size = src->protocol->len + 1 + src->status_code->len + 1 + src->status_description->len + 2 + 2;
+    if (has_content_length) {
+        size += 16 + number_length(body_len) + 2;
+    }
+    if (has_location) {
+        size += 10 + src->location->len + 2;
+    }
+    if (has_allow) {
+        size += 7 + src->allow->len + 2;
+    }
+    if (has_connection) {
+        size += 12 + src->connection->len + 2;
+    }
+    if (has_content_type) {
+        size += 14 + src->entity_header->content_type->len + 2;
+    }
+    if (has_etag) {
+        size += 6 + src->entity_header->etag->len + 2;
+    }
+    if (has_last_modified) {
+        size += 15 + src->entity_header->last_modified->len + 2;
+    }
+    if (src->accept_ranges) {
+        size += 22;
+    }
+    if (has_content_range) {
+        size += 15 + src->entity_header->content_range->len + 2;
+    }
+
+    string *temp = str_with_capacity(size + extra);
+    str_cat(temp, src->protocol->str, src->protocol->len);
     str_cat(temp, " ", 1);
     str_cat(temp, src->status_code->str, src->status_code->len);
     str_cat(temp, " ", 1);
     str_cat(temp, src->status_description->str, src->status_description->len);
     str_append_new_line(temp);
-
-    if (src->location != NULL && src->location->str != NULL) {
-        str_cat(temp, "Location: ", 10);
-        str_cat(temp, src->location->str, src->location->len);
-        str_append_new_line(temp);
+    if (has_location) {
+        header_cat(temp, "Location: ", 10, src->location);
     }
-    if (src->entity_header->content_type != NULL && src->entity_header->content_type->str != NULL) {
-        str_cat(temp, "Content-Type: ", 14);
-        str_cat(temp, src->entity_header->content_type->str, src->entity_header->content_type->len);
-        str_append_new_line(temp);
+    if (has_allow) {
+        header_cat(temp, "Allow: ", 7, src->allow);
     }
-    if (src->body != NULL && src->body->str != NULL) {
+    if (has_connection) {
+        header_cat(temp, "Connection: ", 12, src->connection);
+    }
+    if (has_content_type) {
+        header_cat(temp, "Content-Type: ", 14, src->entity_header->content_type);
+    }
+    if (has_etag) {
+        header_cat(temp, "ETag: ", 6, src->entity_header->etag);
+    }
+    if (has_last_modified) {
+        header_cat(temp, "Last-Modified: ", 15, src->entity_header->last_modified);
+    }
+    if (src->accept_ranges) {
+        str_cat(temp, "Accept-Ranges: bytes\r\n", 22);
+    }
+    if (has_content_range) {
+        header_cat(temp, "Content-Range: ", 15, src->entity_header->content_range);
+    }
+    if (has_content_length) {
         str_cat(temp, "Content-Length: ", 16);
-        string *body_len_str = number_to_str(src->body->len);
-        str_cat(temp, body_len_str->str, body_len_str->len);
-        str_free(body_len_str);
+        str_cat_number(temp, body_len);
         str_append_new_line(temp);
+    }
+    //the empty line terminates the header block
+    str_append_new_line(temp);
+    return temp;
+}
 
-        //Set body
-        str_append_new_line(temp);
-        str_cat(temp, src->body->str, src->body->len);
-    } else {
-        str_cat(temp, "Content-Length: ", 16);
-        str_cat(temp, "0", 1);
-        str_append_new_line(temp);
+/**
+ * takes the http_response struct and puts status line and headers into a string,
+ * terminated by the empty line. The body is left out, so it can be sent from its own buffer
+ * or directly from a file.
+ * @param src the http_response struct
+ * @return string with status line and headers of the src struct
+ */
+string *response_header_string(http_response *src) {
+    return response_header_build(src, 0);
+}
+
+/**
+ * takes the http_response struct and puts the contents into a string.
+ * A file body (see set_response_file) is not included, it has to be sent separately.
+ * @param src the http_response struct
+ * @return string with the contents of the src struct
+ */
+string *response_string(http_response *src) {
+    const size_t body_len = src->body != NULL && src->body->str != NULL ? src->body->len : 0;
+    string *temp = response_header_build(src, body_len);
+    if (body_len > 0) {
+        str_cat(temp, src->body->str, body_len);
     }
     return temp;
 }
@@ -260,58 +1113,246 @@ void set_response_status(http_response *response, string *status_code, string *s
  * Content-Lengt is set as the body lengt
  * @param response Response-struct to be set
  * @param body HTTP body
- * @param content_type Body content-type
+ * @param content_type Body content-type, borrowed (e.g. from get_content_type)
  */
-void set_response_body(http_response *response, string *body, string *content_type){
+void set_response_body(http_response *response, string *body, const string *content_type){
     response->body = body;
     response->entity_header->content_length = body->len;
     response->entity_header->content_type = content_type;
 }
 
+/**
+ * Sets a file as body and the Content-Type in the given struct. The file is not read into
+ * memory, its content is sent directly from the file descriptor (sendfile).
+ * The response takes ownership of fd, it is closed by free_response.
+ * @param response Response-struct to be set
+ * @param fd opened file, see open_file
+ * @param length number of bytes to send, starting at the beginning of the file
+ * @param content_type Body content-type, borrowed (e.g. from get_content_type)
+ */
+void set_response_file(http_response *response, int fd, size_t length, const string *content_type) {
+    response->file = arena_calloc(1, sizeof(http_file));
+    if (response->file == NULL) {
+        exit(2);
+    }
+    response->file->fd = fd;
+    response->file->offset = 0;
+    response->file->length = length;
+    response->entity_header->content_length = length;
+    response->entity_header->content_type = content_type;
+}
+
+/**
+ * Sets ETag and Last-Modified for a file. The strong entity tag is built from inode, size and
+ * modification time, so it changes whenever the file is replaced or written to.
+ * @param response Response-struct to be set
+ * @param st stat() data of the file
+ */
+void set_response_validators(http_response *response, const struct stat *st) {
+    char etag[64];
+    const int etag_len = snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx%08lx\"", (unsigned long) st->st_ino,
+                                  (unsigned long) st->st_size, (unsigned long) st->st_mtim.tv_sec,
+                                  (unsigned long) st->st_mtim.tv_nsec);
+    response->entity_header->etag = str_cpy(etag, (size_t) etag_len);
+
+    struct tm tm;
+    gmtime_r(&st->st_mtim.tv_sec, &tm);
+    char date[32];
+    const int date_len = snprintf(date, sizeof(date), "%s, %02d %s %04d %02d:%02d:%02d GMT", day_names[tm.tm_wday],
+                                  tm.tm_mday, month_names[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min,
+                                  tm.tm_sec);
+    response->entity_header->last_modified = str_cpy(date, (size_t) date_len);
+}
+
+/**
+ * Turns a response with validators (see set_response_validators) into 304 Not Modified.
+ * Only the ETag is kept, the client already has everything else. The response must not
+ * have a body yet.
+ * @param response Response-struct to be set
+ */
+void set_response_not_modified(http_response *response) {
+    set_response_status(response, char_to_string("304"), char_to_string("Not Modified"));
+    response->entity_header->content_type = NULL;
+    response->entity_header->content_length = 0;
+    if (response->entity_header->last_modified != NULL) {
+        str_free(response->entity_header->last_modified);
+        response->entity_header->last_modified = NULL;
+    }
+}
+
+/**
+ * Appends "bytes first-last/size" to dest
+ * @param dest the header value or multipart body
+ * @param range the range
+ * @param size size of the file
+ */
+static void content_range_cat(string *dest, http_byte_range range, size_t size) {
+    str_cat(dest, "bytes ", 6);
+    str_cat_number(dest, range.start);
+    str_cat(dest, "-", 1);
+    str_cat_number(dest, range.start + range.length - 1);
+    str_cat(dest, "/", 1);
+    str_cat_number(dest, size);
+}
+
+/**
+ * Returns the length of "bytes first-last/size"
+ * @param range the range
+ * @param size size of the file
+ * @return number of characters
+ */
+static size_t content_range_length(http_byte_range range, size_t size) {
+    return 6 + number_length(range.start) + 1 + number_length(range.start + range.length - 1) + 1
+           + number_length(size);
+}
+
+/**
+ * Turns a response for a whole file into 206 Partial Content for a single range. A file
+ * (set_response_file) is sent from the start of the range, a body is sent from a part of it,
+ * so the body has to be borrowed (see http_response.release).
+ * @param response Response-struct with the whole file
+ * @param range the range, see request_ranges
+ * @param size size of the file
+ */
+void set_response_partial(http_response *response, http_byte_range range, size_t size) {
+    set_response_status(response, char_to_string("206"), char_to_string("Partial Content"));
+    if (response->file != NULL) {
+        response->file->offset = (off_t) range.start;
+        response->file->length = range.length;
+    } else {
+        response->body_part = (string) {range.length, response->body->str + range.start, 0};
+        response->body = &response->body_part;
+    }
+    response->entity_header->content_length = range.length;
+    string *content_range = str_with_capacity(content_range_length(range, size));
+    content_range_cat(content_range, range, size);
+    response->entity_header->content_range = content_range;
+}
+
+/**
+ * Sets 206 Partial Content with a multipart/byteranges body for several ranges (RFC 9110, 14.6).
+ * Every part has the Content-Type of the response and its own Content-Range. The parts are
+ * copied into the body, from *data* or read from *fd*.
+ * @param response Response-struct, its Content-Type is the one of the file
+ * @param ranges the ranges, see request_ranges
+ * @param count number of ranges
+ * @param size size of the file
+ * @param data the file in memory, NULL to read from fd
+ * @param fd the opened file if data is NULL, it stays open
+ * @return 1 on success, 0 if the body would be larger than HTTP_MAX_MULTIPART_BYTES or the file
+ * can't be read (the response is not changed)
+ */
+short set_response_multipart(http_response *response, const http_byte_range *ranges, size_t count, size_t size,
+                             const char *data, int fd) {
+    const string *type = response->entity_header->content_type;
+    const size_t delimiter = sizeof("\r\n--" BYTERANGES_BOUNDARY "\r\nContent-Type: ") - 1;
+    const size_t close_delimiter = sizeof("\r\n--" BYTERANGES_BOUNDARY "--\r\n") - 1;
+    size_t length = close_delimiter;
+    for (size_t i = 0; i < count; ++i) {
+        length += delimiter + type->len + 2 + 15 + content_range_length(ranges[i], size) + 4 + ranges[i].length;
+    }
+    if (length > HTTP_MAX_MULTIPART_BYTES) {
+        return 0;
+    }
+    string *body = str_with_capacity(length);
+    for (size_t i = 0; i < count; ++i) {
+        str_cat(body, "\r\n--" BYTERANGES_BOUNDARY "\r\nContent-Type: ", delimiter);
+        str_cat(body, type->str, type->len);
+        str_cat(body, "\r\nContent-Range: ", 17);
+        content_range_cat(body, ranges[i], size);
+        str_cat(body, "\r\n\r\n", 4);
+        if (data != NULL) {
+            str_cat(body, data + ranges[i].start, ranges[i].length);
+            continue;
+        }
+        size_t read_total = 0;
+        while (read_total < ranges[i].length) {
+            const ssize_t read_length = pread(fd, body->str + body->len, ranges[i].length - read_total,
+                                              (off_t) (ranges[i].start + read_total));
+            if (read_length <= 0) {
+                str_free(body);
+                return 0;
+            }
+            body->len += (size_t) read_length;
+            read_total += (size_t) read_length;
+        }
+    }
+    str_cat(body, "\r\n--" BYTERANGES_BOUNDARY "--\r\n", close_delimiter);
+    set_response_status(response, char_to_string("206"), char_to_string("Partial Content"));
+    set_response_body(response, body, &multipart_byteranges);
+    return 1;
+}
+
+/**
+ * Sets 416 Range Not Satisfiable with the size of the file in Content-Range and no body
+ * @param response Response-struct to be set, without body
+ * @param size size of the file
+ */
+void set_response_unsatisfiable(http_response *response, size_t size) {
+    set_response_status(response, char_to_string("416"), char_to_string("Range Not Satisfiable"));
+    response->entity_header->content_type = NULL;
+    response->entity_header->content_length = 0;
+    string *content_range = str_with_capacity(8 + number_length(size));
+    str_cat(content_range, "bytes */", 8);
+    str_cat_number(content_range, size);
+    response->entity_header->content_range = content_range;
+}
+
 /**
  * Sets basic HTML body with status-code and status-code-description of the struct
  * status-code and description must be set, in the given struct
  * @param response
  */
 void set_response_default_html_body(http_response *response) {
-    string *body = char_to_string("<!DOCTYPE html><html lang=\"de\"><body><h1>");
+    const char *head = "<!DOCTYPE html><html lang=\"de\"><body><h1>";
+    const char *tail = "</h1></body></html>";
+    string *body = str_with_capacity(strlen(head) + response->status_code->len + 1
+                                     + response->status_description->len + strlen(tail));
+    str_cat(body, head, strlen(head));
     str_cat(body, response->status_code->str, response->status_code->len);
     str_cat(body, " ", 1);
     str_cat(body, response->status_description->str, response->status_description->len);
-    str_cat(body, "</h1></body></html>", strlen("</h1></body></html>"));
-    set_response_body(response, body, char_to_string("text/html"));
+    str_cat(body, tail, strlen(tail));
+    set_response_body(response, body, get_content_type("html", 4));
 }
 
 /**
- * Returns the content_type of a file by the given file-ending
- * @param ending file-ending z.B. png
- * @return HTTP content-type as string, must be freed
+ * Looks up the content type of a file ending in the table generated by tools/gen_mime_table.py.
+ * Every known ending has its own slot, so a single comparison decides. Endings are compared
+ * exactly, ignoring case, so "jsonp" does not match "json".
+ * @param ending file ending without the dot, e.g. png
+ * @param len length of the ending
+ * @return static content type, never freed; application/octet-stream for unknown endings
  */
-string *get_content_type(string *ending) {
-    string *content_type = str_new();
-    if (ending != NULL){
-        str_to_lower_case(ending);
-        if (str_start_with_chars(ending, "png", 3) ||
-            str_start_with_chars(ending, "jpg", 3) ||
-            str_start_with_chars(ending, "gif", 3) ||
-            str_start_with_chars(ending, "jpeg", 4)) {
-            str_cat(content_type, "image/", strlen("image/"));
-            str_cat(content_type, ending->str, ending->len);
-            }
-        else if (str_start_with_chars(ending, "pdf", 3) ||
-            str_start_with_chars(ending, "js", 2)) {
-            str_cat(content_type, "application/", strlen("application/"));
-            str_cat(content_type, ending->str, ending->len);
-            }
-        else if (str_start_with_chars(ending, "html", 4)){
-            str_cat(content_type, "text/", strlen("text/"));
-            str_cat(content_type, ending->str, ending->len);
+const string *get_content_type(const char *ending, size_t len) {
+    if (len == 0 || len > MIME_MAX_EXTENSION) {
+        return &octet_stream;
+    }
+    char lower[MIME_MAX_EXTENSION];
+    uint32_t hash = MIME_HASH_SEED;
+    for (size_t i = 0; i < len; ++i) {
+        lower[i] = ending[i] >= 'A' && ending[i] <= 'Z' ? (char) (ending[i] - 'A' + 'a') : ending[i];
+        hash = (hash ^ (unsigned char) lower[i]) * 16777619u;
+    }
+    const mime_type *entry = &mime_table[hash >> (32 - MIME_TABLE_BITS)];
+    if (entry->extension_len != len || memcmp(entry->extension, lower, len) != 0) {
+        return &octet_stream;
+    }
+    return &entry->type;
+}
 
-        }
-        str_free(ending);
+/**
+ * Returns the content_type of a file by the ending of its path
+ * @param path path to file, e.g. /images/tux.png
+ * @return static content type, never freed, see get_content_type
+ */
+const string *content_type_for_path(const string *path) {
+    size_t dot = path->len;
+    while (dot > 0 && path->str[dot - 1] != '.' && path->str[dot - 1] != '/') {
+        dot--;
     }
-    else{
-        str_cat(content_type, "application/octet-stream/", strlen("application/octet-stream/"));
+    if (dot == 0 || path->str[dot - 1] != '.') {
+        return &octet_stream;
     }
-    return content_type;
-}
\ No newline at end of file
+    return get_content_type(path->str + dot, path->len - dot);
+}
@@ -1,15 +1,28 @@
 #ifndef ECHO_SERVER_HTTPLIB_H
 #define ECHO_SERVER_HTTPLIB_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
 #include "stringstructlib.h"
 
+#define DOC_ROOT "../resources/"
+
 typedef struct request_header {
     string *user_agent;
 } request_header;
 
 typedef struct entity_header {
-    string *content_type;
+    //static, not freed with the header (see get_content_type)
+    const string *content_type;
     size_t content_length;
+    //validators of a file, see set_response_validators
+    string *etag;
+    string *last_modified;
+    //e.g. "bytes 0-499/1234" for 206 and 416 responses
+    string *content_range;
 } entity_header;
 
 typedef struct http_request {
@@ -17,17 +30,131 @@ typedef struct http_request {
     string *uri;
     string *protocol;
     string *host;
+    string *connection;
     request_header *header;
     string *body;
 } http_request;
 
+//A part of a buffer, e.g. the receive buffer of a connection. Neither owned nor null terminated.
+typedef struct str_view {
+    const char *str;
+    size_t len;
+} str_view;
+
+#define HTTP_MAX_HEADERS 64
+//Range headers with more ranges are ignored and the whole file is sent
+#define HTTP_MAX_RANGES 16
+//multipart/byteranges bodies are built in memory, for larger ones the whole file is sent
+#define HTTP_MAX_MULTIPART_BYTES (1024*1024)
+
+typedef struct http_header_field {
+    str_view name;
+    str_view value;
+} http_header_field;
+
+/**
+ * A request as parsed by http_parse_request. All fields point into the receive buffer.
+ */
+typedef struct http_request_view {
+    str_view method;
+    str_view uri;
+    str_view protocol;
+    //headers used by the server, empty if missing
+    str_view host;
+    str_view connection;
+    str_view user_agent;
+    //conditional GET, see request_not_modified
+    str_view if_none_match;
+    str_view if_modified_since;
+    //partial GET, see request_ranges
+    str_view range;
+    str_view if_range;
+    size_t content_length;
+    //framing headers seen, a request with Transfer-Encoding is rejected, see http_parse_request
+    bool has_content_length;
+    bool transfer_encoding;
+    str_view body;
+    //length of the whole request including the body
+    size_t length;
+    size_t header_count;
+    //must stay the last member, see http_parse_request
+    http_header_field headers[HTTP_MAX_HEADERS];
+} http_request_view;
+
+typedef enum http_parse_status {
+    HTTP_PARSE_COMPLETE,
+    HTTP_PARSE_INCOMPLETE,
+    HTTP_PARSE_INVALID,
+    HTTP_PARSE_HEADER_TOO_LARGE,
+    HTTP_PARSE_BODY_TOO_LARGE,
+    //a body framed by Transfer-Encoding, which the server doesn't read
+    HTTP_PARSE_NOT_IMPLEMENTED
+} http_parse_status;
+
+typedef enum http_path_status {
+    HTTP_PATH_OK,
+    //malformed escape, NUL byte or not starting with '/'
+    HTTP_PATH_INVALID,
+    //".." segments lead above the document root
+    HTTP_PATH_OUTSIDE_ROOT
+} http_path_status;
+
+//A satisfiable byte range of a file
+typedef struct http_byte_range {
+    size_t start;
+    size_t length;
+} http_byte_range;
+
+typedef enum http_range_status {
+    //no Range header or it is ignored (invalid, too many ranges, If-Range does not match): send the whole file
+    HTTP_RANGE_NONE,
+    HTTP_RANGE_SATISFIABLE,
+    //none of the ranges lies in the file (416)
+    HTTP_RANGE_UNSATISFIABLE
+} http_range_status;
+
+//State of http_parse_request between calls for a partially received request
+typedef struct http_parser {
+    //bytes already searched for the end of the header block
+    size_t scanned;
+    //length of the complete header block while waiting for the body, otherwise 0
+    size_t header_length;
+    size_t content_length;
+    //limits for request line plus headers and for the body in bytes, 0 for no limit
+    size_t max_header;
+    size_t max_body;
+} http_parser;
+
+typedef struct http_file {
+    int fd;
+    off_t offset;
+    size_t length;
+} http_file;
+
 typedef struct http_response {
     string *protocol;
     string *status_code;
     string *status_description;
     entity_header *entity_header;
     string *location;
+    //methods of the resource, sent with 405
+    string *allow;
+    string *connection;
+    //sends "Accept-Ranges: bytes", set for files
+    bool accept_ranges;
     string *body;
+    http_file *file;
+    //a single range of a borrowed body, body points here (see set_response_partial)
+    string body_part;
+    //already serialized header block (e.g. from the file cache) or a complete response without body
+    //(see response_prepared), used instead of the fields above
+    const string *prepared_header;
+    //if set, body and prepared_header are borrowed from owner and handed back by free_response
+    void (*release)(void *owner);
+    void *owner;
+    //LSN of the write-ahead log record of the change this response acknowledges, the response
+    //is held back until the record is durable; 0 if nothing was changed
+    uint64_t durable_lsn;
 } http_response;
 
 void free_request_header(request_header *header);
@@ -38,22 +165,58 @@ void free_request(http_request *request);
 
 void free_response(http_response *response);
 
+http_response *response_new(void);
+
+http_response *response_prepared(const string *serialized);
+
 int hex2int(char c);
 
 http_request *str_to_http_request(string *str);
 
+http_parse_status http_parse_request(http_parser *parser, const char *buf, size_t len, http_request_view *request);
+
+short request_keep_alive(const http_request_view *request);
+
+short request_not_modified(const http_request_view *request, const string *etag, time_t last_modified);
+
+http_range_status http_parse_range(str_view value, size_t size, http_byte_range *ranges, size_t *count);
+
+http_range_status request_ranges(const http_request_view *request, const string *etag, time_t last_modified,
+                                 size_t size, http_byte_range *ranges, size_t *count);
+
+http_path_status http_normalize_path(char *path, size_t *len);
+
 string *read_file_into_string(char *filepath, unsigned int len);
 
 short validate_file_access(char *filepath, unsigned int len);
 
+int open_file(char *filepath, unsigned int len, size_t *size);
+
 string *response_string(http_response *response);
 
+string *response_header_string(http_response *response);
+
 void set_response_status(http_response *response, string *status_code, string *status_description);
 
-void set_response_body(http_response *response, string *body, string *content_type);
+void set_response_body(http_response *response, string *body, const string *content_type);
+
+void set_response_file(http_response *response, int fd, size_t length, const string *content_type);
+
+void set_response_validators(http_response *response, const struct stat *st);
+
+void set_response_not_modified(http_response *response);
+
+void set_response_partial(http_response *response, http_byte_range range, size_t size);
+
+short set_response_multipart(http_response *response, const http_byte_range *ranges, size_t count, size_t size,
+                             const char *data, int fd);
+
+void set_response_unsatisfiable(http_response *response, size_t size);
 
 void set_response_default_html_body(http_response *response);
 
-string *get_content_type(string *ending);
+const string *get_content_type(const char *ending, size_t len);
+
+const string *content_type_for_path(const string *path);
 
 #endif //ECHO_SERVER_HTTPLIB_H
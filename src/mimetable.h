@@ -0,0 +1,46 @@
+//Generated by tools/gen_mime_table.py, do not edit.
+#ifndef MIMETABLE_H
+#define MIMETABLE_H
+
+#define MIME_TABLE_BITS 7
+#define MIME_HASH_SEED 0x0000005cu
+#define MIME_MAX_EXTENSION 11
+
+static const mime_type mime_table[1 << MIME_TABLE_BITS] = {
+        [0] = {"wasm", 4, {16, "application/wasm", 0}},
+        [4] = {"avif", 4, {10, "image/avif", 0}},
+        [12] = {"otf", 3, {8, "font/otf", 0}},
+        [13] = {"mp3", 3, {10, "audio/mpeg", 0}},
+        [14] = {"pdf", 3, {15, "application/pdf", 0}},
+        [15] = {"mp4", 3, {9, "video/mp4", 0}},
+        [17] = {"html", 4, {24, "text/html; charset=utf-8", 0}},
+        [20] = {"ogg", 3, {9, "audio/ogg", 0}},
+        [27] = {"webmanifest", 11, {25, "application/manifest+json", 0}},
+        [39] = {"png", 3, {9, "image/png", 0}},
+        [40] = {"css", 3, {23, "text/css; charset=utf-8", 0}},
+        [41] = {"csv", 3, {23, "text/csv; charset=utf-8", 0}},
+        [42] = {"map", 3, {16, "application/json", 0}},
+        [45] = {"mjs", 3, {30, "text/javascript; charset=utf-8", 0}},
+        [48] = {"jpeg", 4, {10, "image/jpeg", 0}},
+        [52] = {"ttf", 3, {8, "font/ttf", 0}},
+        [53] = {"md", 2, {28, "text/markdown; charset=utf-8", 0}},
+        [57] = {"js", 2, {30, "text/javascript; charset=utf-8", 0}},
+        [59] = {"txt", 3, {25, "text/plain; charset=utf-8", 0}},
+        [62] = {"gz", 2, {16, "application/gzip", 0}},
+        [64] = {"jpg", 3, {10, "image/jpeg", 0}},
+        [66] = {"svg", 3, {13, "image/svg+xml", 0}},
+        [78] = {"zip", 3, {15, "application/zip", 0}},
+        [80] = {"woff2", 5, {10, "font/woff2", 0}},
+        [85] = {"htm", 3, {24, "text/html; charset=utf-8", 0}},
+        [86] = {"webp", 4, {10, "image/webp", 0}},
+        [87] = {"gif", 3, {9, "image/gif", 0}},
+        [93] = {"webm", 4, {10, "video/webm", 0}},
+        [96] = {"wav", 3, {9, "audio/wav", 0}},
+        [109] = {"bmp", 3, {9, "image/bmp", 0}},
+        [113] = {"xml", 3, {15, "application/xml", 0}},
+        [117] = {"json", 4, {16, "application/json", 0}},
+        [119] = {"woff", 4, {9, "font/woff", 0}},
+        [124] = {"ico", 3, {12, "image/x-icon", 0}},
+};
+
+#endif //MIMETABLE_H
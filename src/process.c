@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "http_server.h"
+
+/**
+ * Die Responses, die ohne Datei auskommen: Fehler und die Weiterleitung auf das Frontend.
+ */
+typedef enum canned_status {
+    CANNED_REDIRECT,
+    CANNED_BAD_REQUEST,
+    CANNED_FORBIDDEN,
+    CANNED_NOT_FOUND,
+    CANNED_CONTENT_TOO_LARGE,
+    CANNED_URI_TOO_LONG,
+    CANNED_HEADER_TOO_LARGE,
+    CANNED_NOT_IMPLEMENTED,
+    CANNED_COUNT
+} canned_status;
+
+static const char *const canned_definitions[CANNED_COUNT][2] = {
+        [CANNED_REDIRECT] = {"308", "Permanent Redirect"},
+        [CANNED_BAD_REQUEST] = {"400", "Bad Request"},
+        [CANNED_FORBIDDEN] = {"403", "Forbidden"},
+        [CANNED_NOT_FOUND] = {"404", "Not Found"},
+        [CANNED_CONTENT_TOO_LARGE] = {"413", "Content Too Large"},
+        [CANNED_URI_TOO_LONG] = {"414", "URI too long"},
+        [CANNED_HEADER_TOO_LARGE] = {"431", "Request Header Fields Too Large"},
+        [CANNED_NOT_IMPLEMENTED] = {"501", "Not Implemented"},
+};
+
+//Die fertig serialisierten Responses, je mit "Connection: close" [0] und "Connection: keep-alive" [1].
+//Sie werden einmal beim Start erzeugt und danach nur noch gelesen, alle Worker teilen sie sich.
+static string *canned_responses[CANNED_COUNT][2];
+
+/**
+ * Serialisiert alle Responses aus canned_definitions. Muss einmal aufgerufen werden, bevor
+ * process() oder reject() Requests beantworten.
+ */
+void canned_responses_init(void) {
+    //Die Responses leben so lange wie das Programm, also nicht in der Arena eines Threads
+    arena *previous = arena_use(NULL);
+    for (int status = 0; status < CANNED_COUNT; ++status) {
+        for (int keep_alive = 0; keep_alive < 2; ++keep_alive) {
+            http_response *resp = response_new();
+            resp->connection = char_to_string(keep_alive ? "keep-alive" : "close");
+            const char *code = canned_definitions[status][0];
+            const char *description = canned_definitions[status][1];
+            set_response_status(resp, str_cpy(code, strlen(code)), str_cpy(description, strlen(description)));
+            if (status == CANNED_REDIRECT) {
+                resp->location = char_to_string(FRONTEND_LOCATION);
+            } else {
+                set_response_default_html_body(resp);
+            }
+            canned_responses[status][keep_alive] = response_string(resp);
+            free_response(resp);
+        }
+    }
+    arena_use(previous);
+}
+
+/**
+ * Gibt eine der vorbereiteten Responses zurück, ohne etwas zu bauen oder zu kopieren.
+ * @param status Die Response.
+ * @param keep_alive Ob die Verbindung offen bleibt, wählt den Connection-Header.
+ * @return Die Response, muss mit free_response freigegeben werden.
+ */
+static http_response *canned_response(canned_status status, bool keep_alive) {
+    return response_prepared(canned_responses[status][keep_alive]);
+}
+
+//Die Platzhalter von debug.html, in der Reihenfolge der Werte in debug_response().
+static const char *const debug_slots[] = {"method", "ressource", "version"};
+
+/**
+ * Öffnet die Vorlage der Seite unter DEBUG_PATH. Sie wird beim ersten Request geparst und neu
+ * geparst, wenn sich die Datei ändert.
+ * @return Die Vorlage, muss mit template_file_close geschlossen werden.
+ */
+template_file *debug_page_open(void) {
+    return template_file_open(DEBUG_TEMPLATE, debug_slots, sizeof(debug_slots) / sizeof(debug_slots[0]));
+}
+
+/**
+ * Beantwortet DEBUG_PATH mit der ausgefüllten Vorlage debug.html. Die Werte aus dem Request werden
+ * HTML-escaped eingesetzt.
+ * @param ctx Der Zustand des Workers mit der Vorlage.
+ * @param request Der Request, dessen Methode, URI und Protokoll angezeigt werden.
+ * @param resp Die Response mit Connection-Header.
+ * @return resp, oder NULL wenn die Vorlage fehlt (resp ist dann unverändert).
+ */
+static http_response *debug_response(process_context *ctx, const http_request_view *request, http_response *resp) {
+    const html_template *page = ctx->debug_page != NULL ? template_file_get(ctx->debug_page) : NULL;
+    if (page == NULL) {
+        return NULL;
+    }
+    const str_view values[] = {request->method, request->uri, request->protocol};
+    set_response_status(resp, char_to_string("200"), char_to_string("OK"));
+    set_response_body(resp, template_render(page, values), get_content_type("html", 4));
+    return resp;
+}
+
+/**
+ * Sendet eine Datei, die nicht im Cache liegt, ganz (200) oder die angefragten Bereiche daraus
+ * (206 bzw. 416). Ein einzelner Bereich wird wie die ganze Datei mit sendfile() gesendet.
+ * @param request Der Request mit Range und If-Range.
+ * @param resp Die Response mit Connection-Header und Validatoren (siehe set_response_validators).
+ * @param file Die geöffnete Datei, die Response übernimmt sie.
+ * @param st Die stat()-Daten der Datei.
+ * @param content_type Der Content-Type der Datei.
+ * @return resp
+ */
+static http_response *file_response(const http_request_view *request, http_response *resp, int file,
+                                    const struct stat *st, const string *content_type) {
+    const size_t size = (size_t) st->st_size;
+    resp->accept_ranges = true;
+    http_byte_range ranges[HTTP_MAX_RANGES];
+    size_t count;
+    switch (request_ranges(request, resp->entity_header->etag, st->st_mtim.tv_sec, size, ranges, &count)) {
+        case HTTP_RANGE_UNSATISFIABLE:
+            close(file);
+            set_response_unsatisfiable(resp, size);
+            return resp;
+        case HTTP_RANGE_SATISFIABLE:
+            if (count == 1) {
+                set_response_file(resp, file, size, content_type);
+                set_response_partial(resp, ranges[0], size);
+                return resp;
+            }
+            resp->entity_header->content_type = content_type;
+            if (set_response_multipart(resp, ranges, count, size, NULL, file)) {
+                close(file);
+                return resp;
+            }
+            //Zu groß für einen Body im Speicher, die ganze Datei wird gesendet
+            break;
+        default:
+            break;
+    }
+    set_response_status(resp, char_to_string("200"), char_to_string("OK"));
+    set_response_file(resp, file, size, content_type);
+    return resp;
+}
+
+/**
+ * Die Funktion akzeptiert den eingehenden Request und gibt eine entsprechende Response zurück.
+ * @param ctx Der Zustand des aufrufenden Workers, z.B. sein Datei-Cache.
+ * @param request Der eingehende Request, von http_parse_request zerlegt.
+ * @param keep_alive Ein- und Ausgabe: Beim Aufruf, ob der Server die Verbindung offen halten würde,
+ * nach dem Aufruf, ob sie tatsächlich offen bleibt. Die Response enthält den passenden Connection-Header.
+ * @return Die ausgehende Response, muss mit free_response freigegeben werden. Dateien werden nicht
+ * gelesen, sondern nur geöffnet (siehe set_response_file).
+ * Die Funktion ist reentrant: sie und die verwendeten httplib/stringstructlib-Funktionen arbeiten nur
+ * auf ihren Argumenten, dem Kontext des Workers und eigenen Allokationen, mehrere Worker dürfen sie
+ * gleichzeitig aufrufen.
+ */
+http_response *process(process_context *ctx, const http_request_view *request, bool *keep_alive) {
+    *keep_alive = *keep_alive && request_keep_alive(request);
+
+    //Die URI wird auf dem Stack dekodiert und normalisiert, escaped ist sie höchstens dreimal so lang
+    char path[3 * MAX_URI_LENGTH];
+    size_t path_len = request->uri.len;
+    http_path_status path_status = HTTP_PATH_INVALID;
+    if (path_len > 0 && path_len <= sizeof(path) && request->uri.str[0] == '/') {
+        memcpy(path, request->uri.str, path_len);
+        path_status = http_normalize_path(path, &path_len);
+    }
+    if (request->uri.len > sizeof(path) || (path_status == HTTP_PATH_OK && path_len > MAX_URI_LENGTH)) {
+        return canned_response(CANNED_URI_TOO_LONG, *keep_alive);
+    }
+    if (request->uri.len == 0 || request->uri.str[0] != '/') {
+        return canned_response(CANNED_NOT_IMPLEMENTED, *keep_alive);
+    }
+    if (path_status == HTTP_PATH_INVALID) {
+        return canned_response(CANNED_BAD_REQUEST, *keep_alive);
+    }
+    if (path_status == HTTP_PATH_OUTSIDE_ROOT) {
+        //Wie bei einer Datei außerhalb des doc-root, aber ohne das Dateisystem zu fragen
+        return canned_response(CANNED_FORBIDDEN, *keep_alive);
+    }
+    const size_t api_len = strlen(API_PATH);
+    if (path_len >= api_len && memcmp(path, API_PATH, api_len) == 0
+        && (path_len == api_len || path[api_len] == '/')) {
+        return api_process(ctx, request, path, path_len, *keep_alive);
+    }
+    if (request->method.len != 3 || memcmp(request->method.str, "GET", 3) != 0) {
+        //POST und alle anderen Methoden außerhalb der API
+        return canned_response(CANNED_NOT_IMPLEMENTED, *keep_alive);
+    }
+    if (path_len == 1) {
+        return canned_response(CANNED_REDIRECT, *keep_alive);
+    }
+
+    //Get File
+    string path_string = {path_len, path, 0};
+    string *uri = &path_string;
+    http_response *resp = response_new();
+    resp->connection = char_to_string(*keep_alive ? "keep-alive" : "close");
+    if (path_len == strlen(DEBUG_PATH) && memcmp(path, DEBUG_PATH, path_len) == 0) {
+        if (debug_response(ctx, request, resp) != NULL) {
+            return resp;
+        }
+        free_response(resp);
+        return canned_response(CANNED_NOT_FOUND, *keep_alive);
+    }
+    if (file_cache_respond(ctx->files, uri, request, *keep_alive, resp)) {
+        return resp;
+    }
+    int file;
+    struct stat st;
+    switch (doc_root_open_file(ctx->root, uri->str, uri->len, &file, &st)) {
+        case DOC_ROOT_FILE:
+            if (file_cache_store(ctx->files, uri, file, request, *keep_alive, resp)) {
+                return resp;
+            }
+            //Zu groß für den Cache, die Validatoren werden für jeden Request neu berechnet
+            set_response_validators(resp, &st);
+            if (request_not_modified(request, resp->entity_header->etag, st.st_mtim.tv_sec)) {
+                close(file);
+                set_response_not_modified(resp);
+                return resp;
+            }
+            return file_response(request, resp, file, &st, content_type_for_path(uri));
+        case DOC_ROOT_NOT_FOUND: //File not found or directory
+            free_response(resp);
+            return canned_response(CANNED_NOT_FOUND, *keep_alive);
+        default: //File not in doc-root
+            free_response(resp);
+            return canned_response(CANNED_FORBIDDEN, *keep_alive);
+    }
+}
+
+/**
+ * Erstellt die Response für einen Request, den http_parse_request nicht annimmt. Da danach
+ * nicht klar ist, wo der nächste Request beginnt, wird die Verbindung geschlossen.
+ * @param status Das Ergebnis von http_parse_request, nicht HTTP_PARSE_COMPLETE.
+ * @param keep_alive Wird auf false gesetzt.
+ * @return Die Response 400, 413, 431 oder 501, muss mit free_response freigegeben werden.
+ */
+http_response *reject(http_parse_status status, bool *keep_alive) {
+    *keep_alive = false;
+    switch (status) {
+        case HTTP_PARSE_HEADER_TOO_LARGE:
+            return canned_response(CANNED_HEADER_TOO_LARGE, false);
+        case HTTP_PARSE_BODY_TOO_LARGE:
+            return canned_response(CANNED_CONTENT_TOO_LARGE, false);
+        case HTTP_PARSE_NOT_IMPLEMENTED:
+            return canned_response(CANNED_NOT_IMPLEMENTED, false);
+        default:
+            return canned_response(CANNED_BAD_REQUEST, false);
+    }
+}
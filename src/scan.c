@@ -0,0 +1,369 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Every scanner returns offsets into buf, len stands for "not found".
+ * The SIMD versions compare 16 (SSE2) or 32 (AVX2) bytes at once and turn the result
+ * into a bit mask, the lowest set bit is the first match. The remaining bytes at the
+ * end of the buffer are handled by the next smaller version.
+ */
+
+/**
+ * Finds "\r\n\r\n", byte by byte
+ * @param buf bytes to search
+ * @param len number of bytes
+ * @return offset of the first "\r\n\r\n", len if there is none
+ */
+static size_t header_end_scalar(const char *buf, size_t len) {
+    for (size_t i = 0; i + 3 < len; ++i) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n') {
+            return i;
+        }
+    }
+    return len;
+}
+
+/**
+ * Finds the end of a line and the first separator in it, byte by byte
+ * @param buf bytes to search
+ * @param len number of bytes
+ * @param separator e.g. ':' for header lines or ' ' for the request line
+ * @param separator_pos set to the offset of the first separator before the newline, or to the
+ * return value if there is none
+ * @return offset of the first '\n', len if there is none
+ */
+static size_t line_scalar(const char *buf, size_t len, char separator, size_t *separator_pos) {
+    size_t found = len;
+    for (size_t i = 0; i < len; ++i) {
+        if (buf[i] == '\n') {
+            *separator_pos = found < i ? found : i;
+            return i;
+        }
+        if (buf[i] == separator && found == len) {
+            found = i;
+        }
+    }
+    *separator_pos = found;
+    return len;
+}
+
+/**
+ * Finds the first byte that is one of four given bytes, byte by byte
+ * @param buf bytes to search
+ * @param len number of bytes
+ * @param set the bytes to look for, repeat one to look for less than four
+ * @return offset of the first match, len if there is none
+ */
+static size_t any_scalar(const char *buf, size_t len, const char set[4]) {
+    for (size_t i = 0; i < len; ++i) {
+        if (buf[i] == set[0] || buf[i] == set[1] || buf[i] == set[2] || buf[i] == set[3]) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/**
+ * Combines bitmaps word by word: a bit of the result is set where it is clear in all bitmaps
+ * @param bitmaps the bitmaps, each with at least words words
+ * @param count number of bitmaps
+ * @param words number of words to combine
+ * @param out the result, words words
+ */
+static void bitmap_nor_scalar(const uint64_t *const *bitmaps, size_t count, size_t words, uint64_t *out) {
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t any = 0;
+        for (size_t b = 0; b < count; ++b) {
+            any |= bitmaps[b][i];
+        }
+        out[i] = ~any;
+    }
+}
+
+#ifdef SCAN_X86
+
+/*
+ * The SSE2 versions also handle the last 16-31 bytes for the AVX2 versions. They are inlined
+ * there, so the compiler emits VEX encoded instructions and the CPU does not pay for switching
+ * between AVX and legacy SSE state on every short header line.
+ */
+
+static inline __attribute__((always_inline)) size_t header_end_sse2(const char *buf, size_t len) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    //the pattern may start at any of the 16 positions, so 3 more bytes have to be readable
+    for (; i + 19 <= len; i += 16) {
+        __m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (buf + i)), cr);
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (buf + i + 1)), lf));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (buf + i + 2)), cr));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (buf + i + 3)), lf));
+        const unsigned int mask = (unsigned int) _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + header_end_scalar(buf + i, len - i);
+}
+
+static inline __attribute__((always_inline)) size_t line_sse2(const char *buf, size_t len, char separator,
+                                                              size_t *separator_pos) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i sep = _mm_set1_epi8(separator);
+    size_t found = len;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) (buf + i));
+        const unsigned int newlines = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(block, lf));
+        if (found == len) {
+            const unsigned int separators = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(block, sep));
+            if (separators != 0) {
+                found = i + (size_t) __builtin_ctz(separators);
+            }
+        }
+        if (newlines != 0) {
+            const size_t newline = i + (size_t) __builtin_ctz(newlines);
+            *separator_pos = found < newline ? found : newline;
+            return newline;
+        }
+    }
+    size_t tail_separator;
+    const size_t newline = i + line_scalar(buf + i, len - i, separator, &tail_separator);
+    *separator_pos = found < len ? found : i + tail_separator;
+    return newline;
+}
+
+static inline __attribute__((always_inline)) size_t any_sse2(const char *buf, size_t len, const char set[4]) {
+    const __m128i s0 = _mm_set1_epi8(set[0]);
+    const __m128i s1 = _mm_set1_epi8(set[1]);
+    const __m128i s2 = _mm_set1_epi8(set[2]);
+    const __m128i s3 = _mm_set1_epi8(set[3]);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *) (buf + i));
+        const __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, s0), _mm_cmpeq_epi8(block, s1)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(block, s2), _mm_cmpeq_epi8(block, s3)));
+        const unsigned int mask = (unsigned int) _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + any_scalar(buf + i, len - i, set);
+}
+
+static void bitmap_nor_sse2(const uint64_t *const *bitmaps, size_t count, size_t words, uint64_t *out) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 2 <= words; i += 2) {
+        __m128i any = _mm_setzero_si128();
+        for (size_t b = 0; b < count; ++b) {
+            any = _mm_or_si128(any, _mm_loadu_si128((const __m128i *) (bitmaps[b] + i)));
+        }
+        _mm_storeu_si128((__m128i *) (out + i), _mm_xor_si128(any, ones));
+    }
+    for (; i < words; ++i) {
+        uint64_t any = 0;
+        for (size_t b = 0; b < count; ++b) {
+            any |= bitmaps[b][i];
+        }
+        out[i] = ~any;
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t header_end_avx2(const char *buf, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 35 <= len; i += 32) {
+        __m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (buf + i)), cr);
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (buf + i + 1)), lf));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (buf + i + 2)), cr));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (buf + i + 3)), lf));
+        const unsigned int mask = (unsigned int) _mm256_movemask_epi8(m);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + header_end_sse2(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t line_avx2(const char *buf, size_t len, char separator, size_t *separator_pos) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i sep = _mm256_set1_epi8(separator);
+    size_t found = len;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (buf + i));
+        const unsigned int newlines = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, lf));
+        if (found == len) {
+            const unsigned int separators = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, sep));
+            if (separators != 0) {
+                found = i + (size_t) __builtin_ctz(separators);
+            }
+        }
+        if (newlines != 0) {
+            const size_t newline = i + (size_t) __builtin_ctz(newlines);
+            *separator_pos = found < newline ? found : newline;
+            return newline;
+        }
+    }
+    size_t tail_separator;
+    const size_t newline = i + line_sse2(buf + i, len - i, separator, &tail_separator);
+    *separator_pos = found < len ? found : i + tail_separator;
+    return newline;
+}
+
+__attribute__((target("avx2")))
+static size_t any_avx2(const char *buf, size_t len, const char set[4]) {
+    const __m256i s0 = _mm256_set1_epi8(set[0]);
+    const __m256i s1 = _mm256_set1_epi8(set[1]);
+    const __m256i s2 = _mm256_set1_epi8(set[2]);
+    const __m256i s3 = _mm256_set1_epi8(set[3]);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *) (buf + i));
+        const __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, s0), _mm256_cmpeq_epi8(block, s1)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, s2), _mm256_cmpeq_epi8(block, s3)));
+        const unsigned int mask = (unsigned int) _mm256_movemask_epi8(m);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + any_sse2(buf + i, len - i, set);
+}
+
+__attribute__((target("avx2")))
+static void bitmap_nor_avx2(const uint64_t *const *bitmaps, size_t count, size_t words, uint64_t *out) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i any = _mm256_setzero_si256();
+        for (size_t b = 0; b < count; ++b) {
+            any = _mm256_or_si256(any, _mm256_loadu_si256((const __m256i *) (bitmaps[b] + i)));
+        }
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_xor_si256(any, ones));
+    }
+    for (; i < words; ++i) {
+        uint64_t any = 0;
+        for (size_t b = 0; b < count; ++b) {
+            any |= bitmaps[b][i];
+        }
+        out[i] = ~any;
+    }
+}
+
+#endif //SCAN_X86
+
+typedef struct scan_functions {
+    size_t (*header_end)(const char *buf, size_t len);
+    size_t (*line)(const char *buf, size_t len, char separator, size_t *separator_pos);
+    size_t (*any)(const char *buf, size_t len, const char set[4]);
+    void (*bitmap_nor)(const uint64_t *const *bitmaps, size_t count, size_t words, uint64_t *out);
+    scan_level level;
+} scan_functions;
+
+static scan_functions active = {header_end_scalar, line_scalar, any_scalar, bitmap_nor_scalar, SCAN_SCALAR};
+
+/**
+ * Selects an implementation of the scanner. Not thread safe, only meant for the start of the
+ * program, tests and benchmarks.
+ * @param level the implementation
+ * @return true if the CPU supports it and it is used from now on
+ */
+bool scan_set_level(scan_level level) {
+    switch (level) {
+        case SCAN_SCALAR:
+            active = (scan_functions) {header_end_scalar, line_scalar, any_scalar, bitmap_nor_scalar, SCAN_SCALAR};
+            return true;
+#ifdef SCAN_X86
+        case SCAN_SSE2:
+            if (!__builtin_cpu_supports("sse2")) {
+                return false;
+            }
+            active = (scan_functions) {header_end_sse2, line_sse2, any_sse2, bitmap_nor_sse2, SCAN_SSE2};
+            return true;
+        case SCAN_AVX2:
+            if (!__builtin_cpu_supports("avx2")) {
+                return false;
+            }
+            active = (scan_functions) {header_end_avx2, line_avx2, any_avx2, bitmap_nor_avx2, SCAN_AVX2};
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * Returns the selected implementation
+ * @return the scan level in use
+ */
+scan_level scan_get_level(void) {
+    return active.level;
+}
+
+/**
+ * Selects the fastest implementation supported by the CPU (CPUID) before main() runs
+ */
+__attribute__((constructor))
+static void scan_init(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+#endif
+    if (!scan_set_level(SCAN_AVX2)) {
+        scan_set_level(SCAN_SSE2);
+    }
+}
+
+/**
+ * Finds the end of a header block
+ * @param buf bytes to search
+ * @param len number of bytes
+ * @return offset of the first "\r\n\r\n", len if there is none
+ */
+size_t scan_header_end(const char *buf, size_t len) {
+    return active.header_end(buf, len);
+}
+
+/**
+ * Finds the end of a line and the first separator in it in a single pass
+ * @param buf bytes to search, starting at the beginning of the line
+ * @param len number of bytes
+ * @param separator e.g. ':' for header lines or ' ' for the request line
+ * @param separator_pos set to the offset of the first separator before the newline, or to the
+ * return value if the line has none
+ * @return offset of the first '\n', len if the line is not complete
+ */
+size_t scan_line(const char *buf, size_t len, char separator, size_t *separator_pos) {
+    return active.line(buf, len, separator, separator_pos);
+}
+
+/**
+ * Finds the first occurrence of any of four bytes, e.g. the characters that end a plain run in a URI
+ * @param buf bytes to search
+ * @param len number of bytes
+ * @param set the bytes to look for, repeat one to look for less than four
+ * @return offset of the first match, len if there is none
+ */
+size_t scan_find_any(const char *buf, size_t len, const char set[4]) {
+    return active.any(buf, len, set);
+}
+
+/**
+ * Finds the slots that are free in all of several occupancy bitmaps: the complements of the
+ * bitmaps are ANDed, i.e. the bitmaps are ORed and the result inverted
+ * @param bitmaps the bitmaps, a set bit is occupied; each with at least words words
+ * @param count number of bitmaps, 0 sets all bits
+ * @param words number of 64-bit words to combine
+ * @param out the result, a set bit is free in every bitmap; may not overlap the bitmaps
+ */
+void scan_bitmap_nor(const uint64_t *const *bitmaps, size_t count, size_t words, uint64_t *out) {
+    active.bitmap_nor(bitmaps, count, words, out);
+}
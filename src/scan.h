@@ -0,0 +1,30 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Implementations of the scanner, from slowest to fastest. The fastest one the CPU
+ * supports is selected when the program starts.
+ */
+typedef enum scan_level {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} scan_level;
+
+size_t scan_header_end(const char *buf, size_t len);
+
+size_t scan_line(const char *buf, size_t len, char separator, size_t *separator_pos);
+
+size_t scan_find_any(const char *buf, size_t len, const char set[4]);
+
+void scan_bitmap_nor(const uint64_t *const *bitmaps, size_t count, size_t words, uint64_t *out);
+
+bool scan_set_level(scan_level level);
+
+scan_level scan_get_level(void);
+
+#endif //SCAN_H
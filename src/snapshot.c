@@ -0,0 +1,326 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "wal.h"
+
+//Snapshots are mapped as they were written, only little endian machines are supported.
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "snapshots are stored little endian");
+_Static_assert(sizeof(snapshot_header) <= SNAPSHOT_HEADER_SIZE, "snapshot header too large");
+_Static_assert(sizeof(snapshot_record) == 32, "snapshot records have a fixed size");
+
+//Alignment of the bitmaps, whole AVX2 registers.
+#define SNAPSHOT_BITMAP_ALIGN 64
+#define SNAPSHOT_INITIAL_NAMES 4096
+
+/**
+ * Computes the checksum of a header, taken with crc set to 0
+ */
+static uint32_t header_crc(const snapshot_header *header) {
+    snapshot_header copy = *header;
+    copy.crc = 0;
+    return wal_crc32c(&copy, sizeof(copy));
+}
+
+/**
+ * Tells whether count elements of size bytes starting at offset end at or before limit
+ */
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t limit) {
+    return offset <= limit && count <= (limit - offset) / size;
+}
+
+/**
+ * Checks that the header fits the file and its sections don't reach past it, so lookups in the
+ * mapping only have to check the indices they read from it
+ */
+static bool header_valid(const snapshot_header *header, size_t size, unsigned int resources) {
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION
+        || header->resources != resources || header->crc != header_crc(header) || header->file_size != size
+        || header->records_offset != SNAPSHOT_HEADER_SIZE || header->bitmaps_offset % SNAPSHOT_BITMAP_ALIGN != 0
+        || !section_fits(header->records_offset, header->record_count, sizeof(snapshot_record), header->ids_offset)
+        || !section_fits(header->ids_offset, header->last_id, sizeof(uint32_t), header->bitmaps_offset)
+        || header->slot_words > UINT64_MAX / resources
+        || !section_fits(header->bitmaps_offset, header->slot_words * resources, sizeof(uint64_t),
+                         header->names_offset)
+        || !section_fits(header->names_offset, header->names_size, 1, size)) {
+        return false;
+    }
+    if (header->resource_start[0] != 0 || header->resource_start[resources] != header->record_count) {
+        return false;
+    }
+    for (unsigned int i = 0; i < resources; ++i) {
+        if (header->resource_start[i] > header->resource_start[i + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Maps a snapshot file. Only the header is checked, so this takes the same time for any number
+ * of bookings.
+ * @param path path of the file
+ * @param resources number of resources the snapshot has to have, at most SNAPSHOT_MAX_RESOURCES
+ * @return the snapshot, must be closed with snapshot_close; NULL if the file can't be mapped or is
+ * no valid snapshot (EINVAL) (errno is set)
+ */
+snapshot *snapshot_open(const char *path, unsigned int resources) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        const int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    const size_t size = (size_t) st.st_size;
+    void *map = size >= SNAPSHOT_HEADER_SIZE ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    const int saved = size >= SNAPSHOT_HEADER_SIZE ? errno : EINVAL;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = saved;
+        return NULL;
+    }
+    const snapshot_header *header = map;
+    if (resources > SNAPSHOT_MAX_RESOURCES || !header_valid(header, size, resources)) {
+        munmap(map, size);
+        errno = EINVAL;
+        return NULL;
+    }
+    snapshot *snap = calloc(1, sizeof(snapshot));
+    if (snap == NULL) {
+        exit(2);
+    }
+    const char *bytes = map;
+    snap->map = map;
+    snap->size = size;
+    snap->header = header;
+    snap->records = (const snapshot_record *) (bytes + header->records_offset);
+    snap->ids = (const uint32_t *) (bytes + header->ids_offset);
+    snap->bitmaps = (const uint64_t *) (bytes + header->bitmaps_offset);
+    snap->names = bytes + header->names_offset;
+    return snap;
+}
+
+/**
+ * Unmaps a snapshot
+ * @param snap the snapshot, may be NULL
+ */
+void snapshot_close(snapshot *snap) {
+    if (snap == NULL) {
+        return;
+    }
+    munmap(snap->map, snap->size);
+    free(snap);
+}
+
+/**
+ * Starts collecting a snapshot. Nothing is written before snapshot_writer_commit, so a caller can
+ * add the bookings under its lock and write the file after releasing it.
+ * @param path path of the snapshot, it is written to path.tmp first
+ * @param resources number of resources, at most SNAPSHOT_MAX_RESOURCES
+ * @param lsn LSN of the write-ahead log the snapshot contains
+ * @param last_id the largest id ever assigned
+ * @param slot_words 64-bit words of each occupancy bitmap
+ * @param expected number of records that will be added, room for them is taken at once
+ * @return the writer, must be ended with snapshot_writer_commit or snapshot_writer_abort; NULL if
+ * resources or last_id are out of range (EINVAL)
+ */
+snapshot_writer *snapshot_writer_new(const char *path, unsigned int resources, uint64_t lsn, uint64_t last_id,
+                                     size_t slot_words, size_t expected) {
+    if (resources == 0 || resources > SNAPSHOT_MAX_RESOURCES || last_id > SIZE_MAX / sizeof(uint32_t)
+        || slot_words > SIZE_MAX / sizeof(uint64_t) / resources || expected > SIZE_MAX / sizeof(snapshot_record) / 2) {
+        errno = EINVAL;
+        return NULL;
+    }
+    snapshot_writer *writer = calloc(1, sizeof(snapshot_writer));
+    if (writer == NULL) {
+        exit(2);
+    }
+    writer->path = strdup(path);
+    writer->temp_path = malloc(strlen(path) + 5);
+    writer->records_cap = expected > 0 ? expected : 1;
+    writer->records = malloc(writer->records_cap * sizeof(snapshot_record));
+    //the pages of ids that are never set are not touched
+    writer->ids = calloc(last_id > 0 ? last_id : 1, sizeof(uint32_t));
+    writer->bitmaps = malloc(resources * slot_words * sizeof(uint64_t) + 1);
+    writer->names = malloc(SNAPSHOT_INITIAL_NAMES);
+    if (writer->path == NULL || writer->temp_path == NULL || writer->records == NULL || writer->ids == NULL
+        || writer->bitmaps == NULL || writer->names == NULL) {
+        exit(2);
+    }
+    strcpy(writer->temp_path, path);
+    strcat(writer->temp_path, ".tmp");
+    writer->names_cap = SNAPSHOT_INITIAL_NAMES;
+    memcpy(writer->header.magic, SNAPSHOT_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = SNAPSHOT_VERSION;
+    writer->header.resources = resources;
+    writer->header.lsn = lsn;
+    writer->header.last_id = last_id;
+    writer->header.slot_words = slot_words;
+    writer->header.records_offset = SNAPSHOT_HEADER_SIZE;
+    return writer;
+}
+
+/**
+ * Remembers the first error of a writer, later steps are skipped
+ */
+static void writer_fail(snapshot_writer *writer, int error) {
+    if (writer->error == 0) {
+        writer->error = error != 0 ? error : EIO;
+    }
+}
+
+/**
+ * Adds a booking. Bookings have to be added by resource, and by start within a resource.
+ * @param writer the writer
+ * @param resource index of the resource
+ * @param id id of the booking, at most the last_id of the writer
+ * @param start start of the booking
+ * @param end end of the booking
+ * @param name the name, not null terminated
+ * @param name_len length of the name, at most 255
+ */
+void snapshot_writer_add(snapshot_writer *writer, unsigned int resource, uint64_t id, int64_t start, int64_t end,
+                         const char *name, size_t name_len) {
+    snapshot_header *header = &writer->header;
+    if (writer->error != 0) {
+        return;
+    }
+    if (resource < writer->resource || resource >= header->resources || id == 0 || id > header->last_id
+        || name_len > UINT8_MAX || header->record_count >= UINT32_MAX
+        || header->names_size + name_len > UINT32_MAX) {
+        writer_fail(writer, EINVAL);
+        return;
+    }
+    while (writer->resource < resource) {
+        header->resource_start[++writer->resource] = header->record_count;
+    }
+    if (header->record_count == writer->records_cap) {
+        writer->records_cap *= 2;
+        snapshot_record *records = realloc(writer->records, writer->records_cap * sizeof(snapshot_record));
+        if (records == NULL) {
+            exit(2);
+        }
+        writer->records = records;
+    }
+    if (header->names_size + name_len > writer->names_cap) {
+        writer->names_cap *= 2;
+        char *names = realloc(writer->names, writer->names_cap);
+        if (names == NULL) {
+            exit(2);
+        }
+        writer->names = names;
+    }
+    snapshot_record record = {id, start, end, (uint32_t) header->names_size, (uint8_t) name_len, {0}};
+    writer->records[header->record_count] = record;
+    memcpy(writer->names + header->names_size, name, name_len);
+    header->names_size += name_len;
+    writer->ids[id - 1] = (uint32_t) ++header->record_count;
+}
+
+/**
+ * Takes a copy of the bitmaps and completes the header. Afterwards the writer no longer reads the
+ * data of the caller, so only adding and ending have to happen under the caller's lock.
+ * @param writer the writer
+ * @param bitmaps the occupancy bitmap of every resource, slot_words each
+ * @return true on success, false if a booking couldn't be added (errno is set); the writer has to
+ * be aborted then
+ */
+bool snapshot_writer_end(snapshot_writer *writer, const uint64_t *const *bitmaps) {
+    snapshot_header *header = &writer->header;
+    while (writer->error == 0 && writer->resource < header->resources) {
+        header->resource_start[++writer->resource] = header->record_count;
+    }
+    for (unsigned int i = 0; i < header->resources && writer->error == 0; ++i) {
+        memcpy(writer->bitmaps + i * header->slot_words, bitmaps[i], header->slot_words * sizeof(uint64_t));
+    }
+    header->ids_offset = header->records_offset + header->record_count * sizeof(snapshot_record);
+    const uint64_t ids_end = header->ids_offset + header->last_id * sizeof(uint32_t);
+    //the bitmaps start on whole AVX2 registers, zeros fill the gap
+    header->bitmaps_offset = (ids_end + SNAPSHOT_BITMAP_ALIGN - 1) / SNAPSHOT_BITMAP_ALIGN * SNAPSHOT_BITMAP_ALIGN;
+    header->names_offset = header->bitmaps_offset + header->resources * header->slot_words * sizeof(uint64_t);
+    header->file_size = header->names_offset + header->names_size;
+    header->crc = header_crc(header);
+    errno = writer->error;
+    return writer->error == 0;
+}
+
+/**
+ * Writes the sections of an ended writer in the order of the file
+ */
+static bool writer_write(const snapshot_writer *writer, FILE *file) {
+    static const char zeros[SNAPSHOT_BITMAP_ALIGN];
+    const snapshot_header *header = &writer->header;
+    const size_t padding = (size_t) (header->bitmaps_offset - header->ids_offset - header->last_id * sizeof(uint32_t));
+    const size_t bitmap_words = header->resources * header->slot_words;
+    return fwrite(header, sizeof(*header), 1, file) == 1 && fseek(file, SNAPSHOT_HEADER_SIZE, SEEK_SET) == 0
+           && fwrite(writer->records, sizeof(snapshot_record), header->record_count, file) == header->record_count
+           && fwrite(writer->ids, sizeof(uint32_t), header->last_id, file) == header->last_id
+           && fwrite(zeros, 1, padding, file) == padding
+           && fwrite(writer->bitmaps, sizeof(uint64_t), bitmap_words, file) == bitmap_words
+           && fwrite(writer->names, 1, header->names_size, file) == header->names_size;
+}
+
+/**
+ * Frees a writer and what it collected
+ */
+static void writer_free(snapshot_writer *writer) {
+    free(writer->path);
+    free(writer->temp_path);
+    free(writer->records);
+    free(writer->ids);
+    free(writer->bitmaps);
+    free(writer->names);
+    free(writer);
+}
+
+/**
+ * Writes the snapshot into the temporary file, syncs it and replaces the old one with it
+ * atomically: after a crash there is either the old or the new snapshot, never a partly written
+ * one. Frees the writer.
+ * @param writer an ended writer
+ * @return true on success, false on an error (errno is set), the old snapshot stays then
+ */
+bool snapshot_writer_commit(snapshot_writer *writer) {
+    FILE *file = NULL;
+    if (writer->error == 0) {
+        file = fopen(writer->temp_path, "wbe");
+        if (file == NULL || !writer_write(writer, file) || fflush(file) != 0 || fsync(fileno(file)) != 0) {
+            writer_fail(writer, errno);
+        }
+    }
+    if (file != NULL && fclose(file) != 0) {
+        writer_fail(writer, errno);
+    }
+    if (writer->error == 0 && rename(writer->temp_path, writer->path) != 0) {
+        writer_fail(writer, errno);
+    }
+    if (writer->error != 0) {
+        const int saved = writer->error;
+        snapshot_writer_abort(writer);
+        errno = saved;
+        return false;
+    }
+    wal_sync_directory(writer->path);
+    writer_free(writer);
+    return true;
+}
+
+/**
+ * Stops writing a snapshot, deletes the temporary file and frees the writer
+ * @param writer the writer
+ */
+void snapshot_writer_abort(snapshot_writer *writer) {
+    unlink(writer->temp_path);
+    writer_free(writer);
+}
@@ -0,0 +1,106 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//"WGSNAP" and the version, a snapshot of another version is not read
+#define SNAPSHOT_MAGIC "WGSNAP"
+#define SNAPSHOT_VERSION 1
+//Room for the header, the records start on the next page.
+#define SNAPSHOT_HEADER_SIZE 4096
+#define SNAPSHOT_MAX_RESOURCES 16
+
+/**
+ * The header at the start of a snapshot file. All numbers are stored in the byte order of the
+ * machine (little endian), the file is used in place through mmap.
+ */
+typedef struct snapshot_header {
+    char magic[6];
+    uint16_t version;
+    uint32_t resources;
+    //CRC-32C of the header with crc set to 0; the sections are not checked, opening stays O(1)
+    uint32_t crc;
+    //the write-ahead log up to this LSN is contained, replay continues there
+    uint64_t lsn;
+    uint64_t last_id;
+    uint64_t record_count;
+    uint64_t names_size;
+    //64-bit words of the occupancy bitmap of each resource
+    uint64_t slot_words;
+    uint64_t file_size;
+    //offsets of the sections in the file
+    uint64_t records_offset;
+    uint64_t ids_offset;
+    uint64_t bitmaps_offset;
+    uint64_t names_offset;
+    //the records of resource r are [resource_start[r], resource_start[r + 1]), ordered by start
+    uint64_t resource_start[SNAPSHOT_MAX_RESOURCES + 1];
+} snapshot_header;
+
+//A booking in a snapshot, its resource is given by the section of the records it lies in.
+typedef struct snapshot_record {
+    uint64_t id;
+    int64_t start;
+    int64_t end;
+    //the name is names[name_offset, name_offset + name_len)
+    uint32_t name_offset;
+    uint8_t name_len;
+    uint8_t reserved[3];
+} snapshot_record;
+
+/**
+ * A snapshot file mapped into memory: the header, the records of all resources, an index from
+ * id - 1 to record index + 1 (0 for ids that were cancelled before the snapshot), the occupancy
+ * bitmaps of the resources one after another and the names. Nothing is read or copied when it is
+ * opened, the kernel loads the pages that are used.
+ */
+typedef struct snapshot {
+    void *map;
+    size_t size;
+    const snapshot_header *header;
+    const snapshot_record *records;
+    const uint32_t *ids;
+    const uint64_t *bitmaps;
+    const char *names;
+} snapshot;
+
+/**
+ * Collects a snapshot in memory, records are added in order; snapshot_writer_commit writes it
+ * into a temporary file next to its path and replaces the old one with it.
+ */
+typedef struct snapshot_writer {
+    char *path;
+    char *temp_path;
+    snapshot_header header;
+    //the sections behind the header
+    snapshot_record *records;
+    size_t records_cap;
+    uint32_t *ids;
+    uint64_t *bitmaps;
+    char *names;
+    size_t names_cap;
+    //resource of the last added record
+    unsigned int resource;
+    //the first error, later steps are skipped
+    int error;
+} snapshot_writer;
+
+snapshot *snapshot_open(const char *path, unsigned int resources);
+
+void snapshot_close(snapshot *snap);
+
+snapshot_writer *snapshot_writer_new(const char *path, unsigned int resources, uint64_t lsn, uint64_t last_id,
+                                     size_t slot_words, size_t expected);
+
+void snapshot_writer_add(snapshot_writer *writer, unsigned int resource, uint64_t id, int64_t start, int64_t end,
+                         const char *name, size_t name_len);
+
+bool snapshot_writer_end(snapshot_writer *writer, const uint64_t *const *bitmaps);
+
+bool snapshot_writer_commit(snapshot_writer *writer);
+
+void snapshot_writer_abort(snapshot_writer *writer);
+
+#endif //SNAPSHOT_H
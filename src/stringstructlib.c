@@ -3,25 +3,105 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "httplib.h"
 
+/**
+ * Vergrößert den Puffer von str auf genau cap Bytes. Im Fehlerfall wird das Programm beendet.
+ * @param str Der String.
+ * @param cap Die neue Kapazität, mindestens str->len.
+ */
+static void str_grow_to(string *str, size_t cap) {
+    char *buffer = arena_realloc(str->str, str->len, cap);
+    if (buffer == NULL) {
+        exit(3);
+    }
+    str->str = buffer;
+    str->cap = cap;
+}
+
 /**
  * Hängt einen String src mit der Länge len an einen bestehenden String dest an.
+ * Reicht die Kapazität nicht, wird sie mindestens verdoppelt, damit wiederholtes
+ * Anhängen insgesamt nur linear viel kopiert.
  * @param dest An diesen String wird angehängt.
  * @param src Dieser String wird an dest angehängt.
  * @param len Die Länge von src.
  */
 void str_cat(string *dest, const char *src, size_t len) {
-    char *str = calloc(1, get_length(dest) + len);
-    for (unsigned int i = 0; i < get_length(dest); i++) {
-        str[i] = get_char_str(dest)[i];
+    if (len == 0) {
+        return;
     }
-    for (unsigned int i = 0; i < len; i++) {
-        str[i + get_length(dest)] = src[i];
+    const size_t needed = dest->len + len;
+    if (needed > dest->cap) {
+        size_t cap = dest->cap < 16 ? 16 : dest->cap * 2;
+        while (cap < needed) {
+            cap *= 2;
+        }
+        str_grow_to(dest, cap);
     }
-    free(dest->str);
-    dest->str = str;
-    dest->len = len + get_length(dest);
+    memcpy(dest->str + dest->len, src, len);
+    dest->len = needed;
+}
+
+/**
+ * Stellt sicher, dass an str noch additional Bytes ohne weitere Allokation angehängt
+ * werden können. Ist die Endgröße vorher bekannt, wird so genau einmal alloziert.
+ * @param str Der String.
+ * @param additional Anzahl der Bytes, die noch angehängt werden.
+ */
+void str_reserve(string *str, size_t additional) {
+    if (str->len + additional > str->cap) {
+        str_grow_to(str, str->len + additional);
+    }
+}
+
+/**
+ * Erstellt einen neuen leeren String mit Platz für cap Bytes.
+ * Im Fehlerfall wird das Programm beendet.
+ * @param cap Die Kapazität, z.B. die vorher berechnete Endgröße.
+ * @return string* Der neue leere String.
+ */
+string *str_with_capacity(size_t cap) {
+    string *str = arena_calloc(1, sizeof(string));
+    if (str == NULL) {
+        exit(2);
+    }
+    str->str = arena_malloc(cap > 0 ? cap : 1);
+    if (str->str == NULL) {
+        exit(3);
+    }
+    str->cap = cap > 0 ? cap : 1;
+    return str;
+}
+
+/**
+ * Hängt eine Zahl in Dezimalschreibweise an dest an, ohne einen Zwischenstring anzulegen.
+ * @param dest An diesen String wird angehängt.
+ * @param number Die Zahl.
+ */
+void str_cat_number(string *dest, size_t number) {
+    const size_t length = number_length(number);
+    str_reserve(dest, length);
+    for (size_t i = length; i > 0; i--) {
+        dest->str[dest->len + i - 1] = (char) ('0' + number % 10);
+        number /= 10;
+    }
+    dest->len += length;
+}
+
+/**
+ * Gibt die Anzahl der Dezimalstellen einer Zahl zurück.
+ * @param number Die Zahl.
+ * @return size_t Anzahl der Stellen, 1 für 0.
+ */
+size_t number_length(size_t number) {
+    size_t length = 1;
+    while (number >= 10) {
+        number /= 10;
+        length++;
+    }
+    return length;
 }
 
 /**
@@ -45,7 +125,7 @@ string **str_split(string *str, const char seperator) {
             counter++;
         }
     }
-    string **arr = calloc(counter + 2, sizeof(string *));
+    string **arr = arena_calloc(counter + 2, sizeof(string *));
     unsigned int links = 0;
     unsigned int rechts = 0;
     int j = 0;
@@ -84,16 +164,17 @@ string **str_split_at_index(string *str, const int index) {
  * @return string* Der neue leere String.
  */
 string *str_new(void) {
-    string *str = calloc(1, sizeof(string));
+    string *str = arena_calloc(1, sizeof(string));
     if (str == NULL) {
         exit(2);
     }
-    str->str = calloc(1, 1);
+    str->str = arena_calloc(1, 1);
     if (str->str == NULL) {
         exit(3);
     }
     str->str[0] = '\0';
     str->len = 0;
+    str->cap = 1;
     return str;
 }
 
@@ -117,28 +198,30 @@ void str_print(string *str) {
  */
 string *str_cpy(const char *src, size_t len) {
     assert(src != NULL);
-    string *dest = calloc(1, sizeof(string));
+    string *dest = arena_calloc(1, sizeof(string));
     if (dest == NULL) {
         exit(2);
     }
-    dest->str = calloc(len, sizeof(char));
+    dest->str = arena_calloc(len, sizeof(char));
     if (dest->str == NULL) {
         exit(3);
     }
     memcpy(dest->str, src, len);
     dest->len = len;
+    dest->cap = len;
     return dest;
 }
 
 /**
- * Gibt den String str frei.
+ * Gibt den String str frei. Strings aus der Arena des Threads (siehe arena_use) werden erst
+ * mit arena_reset freigegeben.
  * @param str Der freizugebende String.
  */
 void str_free(string *str) {
     assert(str != NULL);
     assert(str->str != NULL);
-    free(str->str);
-    free(str);
+    arena_free(str->str);
+    arena_free(str);
 }
 
 /**
@@ -170,7 +253,7 @@ char *get_char_str(string *str) {
 string *str_decode(string *src) {
     assert(src != NULL);
     unsigned int decode_len = 0; // Counter for the length of decoded string
-    char *str = calloc(1, get_length(src)); // String for temporally saving the decoded string
+    char *str = arena_calloc(1, get_length(src)); // String for temporally saving the decoded string
     for (unsigned int i = 0; i < get_length(src); i++) {
         // copies source string into decoded string
         if (src->str[i] == '%' && ((i + 2) < get_length(src))) {
@@ -186,11 +269,10 @@ string *str_decode(string *src) {
             decode_len++;
         }
     }
-    str = realloc(str, decode_len);
-    assert(str != NULL);
-    string *dest = calloc(1, sizeof(string)); // storing the decoded string in string-struct
+    string *dest = arena_calloc(1, sizeof(string)); // storing the decoded string in string-struct
     dest->str = str;
     dest->len = decode_len;
+    dest->cap = get_length(src);
     return dest;
 }
 
@@ -219,12 +301,8 @@ short str_start_with(string *str1, string *str2) {
  * @return 1 if true, 0 if false
  */
 short str_start_with_chars(string *str, char *c, unsigned int length) {
-    string *str2 = calloc(1, sizeof(string));
-    str2->str = c;
-    str2->len = length;
-    short result = str_start_with(str, str2);
-    free(str2);
-    return result;
+    string str2 = {length, c, 0};
+    return str_start_with(str, &str2);
 }
 
 /**
@@ -234,13 +312,14 @@ short str_start_with_chars(string *str, char *c, unsigned int length) {
 void str_trim(string *str) {
     unsigned short start = str->str[0] == ' ' ? 1 : 0;
     unsigned short end = str->str[str->len - 1] == ' ' ? 1 : 0;
-    char *new_str = calloc(str->len - start - end, sizeof(char));
+    char *new_str = arena_calloc(str->len - start - end, sizeof(char));
     for (unsigned int i = 0; i < (str->len - start - end); ++i) {
         new_str[i] = str->str[i + start];
     }
-    free(str->str);
+    arena_free(str->str);
     str->str = new_str;
     str->len -= start + end;
+    str->cap = str->len;
 }
 
 /** str_cmp implemented for string-struct without /0 Terminator
@@ -275,7 +354,7 @@ void str_replace_with(string *str, char *to_replace, char *replace_with) {
         string **pivot = str_split_at_index(str, (int) i);
         if (pivot[1] != NULL && str_start_with_chars(pivot[1], to_replace, (unsigned int) strlen(to_replace))) {
             //save the current pivot element, because it was removed from the string by splitting it
-            char *char1 = calloc(1, sizeof(char));
+            char *char1 = arena_calloc(1, sizeof(char));
             char1[0] = str->str[i];
 
             //start building the new string with the part left of the pivot element, the pivot element and replace_with
@@ -286,26 +365,27 @@ void str_replace_with(string *str, char *to_replace, char *replace_with) {
 
             //now get the remaining chars behind to_replace and concat them, if any
             string **remaining = str_split_at_index(pivot[1], (int) strlen(to_replace));
-            char *char2 = calloc(1, sizeof(char));
+            char *char2 = arena_calloc(1, sizeof(char));
             char2[0] = str->str[i + strlen(to_replace) + 1];
             str_cat(builder, char2, sizeof(char));
             if (remaining[1] != NULL) {
                 str_cat(builder, remaining[1]->str, remaining[1]->len);
                 str_free(remaining[1]);
             }
-            free(str->str);
+            arena_free(str->str);
             str->str = builder->str;
             str->len = builder->len;
-            free(builder);
+            str->cap = builder->cap;
+            arena_free(builder);
             str_free(remaining[0]);
-            free(remaining);
-            free(char2);
-            free(char1);
+            arena_free(remaining);
+            arena_free(char2);
+            arena_free(char1);
         }
         if (pivot[1] != NULL)
             str_free(pivot[1]);
         str_free(pivot[0]);
-        free(pivot);
+        arena_free(pivot);
     }
 }
 
@@ -316,11 +396,12 @@ void str_replace_with(string *str, char *to_replace, char *replace_with) {
  * @return string containing c, must be freed
  */
 string *char_to_string(char *c) {
-    string *str = calloc(1, sizeof(string));
+    string *str = arena_calloc(1, sizeof(string));
     size_t size = strlen(c);
-    str->str = calloc(size, sizeof(char));
+    str->str = arena_calloc(size, sizeof(char));
     memcpy(str->str, c, size);
     str->len = size;
+    str->cap = size;
     return str;
 }
 
@@ -349,14 +430,15 @@ string *number_to_str(size_t number) {
     for (i = 0; temp > 0; i++) {
         temp /= 10;
     }
-    string *ret = calloc(1, sizeof(string));
+    string *ret = arena_calloc(1, sizeof(string));
     ret->len = (unsigned) i;
-    char *str = calloc((unsigned) i, sizeof(char));
+    char *str = arena_calloc((unsigned) i, sizeof(char));
     for (i--; i >= 0; i--) {
         str[i] = (char) ((int) number % 10 + '0');
         number /= 10;
     }
     ret->str = str;
+    ret->cap = ret->len;
     return ret;
 }
 
@@ -383,7 +465,7 @@ void str_format(string *str) {
             spaces++;
         }
     }
-    char *new_str = calloc(str->len - spaces, sizeof(char));
+    char *new_str = arena_calloc(str->len - spaces, sizeof(char));
 
     unsigned int new_str_index = 0;
     for (unsigned int i = 0; i < str->len; ++i) {
@@ -391,9 +473,10 @@ void str_format(string *str) {
             new_str[new_str_index++] = str->str[i];
         }
     }
-    free(str->str);
+    arena_free(str->str);
     str->str = new_str;
     str->len = str->len - spaces;
+    str->cap = str->len;
 }
 
 /**
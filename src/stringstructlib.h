@@ -4,10 +4,20 @@
 typedef struct stringstructlib {
     size_t len;
     char *str;
+    //allocated bytes of str, appends only reallocate once len would exceed it
+    size_t cap;
 } string;
 
 void str_cat(string *dest, const char *src, size_t len);
 
+void str_reserve(string *str, size_t additional);
+
+string *str_with_capacity(size_t cap);
+
+void str_cat_number(string *dest, size_t number);
+
+size_t number_length(size_t number);
+
 void str_append_new_line(string *dest);
 
 string **str_split(string *str, char separator);
@@ -0,0 +1,311 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "template.h"
+
+/**
+ * Returns the replacement of a character that has to be escaped in HTML text and attributes
+ * @param c the character
+ * @return the entity, NULL if c is copied unchanged
+ */
+static const char *html_entity(char c) {
+    switch (c) {
+        case '&':
+            return "&amp;";
+        case '<':
+            return "&lt;";
+        case '>':
+            return "&gt;";
+        case '"':
+            return "&quot;";
+        case '\'':
+            return "&#39;";
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * Returns the length of a value after HTML escaping
+ * @param value the value, not null terminated
+ * @param len length of the value
+ * @return length of the escaped value
+ */
+size_t html_escaped_length(const char *value, size_t len) {
+    size_t escaped = len;
+    for (size_t i = 0; i < len; ++i) {
+        const char *entity = html_entity(value[i]);
+        if (entity != NULL) {
+            escaped += strlen(entity) - 1;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Copies a value HTML escaped to dest
+ * @param dest target with room for html_escaped_length() bytes
+ * @param value the value
+ * @param len length of the value
+ * @return position behind the copied value
+ */
+static char *html_escape_into(char *dest, const char *value, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const char *entity = html_entity(value[i]);
+        if (entity != NULL) {
+            memcpy(dest, value + start, i - start);
+            dest += i - start;
+            const size_t entity_len = strlen(entity);
+            memcpy(dest, entity, entity_len);
+            dest += entity_len;
+            start = i + 1;
+        }
+    }
+    memcpy(dest, value + start, len - start);
+    return dest + len - start;
+}
+
+/**
+ * Finds the slot of a placeholder name
+ * @param name the name between ${ and }
+ * @param len length of the name
+ * @param slots names of the slots
+ * @param slot_count number of slots
+ * @return index of the slot, -1 if the name is no slot or empty
+ */
+static int find_slot(const char *name, size_t len, const char *const *slots, size_t slot_count) {
+    if (len == 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (strlen(slots[i]) == len && memcmp(slots[i], name, len) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Appends a segment, adjacent literal text is merged into one segment
+ * @param template the template being parsed
+ * @param segment the new segment
+ */
+static void add_segment(html_template *template, template_segment segment) {
+    if (segment.slot < 0) {
+        if (segment.len == 0) {
+            return;
+        }
+        template->literal_len += segment.len;
+        template_segment *last = template->segment_count > 0 ? &template->segments[template->segment_count - 1]
+                                                             : NULL;
+        if (last != NULL && last->slot < 0 && last->offset + last->len == segment.offset) {
+            last->len += segment.len;
+            return;
+        }
+    }
+    template->segments[template->segment_count++] = segment;
+}
+
+/**
+ * Parses a template into literal segments and placeholders. The text is copied, so it may be
+ * freed afterwards.
+ * @param text the template, e.g. the content of resources/debug.html
+ * @param len length of the text
+ * @param slots names of the placeholders, the index of a name is the index of its value in
+ * template_render
+ * @param slot_count number of names, at most TEMPLATE_MAX_SLOTS
+ * @return the template, must be freed with template_free
+ */
+html_template *template_parse(const char *text, size_t len, const char *const *slots, size_t slot_count) {
+    html_template *template = calloc(1, sizeof(html_template));
+    if (template == NULL) {
+        exit(2);
+    }
+    template->source = malloc(len > 0 ? len : 1);
+    //every placeholder takes at least four bytes and splits one literal segment into two
+    template->segments = calloc(len / 4 * 2 + 1, sizeof(template_segment));
+    if (template->source == NULL || template->segments == NULL) {
+        exit(2);
+    }
+    memcpy(template->source, text, len);
+    template->source_len = len;
+    template->slot_count = slot_count < TEMPLATE_MAX_SLOTS ? slot_count : TEMPLATE_MAX_SLOTS;
+
+    const char *source = template->source;
+    size_t literal_start = 0;
+    size_t pos = 0;
+    while (pos + 1 < len) {
+        const char *open = memchr(source + pos, '$', len - pos - 1);
+        if (open == NULL) {
+            break;
+        }
+        const size_t start = (size_t) (open - source);
+        const char *close = open[1] == '{' ? memchr(open + 2, '}', len - start - 2) : NULL;
+        const int slot = close != NULL ? find_slot(open + 2, (size_t) (close - open - 2), slots,
+                                                   template->slot_count) : -1;
+        if (slot < 0) {
+            pos = start + 1;
+            continue;
+        }
+        add_segment(template, (template_segment) {-1, literal_start, start - literal_start});
+        add_segment(template, (template_segment) {slot, start, (size_t) (close - open + 1)});
+        pos = (size_t) (close - source) + 1;
+        literal_start = pos;
+    }
+    add_segment(template, (template_segment) {-1, literal_start, len - literal_start});
+    return template;
+}
+
+/**
+ * Frees a template
+ * @param template the template, may be NULL
+ */
+void template_free(html_template *template) {
+    if (template == NULL) {
+        return;
+    }
+    free(template->source);
+    free(template->segments);
+    free(template);
+}
+
+/**
+ * Renders a template with one allocation: the length is computed first, then literal segments
+ * and HTML escaped values are copied into the result.
+ * @param template the parsed template
+ * @param values one value per slot of the template, in the order of the slot names
+ * @return the page, allocated like other strings (see arena_use), must be freed with str_free
+ */
+string *template_render(const html_template *template, const str_view *values) {
+    size_t escaped[TEMPLATE_MAX_SLOTS];
+    for (size_t i = 0; i < template->slot_count; ++i) {
+        escaped[i] = html_escaped_length(values[i].str, values[i].len);
+    }
+    size_t len = template->literal_len;
+    for (size_t i = 0; i < template->segment_count; ++i) {
+        if (template->segments[i].slot >= 0) {
+            len += escaped[template->segments[i].slot];
+        }
+    }
+    string *page = str_with_capacity(len);
+    char *dest = page->str;
+    for (size_t i = 0; i < template->segment_count; ++i) {
+        const template_segment *segment = &template->segments[i];
+        if (segment->slot < 0) {
+            memcpy(dest, template->source + segment->offset, segment->len);
+            dest += segment->len;
+        } else if (escaped[segment->slot] == values[segment->slot].len) {
+            memcpy(dest, values[segment->slot].str, values[segment->slot].len);
+            dest += values[segment->slot].len;
+        } else {
+            dest = html_escape_into(dest, values[segment->slot].str, values[segment->slot].len);
+        }
+    }
+    page->len = len;
+    return page;
+}
+
+/**
+ * Creates a template backed by a file. The file is read on the first template_file_get.
+ * @param path null terminated path of the file, e.g. DOC_ROOT "debug.html"
+ * @param slots names of the placeholders, not copied, must live as long as the template
+ * @param slot_count number of names
+ * @return the template file, must be closed with template_file_close
+ */
+template_file *template_file_open(const char *path, const char *const *slots, size_t slot_count) {
+    template_file *file = calloc(1, sizeof(template_file));
+    if (file == NULL) {
+        exit(2);
+    }
+    file->path = strdup(path);
+    if (file->path == NULL) {
+        exit(2);
+    }
+    file->slots = slots;
+    file->slot_count = slot_count;
+    return file;
+}
+
+/**
+ * Reads and parses the file of a template
+ * @param file the template file
+ * @return 1 on success, 0 if the file can't be read
+ */
+static short template_file_load(template_file *file) {
+    const int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    char *text = NULL;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (text = malloc((size_t) st.st_size + 1)) == NULL) {
+        close(fd);
+        return 0;
+    }
+    size_t len = 0;
+    while (len < (size_t) st.st_size) {
+        const ssize_t length = read(fd, text + len, (size_t) st.st_size - len);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+        len += (size_t) length;
+    }
+    close(fd);
+    if (len != (size_t) st.st_size) {
+        free(text);
+        return 0;
+    }
+    template_free(file->template);
+    file->template = template_parse(text, len, file->slots, file->slot_count);
+    free(text);
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->size = st.st_size;
+    file->mtime = st.st_mtim;
+    file->loads++;
+    return 1;
+}
+
+/**
+ * Returns the parsed template of a file. The file is revalidated with a single stat() and only
+ * read and parsed again if inode, size or modification time changed.
+ * @param file the template file
+ * @return the template, valid until the next call; NULL if the file can't be read
+ */
+const html_template *template_file_get(template_file *file) {
+    struct stat st;
+    if (stat(file->path, &st) < 0) {
+        template_free(file->template);
+        file->template = NULL;
+        return NULL;
+    }
+    if (file->template == NULL || st.st_ino != file->ino || st.st_dev != file->dev || st.st_size != file->size
+        || st.st_mtim.tv_sec != file->mtime.tv_sec || st.st_mtim.tv_nsec != file->mtime.tv_nsec) {
+        if (!template_file_load(file)) {
+            template_free(file->template);
+            file->template = NULL;
+        }
+    }
+    return file->template;
+}
+
+/**
+ * Closes a template file and frees its template
+ * @param file the template file, may be NULL
+ */
+void template_file_close(template_file *file) {
+    if (file == NULL) {
+        return;
+    }
+    template_free(file->template);
+    free(file->path);
+    free(file);
+}
@@ -0,0 +1,71 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "httplib.h"
+
+//Maximum number of placeholder names of a template.
+#define TEMPLATE_MAX_SLOTS 16
+
+//A part of a parsed template: literal text of the source or a placeholder.
+typedef struct template_segment {
+    //index of the placeholder in the slot names, -1 for literal text
+    int slot;
+    //literal text: position in the source
+    size_t offset;
+    size_t len;
+} template_segment;
+
+/**
+ * A template parsed once into literal segments and placeholder slots, so rendering only copies
+ * segments and values. Placeholders are written ${name}; names that are not slots of the template
+ * stay literal text.
+ */
+typedef struct html_template {
+    char *source;
+    size_t source_len;
+    template_segment *segments;
+    size_t segment_count;
+    size_t slot_count;
+    //bytes of literal text, the lower bound of a rendered page
+    size_t literal_len;
+} html_template;
+
+/**
+ * A template loaded from a file. It is parsed on first use and parsed again when inode, size or
+ * modification time of the file change, see template_file_get. Not synchronized, every worker
+ * owns its own.
+ */
+typedef struct template_file {
+    //null terminated, including DOC_ROOT
+    char *path;
+    const char *const *slots;
+    size_t slot_count;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    //NULL until loaded or while the file can't be read
+    html_template *template;
+    //number of times the file was parsed
+    unsigned long loads;
+} template_file;
+
+html_template *template_parse(const char *text, size_t len, const char *const *slots, size_t slot_count);
+
+void template_free(html_template *template);
+
+size_t html_escaped_length(const char *value, size_t len);
+
+string *template_render(const html_template *template, const str_view *values);
+
+template_file *template_file_open(const char *path, const char *const *slots, size_t slot_count);
+
+const html_template *template_file_get(template_file *file);
+
+void template_file_close(template_file *file);
+
+#endif //TEMPLATE_H
@@ -0,0 +1,410 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wal.h"
+
+#define WAL_INITIAL_BUFFER 4096
+
+static uint32_t crc32c_table[256];
+
+/**
+ * Computes the table of the byte-wise CRC-32C (Castagnoli, reflected polynomial 0x82F63B78)
+ * before main() runs
+ */
+__attribute__((constructor))
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        }
+        crc32c_table[i] = crc;
+    }
+}
+
+/**
+ * Computes the CRC-32C of a record, the checksum iSCSI and ext4 use
+ * @param data the bytes
+ * @param len number of bytes
+ * @return the checksum
+ */
+uint32_t wal_crc32c(const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) {
+        crc = crc32c_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void put_u32(char *dest, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        dest[i] = (char) (value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const char *src) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= (uint32_t) (unsigned char) src[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * Writes all bytes, continuing after partial writes and signals
+ * @return true on success, false on an error (errno is set)
+ */
+static bool write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        len -= (size_t) written;
+    }
+    return true;
+}
+
+/**
+ * Syncs the directory of a file, so a newly created or renamed file is found after a crash as well
+ * @param path path of the file
+ */
+void wal_sync_directory(const char *path) {
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        exit(2);
+    }
+    const int dir = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    free(copy);
+}
+
+/**
+ * Reads the log from an LSN on and hands every valid record to replay. Reading stops at the first
+ * record that is cut off or whose checksum doesn't match, e.g. after a crash during a write; the
+ * file is truncated there, so new records follow the last valid one.
+ * @return the length of the valid log, -1 on an error (errno is set)
+ */
+static off_t recover(wal *log, uint64_t from, wal_replay replay, void *arg) {
+    struct stat st;
+    if (fstat(log->fd, &st) < 0) {
+        return -1;
+    }
+    if ((uint64_t) st.st_size < from) {
+        //the records up to from are gone, the records appended next would get LSNs already taken
+        errno = EINVAL;
+        return -1;
+    }
+    const size_t size = (size_t) st.st_size - from;
+    char *data = malloc(size > 0 ? size : 1);
+    if (data == NULL) {
+        exit(2);
+    }
+    size_t read_bytes = 0;
+    while (read_bytes < size) {
+        const ssize_t length = pread(log->fd, data + read_bytes, size - read_bytes, (off_t) (from + read_bytes));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            free(data);
+            return -1;
+        }
+        read_bytes += (size_t) length;
+    }
+    size_t valid = 0;
+    while (valid + WAL_RECORD_HEADER <= size) {
+        const uint32_t len = get_u32(data + valid);
+        if (len == 0 || len > WAL_MAX_RECORD || len > size - valid - WAL_RECORD_HEADER
+            || wal_crc32c(data + valid + WAL_RECORD_HEADER, len) != get_u32(data + valid + 4)) {
+            break;
+        }
+        if (replay != NULL) {
+            replay(arg, data + valid + WAL_RECORD_HEADER, len);
+        }
+        log->stats.recovered++;
+        valid += WAL_RECORD_HEADER + len;
+    }
+    free(data);
+    if (valid < size) {
+        if (ftruncate(log->fd, (off_t) (from + valid)) < 0 || fdatasync(log->fd) < 0) {
+            return -1;
+        }
+        log->stats.truncated = size - valid;
+    }
+    return (off_t) (from + valid);
+}
+
+/**
+ * The flusher thread: takes everything appended so far as one batch, writes it with one write()
+ * and syncs it with one fdatasync() while new records collect in the other buffer. With
+ * WAL_DURABILITY_SYNC a batch is a single record.
+ * @param arg the log
+ * @return NULL
+ */
+static void *flush_loop(void *arg) {
+    wal *log = arg;
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (log->len == 0 && !log->closing) {
+            pthread_cond_wait(&log->pending, &log->lock);
+        }
+        if (log->len == 0) {
+            break;
+        }
+        size_t take = log->len;
+        if (log->durability == WAL_DURABILITY_SYNC) {
+            take = WAL_RECORD_HEADER + get_u32(log->buffer);
+        }
+        if (take == log->len) {
+            char *batch = log->batch;
+            const size_t batch_cap = log->batch_cap;
+            log->batch = log->buffer;
+            log->batch_cap = log->cap;
+            log->buffer = batch;
+            log->cap = batch_cap;
+            log->len = 0;
+        } else {
+            if (log->batch_cap < take) {
+                char *batch = realloc(log->batch, take);
+                if (batch == NULL) {
+                    exit(2);
+                }
+                log->batch = batch;
+                log->batch_cap = take;
+            }
+            memcpy(log->batch, log->buffer, take);
+            memmove(log->buffer, log->buffer + take, log->len - take);
+            log->len -= take;
+        }
+        const uint64_t end = log->appended - log->len;
+        pthread_mutex_unlock(&log->lock);
+
+        const bool sync = log->durability != WAL_DURABILITY_NONE;
+        if (!write_all(log->fd, log->batch, take) || (sync && fdatasync(log->fd) < 0)) {
+            //Acknowledging bookings that are not on disk would be worse than stopping
+            fprintf(stderr, "ERROR writing the write-ahead log, errno: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        pthread_mutex_lock(&log->lock);
+        atomic_store(&log->durable, end);
+        log->stats.batches++;
+        log->stats.syncs += sync;
+        pthread_cond_broadcast(&log->synced);
+        const uint64_t one = 1;
+        for (size_t i = 0; i < log->subscriber_count; ++i) {
+            //a full counter (EAGAIN) is already signalled
+            (void) !write(log->subscribers[i], &one, sizeof(one));
+        }
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+/**
+ * Opens or creates a log, replays its records and starts the flusher
+ * @param path path of the log file
+ * @param durability when appended records count as durable
+ * @param from LSN to replay from, e.g. the one a snapshot was taken at; 0 replays the whole log.
+ * Has to be the start of a record (or the end of the log), the records before it are not read.
+ * @param replay called for every valid record already in the log from there on, may be NULL
+ * @param arg passed to replay
+ * @return the log, must be closed with wal_close; NULL if the file can't be opened or read, or if
+ * it is shorter than from (EINVAL) (errno is set)
+ */
+wal *wal_open(const char *path, wal_durability durability, uint64_t from, wal_replay replay, void *arg) {
+    wal *log = calloc(1, sizeof(wal));
+    if (log == NULL) {
+        exit(2);
+    }
+    log->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    const off_t end = log->fd >= 0 ? recover(log, from, replay, arg) : -1;
+    if (end < 0) {
+        const int saved = errno;
+        if (log->fd >= 0) {
+            close(log->fd);
+        }
+        free(log);
+        errno = saved;
+        return NULL;
+    }
+    wal_sync_directory(path);
+    log->durability = durability;
+    log->appended = (uint64_t) end;
+    atomic_init(&log->durable, (uint64_t) end);
+    log->buffer = malloc(WAL_INITIAL_BUFFER);
+    log->batch = malloc(WAL_INITIAL_BUFFER);
+    if (log->buffer == NULL || log->batch == NULL) {
+        exit(2);
+    }
+    log->cap = WAL_INITIAL_BUFFER;
+    log->batch_cap = WAL_INITIAL_BUFFER;
+    if (pthread_mutex_init(&log->lock, NULL) != 0 || pthread_cond_init(&log->pending, NULL) != 0
+        || pthread_cond_init(&log->synced, NULL) != 0 || pthread_create(&log->flusher, NULL, flush_loop, log) != 0) {
+        exit(2);
+    }
+    return log;
+}
+
+/**
+ * Appends a record. Only the buffer is written, the flusher writes and syncs it with the next
+ * batch. Records are replayed in the order of the calls, so a caller that appends the changes
+ * of a data structure has to do so under the same lock that orders the changes.
+ * @param log the log
+ * @param record the payload
+ * @param len length of the payload, 1 to WAL_MAX_RECORD
+ * @return the LSN of the record, see wal_is_durable and wal_wait
+ */
+uint64_t wal_append(wal *log, const void *record, size_t len) {
+    pthread_mutex_lock(&log->lock);
+    if (log->len + WAL_RECORD_HEADER + len > log->cap) {
+        size_t cap = log->cap * 2;
+        while (cap < log->len + WAL_RECORD_HEADER + len) {
+            cap *= 2;
+        }
+        char *buffer = realloc(log->buffer, cap);
+        if (buffer == NULL) {
+            exit(2);
+        }
+        log->buffer = buffer;
+        log->cap = cap;
+    }
+    put_u32(log->buffer + log->len, (uint32_t) len);
+    put_u32(log->buffer + log->len + 4, wal_crc32c(record, len));
+    memcpy(log->buffer + log->len + WAL_RECORD_HEADER, record, len);
+    log->len += WAL_RECORD_HEADER + len;
+    log->appended += WAL_RECORD_HEADER + len;
+    log->stats.records++;
+    const uint64_t lsn = log->appended;
+    pthread_cond_signal(&log->pending);
+    pthread_mutex_unlock(&log->lock);
+    return lsn;
+}
+
+/**
+ * Returns the LSN of the last appended record, the end of the log once it is written
+ * @param log the log
+ * @return the LSN
+ */
+uint64_t wal_appended(wal *log) {
+    pthread_mutex_lock(&log->lock);
+    const uint64_t lsn = log->appended;
+    pthread_mutex_unlock(&log->lock);
+    return lsn;
+}
+
+/**
+ * Tells without blocking whether a record is durable
+ * @param log the log
+ * @param lsn the LSN of the record, 0 is always durable
+ * @return true if the record was synced, or was written with WAL_DURABILITY_NONE
+ */
+bool wal_is_durable(wal *log, uint64_t lsn) {
+    return log->durability == WAL_DURABILITY_NONE || atomic_load(&log->durable) >= lsn;
+}
+
+/**
+ * Blocks until a record is durable
+ * @param log the log
+ * @param lsn the LSN of the record
+ */
+void wal_wait(wal *log, uint64_t lsn) {
+    if (wal_is_durable(log, lsn)) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    while (!wal_is_durable(log, lsn)) {
+        pthread_cond_wait(&log->synced, &log->lock);
+    }
+    pthread_mutex_unlock(&log->lock);
+}
+
+/**
+ * Blocks until the log is on disk up to an LSN, whatever its durability. Used before something
+ * that depends on the records is made durable itself, e.g. a snapshot taken at the LSN: with
+ * WAL_DURABILITY_NONE the flusher only writes, so the records are synced here.
+ * @param log the log
+ * @param lsn the LSN, at most wal_appended
+ * @return true on success, false if syncing failed (errno is set)
+ */
+bool wal_sync_to(wal *log, uint64_t lsn) {
+    pthread_mutex_lock(&log->lock);
+    //durable follows every written batch, also without syncs
+    while (atomic_load(&log->durable) < lsn) {
+        pthread_cond_wait(&log->synced, &log->lock);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return log->durability != WAL_DURABILITY_NONE || fdatasync(log->fd) == 0;
+}
+
+/**
+ * Creates an event file descriptor that becomes readable after every batch, so an event loop
+ * learns when waiting records became durable without blocking
+ * @param log the log
+ * @return the descriptor, non-blocking, closed by wal_close; -1 on an error
+ */
+int wal_subscribe(wal *log) {
+    pthread_mutex_lock(&log->lock);
+    int fd = -1;
+    if (log->subscriber_count < WAL_MAX_SUBSCRIBERS) {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd >= 0) {
+            log->subscribers[log->subscriber_count++] = fd;
+        }
+    }
+    pthread_mutex_unlock(&log->lock);
+    return fd;
+}
+
+/**
+ * Returns a copy of the counters, taken under the lock while the flusher may be running
+ * @param log the log
+ * @return the counters
+ */
+wal_stats wal_get_stats(wal *log) {
+    pthread_mutex_lock(&log->lock);
+    const wal_stats stats = log->stats;
+    pthread_mutex_unlock(&log->lock);
+    return stats;
+}
+
+/**
+ * Writes and syncs the remaining records, stops the flusher and closes the log
+ * @param log the log, may be NULL
+ */
+void wal_close(wal *log) {
+    if (log == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    log->closing = true;
+    pthread_cond_signal(&log->pending);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->flusher, NULL);
+    for (size_t i = 0; i < log->subscriber_count; ++i) {
+        close(log->subscribers[i]);
+    }
+    close(log->fd);
+    pthread_cond_destroy(&log->synced);
+    pthread_cond_destroy(&log->pending);
+    pthread_mutex_destroy(&log->lock);
+    free(log->buffer);
+    free(log->batch);
+    free(log);
+}
@@ -0,0 +1,93 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Every record starts with the length and the CRC-32C of its payload, both 32 bit little endian.
+#define WAL_RECORD_HEADER 8
+//Longest payload of a record, longer lengths mark a torn or corrupt log.
+#define WAL_MAX_RECORD 4096
+//Most event file descriptors that are signalled after a batch, one per worker.
+#define WAL_MAX_SUBSCRIBERS 256
+
+typedef enum wal_durability {
+    //records are written by the flusher but never synced, appends count as durable at once
+    WAL_DURABILITY_NONE,
+    //all records appended while the previous batch was written are synced with one fdatasync
+    WAL_DURABILITY_GROUP,
+    //every record is written and synced on its own
+    WAL_DURABILITY_SYNC
+} wal_durability;
+
+typedef struct wal_stats {
+    unsigned long records;
+    unsigned long batches;
+    unsigned long syncs;
+    //records recovered by wal_open and bytes cut off behind the last valid one
+    unsigned long recovered;
+    unsigned long truncated;
+} wal_stats;
+
+/**
+ * An append-only write-ahead log. Appends only copy the record into a buffer; a background
+ * flusher writes everything appended so far with one write() and one fdatasync() (group commit)
+ * while new records collect in a second buffer. A record's LSN is the file offset behind it, it
+ * is durable once the flusher has synced up to there.
+ */
+typedef struct wal {
+    int fd;
+    wal_durability durability;
+    pthread_mutex_t lock;
+    //signalled when records are appended or the log is closed
+    pthread_cond_t pending;
+    //signalled after every batch
+    pthread_cond_t synced;
+    //records not yet taken by the flusher
+    char *buffer;
+    size_t len;
+    size_t cap;
+    //the batch being written, only touched by the flusher
+    char *batch;
+    size_t batch_cap;
+    //LSN of the last appended record
+    uint64_t appended;
+    //LSN up to which the log is written and, unless WAL_DURABILITY_NONE, synced; read without the lock
+    _Atomic uint64_t durable;
+    //event file descriptors signalled after every batch, see wal_subscribe
+    int subscribers[WAL_MAX_SUBSCRIBERS];
+    size_t subscriber_count;
+    bool closing;
+    pthread_t flusher;
+    wal_stats stats;
+} wal;
+
+//Called by wal_open for every valid record, in the order they were appended.
+typedef void (*wal_replay)(void *arg, const char *record, size_t len);
+
+uint32_t wal_crc32c(const void *data, size_t len);
+
+void wal_sync_directory(const char *path);
+
+wal *wal_open(const char *path, wal_durability durability, uint64_t from, wal_replay replay, void *arg);
+
+uint64_t wal_append(wal *log, const void *record, size_t len);
+
+uint64_t wal_appended(wal *log);
+
+bool wal_is_durable(wal *log, uint64_t lsn);
+
+void wal_wait(wal *log, uint64_t lsn);
+
+bool wal_sync_to(wal *log, uint64_t lsn);
+
+int wal_subscribe(wal *log);
+
+wal_stats wal_get_stats(wal *log);
+
+void wal_close(wal *log);
+
+#endif //WAL_H
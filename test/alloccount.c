@@ -0,0 +1,52 @@
+#include <stdlib.h>
+
+#include "alloccount.h"
+
+/*
+ * The test and bench binaries are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so every
+ * allocation of the tested code goes through these functions and is counted.
+ */
+
+void *__real_malloc(size_t size);
+
+void *__real_calloc(size_t count, size_t size);
+
+void *__real_realloc(void *ptr, size_t size);
+
+static size_t allocations;
+static size_t allocated_bytes;
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    allocated_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * Returns the number of heap allocations (malloc, calloc, realloc) since the start of the program
+ * @return number of allocations
+ */
+size_t alloc_count(void) {
+    return allocations;
+}
+
+/**
+ * Returns the number of bytes requested from the heap since the start of the program. realloc
+ * counts with its new size, freed memory is not subtracted.
+ * @return number of bytes
+ */
+size_t alloc_bytes(void) {
+    return allocated_bytes;
+}
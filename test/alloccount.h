@@ -0,0 +1,10 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+#include <stddef.h>
+
+size_t alloc_count(void);
+
+size_t alloc_bytes(void);
+
+#endif //ALLOCCOUNT_H
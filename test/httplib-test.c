@@ -1,9 +1,21 @@
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
+#include "alloccount.h"
+#include "../src/arena.h"
+#include "../src/booking.h"
+#include "../src/docroot.h"
+#include "../src/filecache.h"
 #include "../src/httplib.h"
+#include "../src/scan.h"
+#include "../src/template.h"
 
 static void str_cat_test_helloworld(void);
 
@@ -39,6 +51,48 @@ static void str_format_test(void);
 
 static void str_equals_test(void);
 
+static void http_parse_request_test(void);
+
+static void http_parse_request_alloc_test(void);
+
+static void http_parse_request_limits_test(void);
+
+static void request_keep_alive_test(void);
+
+static void response_string_without_body_test(void);
+
+static void response_file_test(void);
+
+static void file_cache_test(void);
+
+static void str_builder_test(void);
+
+static void arena_test(void);
+
+static void scan_test(void);
+
+static void http_normalize_path_test(void);
+
+static void response_prepared_test(void);
+
+static void content_type_test(void);
+
+static void doc_root_test(void);
+
+static void conditional_get_test(void);
+
+static void range_test(void);
+
+static void template_test(void);
+
+static void booking_test(void);
+
+static void availability_test(void);
+
+static void wal_test(void);
+
+static void snapshot_test(void);
+
 int main(void) {
     str_cat_test_helloworld();
     str_decode_test_space();
@@ -57,6 +111,27 @@ int main(void) {
     str_to_lower_case_test();
     str_format_test();
     str_equals_test();
+    http_parse_request_test();
+    http_parse_request_alloc_test();
+    http_parse_request_limits_test();
+    request_keep_alive_test();
+    response_string_without_body_test();
+    response_file_test();
+    file_cache_test();
+    str_builder_test();
+    arena_test();
+    scan_test();
+    http_normalize_path_test();
+    response_prepared_test();
+    content_type_test();
+    doc_root_test();
+    conditional_get_test();
+    range_test();
+    template_test();
+    booking_test();
+    availability_test();
+    wal_test();
+    snapshot_test();
     printf("INFO in file %s, line %d: All httplib tests passed successfully.\n", __FILE__, __LINE__);
     return 0;
 }
@@ -215,7 +290,8 @@ static void response_string_test(void) {
     test_respo->status_code = str_cpy("http", 4);
     test_respo->status_description = str_cpy("Heinz", 5);
     test_respo->entity_header = calloc(1, sizeof(entity_header));
-    test_respo->entity_header->content_type = str_cpy("StarWars", 8);
+    string content_type = {8, "StarWars", 8};
+    test_respo->entity_header->content_type = &content_type;
     test_respo->body = str_cpy("Hello World!", 12);
 
     string *test22 = response_string(test_respo);
@@ -272,4 +348,868 @@ static void str_equals_test(void) {
     string *s2 = char_to_string("ABCD");
     assert(str_equals(s1,s2)==0);
     assert(str_equals(s1,s1));
-}
\ No newline at end of file
+}
+static void http_parse_request_test(void) {
+    char *pipelined = "GET /a HTTP/1.1\r\nHost: x\r\n\r\nPOST /b HTTP/1.1\r\ncontent-length: 3\r\n\r\nabcGET /c HTTP/1.1\r\n";
+    size_t len = strlen(pipelined);
+    http_parser parser = {0};
+    http_request_view req;
+    assert(http_parse_request(&parser, pipelined, len, &req) == HTTP_PARSE_COMPLETE);
+    size_t first = req.length;
+    assert(first == strlen("GET /a HTTP/1.1\r\nHost: x\r\n\r\n"));
+    assert(req.method.len == 3 && memcmp(req.method.str, "GET", 3) == 0);
+    assert(req.uri.len == 2 && memcmp(req.uri.str, "/a", 2) == 0);
+    assert(req.host.len == 1 && req.host.str[0] == 'x');
+    assert(req.header_count == 1);
+
+    //body not complete yet, then complete
+    assert(http_parse_request(&parser, pipelined + first, 40, &req) == HTTP_PARSE_INCOMPLETE);
+    assert(parser.header_length == 39 && parser.content_length == 3);
+    assert(http_parse_request(&parser, pipelined + first, len - first, &req) == HTTP_PARSE_COMPLETE);
+    size_t second = req.length;
+    assert(second == strlen("POST /b HTTP/1.1\r\ncontent-length: 3\r\n\r\nabc"));
+    assert(req.body.len == 3 && memcmp(req.body.str, "abc", 3) == 0);
+
+    //third request is still missing its empty line, only new bytes are searched on the next call
+    assert(http_parse_request(&parser, pipelined + first + second, len - first - second, &req)
+           == HTTP_PARSE_INCOMPLETE);
+    assert(parser.scanned == len - first - second);
+    char *rest = "GET /c HTTP/1.1\r\n\r\n";
+    assert(http_parse_request(&parser, rest, strlen(rest), &req) == HTTP_PARSE_COMPLETE);
+    assert(parser.scanned == 0);
+
+    char *invalid[] = {"GET  / HTTP/1.1\r\n\r\n", "GET /\r\n\r\n", "GET / HTTP/1.1\nHost: x\r\n\r\n",
+                       "GET / HTTP/1.1\r\nHost x\r\n\r\n", "GET / HTTP/1.1\r\n folded\r\n\r\n",
+                       "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        assert(http_parse_request(&parser, invalid[i], strlen(invalid[i]), &req) == HTTP_PARSE_INVALID);
+    }
+}
+
+static void http_parse_request_alloc_test(void) {
+    char *c = "GET /images/tux.jpg HTTP/1.1\r\nHost: localhost:31337\r\nUser-Agent: Mozilla/5.0\r\n"
+              "Accept: */*\r\nConnection: keep-alive\r\n\r\n";
+    http_parser parser = {0};
+    http_request_view req;
+    size_t before = alloc_count();
+    assert(http_parse_request(&parser, c, 20, &req) == HTTP_PARSE_INCOMPLETE);
+    assert(http_parse_request(&parser, c, strlen(c), &req) == HTTP_PARSE_COMPLETE);
+    assert(request_keep_alive(&req) == 1);
+    assert(alloc_count() == before);
+    assert(req.user_agent.len == 11 && req.header_count == 4);
+    //the counter sees allocations of the tested code
+    string *str = str_new();
+    assert(alloc_count() == before + 2);
+    str_free(str);
+}
+
+static void http_parse_request_limits_test(void) {
+    http_parser parser = {0};
+    parser.max_header = 64;
+    parser.max_body = 10;
+    http_request_view req;
+
+    //the body limit is checked as soon as the header block is complete
+    char *c1 = "POST /booking HTTP/1.1\r\nContent-Length: 11\r\n\r\n";
+    assert(http_parse_request(&parser, c1, strlen(c1), &req) == HTTP_PARSE_BODY_TOO_LARGE);
+    char *c2 = "POST /booking HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n";
+    parser.max_header = 128;
+    assert(http_parse_request(&parser, c2, strlen(c2), &req) == HTTP_PARSE_BODY_TOO_LARGE);
+    parser.max_header = 64;
+
+    //the header limit is checked before the header block is complete
+    char c3[128];
+    memset(c3, 'a', sizeof(c3));
+    memcpy(c3, "GET /", 5);
+    assert(http_parse_request(&parser, c3, 60, &req) == HTTP_PARSE_INCOMPLETE);
+    assert(http_parse_request(&parser, c3, sizeof(c3), &req) == HTTP_PARSE_HEADER_TOO_LARGE);
+    assert(parser.scanned == 0 && parser.max_header == 64 && parser.max_body == 10);
+
+    char *c4 = "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123456789";
+    assert(http_parse_request(&parser, c4, strlen(c4), &req) == HTTP_PARSE_COMPLETE);
+    assert(req.body.len == 10);
+
+    //more headers than HTTP_MAX_HEADERS
+    parser.max_header = 0;
+    string *many = char_to_string("GET / HTTP/1.1\r\n");
+    for (int i = 0; i <= HTTP_MAX_HEADERS; ++i) {
+        str_cat(many, "X: y\r\n", 6);
+    }
+    str_cat(many, "\r\n", 2);
+    assert(http_parse_request(&parser, many->str, many->len, &req) == HTTP_PARSE_HEADER_TOO_LARGE);
+    str_free(many);
+
+    //only Content-Length frames a body, a chunked body must not be read as the next request
+    char *c5 = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\nGET / HTTP/1.1\r\n\r\n";
+    assert(http_parse_request(&parser, c5, strlen(c5), &req) == HTTP_PARSE_NOT_IMPLEMENTED);
+    assert(parser.scanned == 0 && parser.header_length == 0);
+    char *c6 = "POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n";
+    assert(http_parse_request(&parser, c6, strlen(c6), &req) == HTTP_PARSE_INVALID);
+    char *c7 = "POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 20\r\n\r\nab";
+    assert(http_parse_request(&parser, c7, strlen(c7), &req) == HTTP_PARSE_INVALID);
+    char *c8 = "POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 2\r\n\r\nab";
+    assert(http_parse_request(&parser, c8, strlen(c8), &req) == HTTP_PARSE_COMPLETE && req.body.len == 2);
+}
+
+static void request_keep_alive_test(void) {
+    char *c1 = "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+    char *c2 = "GET / HTTP/1.1\r\nConnection: Close\r\n\r\n";
+    char *c3 = "GET / HTTP/1.0\r\n\r\n";
+    char *c4 = "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    char *requests[] = {c1, c2, c3, c4};
+    short expected[] = {1, 0, 0, 1};
+    for (int i = 0; i < 4; ++i) {
+        http_parser parser = {0};
+        http_request_view req;
+        assert(http_parse_request(&parser, requests[i], strlen(requests[i]), &req) == HTTP_PARSE_COMPLETE);
+        assert(request_keep_alive(&req) == expected[i]);
+    }
+}
+
+static void response_string_without_body_test(void) {
+    http_response *resp = calloc(1, sizeof(http_response));
+    resp->entity_header = calloc(1, sizeof(entity_header));
+    set_response_status(resp, char_to_string("308"), char_to_string("Permanent Redirect"));
+    resp->location = char_to_string("http://localhost:4200");
+    resp->connection = char_to_string("close");
+
+    string *str = response_string(resp);
+    char *c = "HTTP/1.1 308 Permanent Redirect\r\nLocation: http://localhost:4200\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    string *expected = str_cpy(c, strlen(c));
+    assert(str_cmp(str, expected) == 0);
+
+    str_free(str);
+    free_response(resp);
+}
+
+static void response_file_test(void) {
+    char *uri = "/images/tux.jpg";
+    char *dir = "/images";
+    size_t size = 0;
+    assert(open_file(dir, (unsigned int) strlen(dir), &size) == -1);
+    int fd = open_file(uri, (unsigned int) strlen(uri), &size);
+    assert(fd >= 0);
+    assert(size == 9883);
+
+    http_response *resp = response_new();
+    set_response_status(resp, char_to_string("200"), char_to_string("OK"));
+    set_response_file(resp, fd, size, get_content_type("jpg", 3));
+    string *header = response_header_string(resp);
+    char *c = "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: 9883\r\n\r\n";
+    string *expected = str_cpy(c, strlen(c));
+    assert(str_cmp(header, expected) == 0);
+
+    str_free(header);
+    //closes fd
+    free_response(resp);
+}
+
+static void file_cache_test(void) {
+    char *uri = "/images/tux.jpg";
+    string *path = str_cpy(uri, strlen(uri));
+    size_t size = 0;
+    file_cache *cache = file_cache_new(FILE_CACHE_DEFAULT_BUDGET);
+
+    http_response *first = response_new();
+    assert(file_cache_respond(cache, path, NULL, true, first) == 0);
+    int fd = open_file(uri, (unsigned int) strlen(uri), &size);
+    assert(file_cache_store(cache, path, fd, NULL, true, first) == 1);
+    assert(first->body->len == 9883);
+    //ETag and Last-Modified depend on the file system, only the surrounding headers are fixed
+    char *c = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Type: image/jpeg\r\nETag: \"";
+    char *tail = "GMT\r\nAccept-Ranges: bytes\r\nContent-Length: 9883\r\n\r\n";
+    const string *header = first->prepared_header;
+    assert(header->len > strlen(c) + strlen(tail) && memcmp(header->str, c, strlen(c)) == 0);
+    assert(memcmp(header->str + header->len - strlen(tail), tail, strlen(tail)) == 0);
+
+    http_response *second = response_new();
+    assert(file_cache_respond(cache, path, NULL, false, second) == 1);
+    assert(second->body == first->body);
+    assert(cache->stats.hits == 1 && cache->stats.misses == 1 && cache->stats.entries == 1);
+
+    //a matching ETag is answered with the cached 304 header block and no body
+    http_request_view request = {0};
+    file_cache_entry *entry = cache->lru_head;
+    request.if_none_match = (str_view) {entry->etag->str, entry->etag->len};
+    http_response *third = response_new();
+    assert(file_cache_respond(cache, path, &request, true, third) == 1);
+    assert(third->body == NULL && cache->stats.not_modified == 1);
+    char *not_modified = "HTTP/1.1 304 Not Modified\r\nConnection: keep-alive\r\nETag: ";
+    assert(memcmp(third->prepared_header->str, not_modified, strlen(not_modified)) == 0);
+    assert(memmem(third->prepared_header->str, third->prepared_header->len, "Content-Length", 14) == NULL);
+    free_response(third);
+
+    //entries still being sent survive the cache
+    file_cache_free(cache);
+    assert(second->body->len == 9883);
+    free_response(first);
+    free_response(second);
+    str_free(path);
+}
+
+static void str_builder_test(void) {
+    string *str = str_new();
+    for (int i = 0; i < 1000; ++i) {
+        str_cat(str, "ab", 2);
+    }
+    assert(str->len == 2000);
+    assert(str->cap >= 2000 && str->cap < 4000);
+    assert(memcmp(str->str + 1998, "ab", 2) == 0);
+    str_cat_number(str, 0);
+    str_cat_number(str, 1234567);
+    assert(str->len == 2008);
+    assert(memcmp(str->str + 2000, "01234567", 8) == 0);
+    str_free(str);
+
+    //header and body are written into a single allocation of the exact size
+    http_response *resp = response_new();
+    set_response_status(resp, char_to_string("404"), char_to_string("Not Found"));
+    set_response_default_html_body(resp);
+    assert(resp->body->len == resp->body->cap);
+    string *serialized = response_string(resp);
+    assert(serialized->len == serialized->cap);
+    str_free(serialized);
+    free_response(resp);
+}
+
+static void arena_test(void) {
+    char *c = "GET /does/not/exist.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    arena *a = arena_new(256);
+    arena *previous = arena_use(a);
+    //the first round grows the arena, afterwards the same request does not touch malloc
+    for (int round = 0; round < 3; ++round) {
+        size_t before = alloc_count();
+        http_parser parser = {0};
+        http_request_view req;
+        assert(http_parse_request(&parser, c, strlen(c), &req) == HTTP_PARSE_COMPLETE);
+        string raw_uri = {req.uri.len, (char *) req.uri.str, 0};
+        string *uri = str_decode(&raw_uri);
+        assert(validate_file_access(uri->str, (unsigned int) uri->len) == 2);
+
+        http_response *resp = response_new();
+        resp->connection = char_to_string("keep-alive");
+        set_response_status(resp, char_to_string("404"), char_to_string("Not Found"));
+        set_response_default_html_body(resp);
+        const string *content_type = content_type_for_path(uri);
+        string *serialized = response_string(resp);
+        assert(str_start_with_chars(serialized, "HTTP/1.1 404 Not Found\r\n", 24));
+        assert(arena_owns(a, serialized->str));
+
+        assert(content_type->len == 24 && memcmp(content_type->str, "text/html; charset=utf-8", 24) == 0);
+        str_free(serialized);
+        str_free(uri);
+        free_response(resp);
+        arena_reset(a);
+        if (round > 0) {
+            assert(alloc_count() == before);
+        }
+    }
+    assert(a->chunks->next == NULL);
+    arena_use(previous);
+
+    //without an arena the constructors use the heap
+    string *str = char_to_string("heap");
+    assert(!arena_owns(a, str));
+    str_free(str);
+    arena_destroy(a);
+}
+
+static void scan_test(void) {
+    //matches at every position relative to the 16 and 32 byte blocks, and in the scalar tail
+    char buf[100];
+    const scan_level initial = scan_get_level();
+    for (int level = SCAN_SCALAR; level <= SCAN_AVX2; ++level) {
+        if (!scan_set_level((scan_level) level)) {
+            continue;
+        }
+        for (size_t at = 0; at + 4 <= sizeof(buf); ++at) {
+            memset(buf, 'a', sizeof(buf));
+            memcpy(buf + at, "\r\n\r\n", 4);
+            buf[at / 2] = '\r';
+            assert(scan_header_end(buf, sizeof(buf)) == at);
+            assert(scan_header_end(buf, at + 3) == at + 3);
+
+            size_t separator;
+            memset(buf, 'a', sizeof(buf));
+            buf[at] = '\n';
+            assert(scan_line(buf, sizeof(buf), ':', &separator) == at);
+            assert(separator == at);
+            if (at >= 2) {
+                buf[at / 2 - 1] = ':';
+                buf[at / 2] = ':';
+                assert(scan_line(buf, sizeof(buf), ':', &separator) == at);
+                assert(separator == at / 2 - 1);
+                assert(scan_line(buf, at, ':', &separator) == at);
+                assert(separator == at / 2 - 1);
+            }
+            //a separator behind the newline does not count
+            memset(buf, 'a', sizeof(buf));
+            buf[at] = '\n';
+            buf[sizeof(buf) - 1] = ':';
+            assert(scan_line(buf, sizeof(buf), ':', &separator) == at);
+            assert(separator == at);
+        }
+    }
+    scan_set_level(initial);
+}
+
+static void http_normalize_path_test(void) {
+    const struct {
+        const char *in;
+        http_path_status status;
+        const char *out;
+    } cases[] = {
+            {"/index.html",                          HTTP_PATH_OK,           "/index.html"},
+            {"/images/a%20b.png",                    HTTP_PATH_OK,           "/images/a b.png"},
+            {"/index.html?v=2",                      HTTP_PATH_OK,           "/index.html"},
+            {"/a/./b/../c",                          HTTP_PATH_OK,           "/a/c"},
+            {"/a/b/..",                              HTTP_PATH_OK,           "/a/"},
+            {"/a/.",                                 HTTP_PATH_OK,           "/a/"},
+            {"/./",                                  HTTP_PATH_OK,           "/"},
+            {"/a/%2e%2E/b",                          HTTP_PATH_OK,           "/b"},
+            {"/a%2fb",                               HTTP_PATH_OK,           "/a/b"},
+            {"/..a/b..",                             HTTP_PATH_OK,           "/..a/b.."},
+            {"/%25%3F",                              HTTP_PATH_OK,           "/%?"},
+            {"/..",                                  HTTP_PATH_OUTSIDE_ROOT, NULL},
+            {"/a/../../etc/passwd",                  HTTP_PATH_OUTSIDE_ROOT, NULL},
+            {"/%2e%2e/%2e%2e/etc/passwd",            HTTP_PATH_OUTSIDE_ROOT, NULL},
+            {"/..%2fetc",                            HTTP_PATH_OUTSIDE_ROOT, NULL},
+            {"/a%2",                                 HTTP_PATH_INVALID,      NULL},
+            {"/a%zz",                                HTTP_PATH_INVALID,      NULL},
+            {"/a%00b",                               HTTP_PATH_INVALID,      NULL},
+            {"index.html",                           HTTP_PATH_INVALID,      NULL},
+            {"/aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa/%41%42/../x", HTTP_PATH_OK,
+                    "/aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa/x"},
+    };
+    char path[128];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        size_t len = strlen(cases[i].in);
+        memcpy(path, cases[i].in, len);
+        assert(http_normalize_path(path, &len) == cases[i].status);
+        if (cases[i].out != NULL) {
+            assert(len == strlen(cases[i].out) && memcmp(path, cases[i].out, len) == 0);
+        }
+    }
+    //a NUL byte in the raw URI
+    memcpy(path, "/a\0b", 4);
+    size_t len = 4;
+    assert(http_normalize_path(path, &len) == HTTP_PATH_INVALID);
+}
+
+static void response_prepared_test(void) {
+    string *serialized = char_to_string("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    arena *a = arena_new(256);
+    arena *previous = arena_use(a);
+    size_t before = alloc_count();
+    http_response *resp = response_prepared(serialized);
+    //the response is sent unchanged, nothing is built or allocated besides the response
+    assert(resp->prepared_header == serialized);
+    assert(resp->body == NULL && resp->file == NULL && resp->release == NULL);
+    assert(alloc_count() == before);
+    free_response(resp);
+    arena_use(previous);
+    arena_destroy(a);
+    //the serialized response is not owned by the response
+    assert(serialized->len == 45);
+    str_free(serialized);
+}
+
+static void content_type_test(void) {
+    const char *cases[][2] = {
+            {"/index.html",          "text/html; charset=utf-8"},
+            {"/INDEX.HTML",          "text/html; charset=utf-8"},
+            {"/app.js",              "text/javascript; charset=utf-8"},
+            {"/style.css",           "text/css; charset=utf-8"},
+            {"/test.txt",            "text/plain; charset=utf-8"},
+            {"/images/tux.jpg",      "image/jpeg"},
+            {"/icon.svg",            "image/svg+xml"},
+            {"/favicon.ico",         "image/x-icon"},
+            {"/font.woff2",          "font/woff2"},
+            {"/app.wasm",            "application/wasm"},
+            {"/data.json",           "application/json"},
+            {"/site.webmanifest",    "application/manifest+json"},
+            //exact matches only
+            {"/data.jsonp",          "application/octet-stream"},
+            {"/page.htmlx",          "application/octet-stream"},
+            {"/archive.tar.gz",      "application/gzip"},
+            {"/README",              "application/octet-stream"},
+            {"/dir.d/README",        "application/octet-stream"},
+            {"/trailing.",           "application/octet-stream"},
+            {"/long.webmanifestx",   "application/octet-stream"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        string path = {strlen(cases[i][0]), (char *) cases[i][0], 0};
+        const string *type = content_type_for_path(&path);
+        assert(type->len == strlen(cases[i][1]) && memcmp(type->str, cases[i][1], type->len) == 0);
+    }
+    //the result is static, the same string for every call
+    assert(get_content_type("png", 3) == get_content_type("PNG", 3));
+}
+
+static void doc_root_test(void) {
+    doc_root *root = doc_root_open(DOC_ROOT);
+    assert(root != NULL);
+    int fd = -1;
+    struct stat st;
+    assert(doc_root_open_file(root, "/index.html", 11, &fd, &st) == DOC_ROOT_FILE);
+    assert(fd >= 0 && st.st_size > 0);
+    close(fd);
+    //only the given length counts, the path does not have to be null terminated
+    assert(doc_root_open_file(root, "/test.txtXYZ", 9, &fd, &st) == DOC_ROOT_FILE);
+    close(fd);
+    //directories are not served
+    assert(doc_root_open_file(root, "/images", 7, &fd, &st) == DOC_ROOT_NOT_FOUND);
+    assert(doc_root_open_file(root, "/", 1, &fd, &st) == DOC_ROOT_NOT_FOUND);
+    //the second lookup of a missing file is answered from the negative cache
+    assert(doc_root_open_file(root, "/a.txt", 6, &fd, &st) == DOC_ROOT_NOT_FOUND);
+    assert(root->stats.negative_hits == 0);
+    assert(doc_root_open_file(root, "/a.txt", 6, &fd, &st) == DOC_ROOT_NOT_FOUND);
+    assert(root->stats.negative_hits == 1);
+    assert(doc_root_open_file(root, "/index.html/a", 13, &fd, &st) == DOC_ROOT_NOT_FOUND);
+    //the file exists, but outside of the root
+    char *outside = "/../test/resources/test.txt";
+    assert(doc_root_open_file(root, outside, strlen(outside), &fd, &st) == DOC_ROOT_FORBIDDEN);
+    assert(root->stats.lookups == 8);
+    doc_root_close(root);
+}
+
+static void conditional_get_test(void) {
+    http_response *resp = response_new();
+    struct stat st = {0};
+    st.st_ino = 0x1234;
+    st.st_size = 9883;
+    //Sun, 06 Nov 1994 08:49:37 GMT
+    st.st_mtim.tv_sec = 784111777;
+    st.st_mtim.tv_nsec = 5;
+    set_response_validators(resp, &st);
+    string *etag = resp->entity_header->etag;
+    assert(etag->len == 28 && memcmp(etag->str, "\"1234-269b-2ebc98a100000005\"", 28) == 0);
+    assert(resp->entity_header->last_modified->len == 29);
+    assert(memcmp(resp->entity_header->last_modified->str, "Sun, 06 Nov 1994 08:49:37 GMT", 29) == 0);
+
+    const char *cases[][3] = {
+            //If-None-Match, If-Modified-Since, expected result
+            {"",                                       "",                               "0"},
+            {"\"1234-269b-2ebc98a100000005\"",         "",                               "1"},
+            {"W/\"1234-269b-2ebc98a100000005\"",       "",                               "1"},
+            {"\"a\", \"1234-269b-2ebc98a100000005\"",  "",                               "1"},
+            {"*",                                      "",                               "1"},
+            {"\"1234-269b-2ebc98a100000004\"",         "",                               "0"},
+            {"\"1234-269b-2ebc98a100000005",           "",                               "0"},
+            //If-None-Match wins over If-Modified-Since
+            {"\"a\"",                                  "Sun, 06 Nov 1994 08:49:37 GMT",  "0"},
+            {"",                                       "Sun, 06 Nov 1994 08:49:37 GMT",  "1"},
+            {"",                                       "Mon, 07 Nov 1994 00:00:00 GMT",  "1"},
+            {"",                                       "Sun, 06 Nov 1994 08:49:36 GMT",  "0"},
+            {"",                                       "Sunday, 06-Nov-94 08:49:37 GMT", "0"},
+            {"",                                       "Sun, 06 Nov 1994 08:49:37 UTC",  "0"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        http_request_view request = {0};
+        request.if_none_match = (str_view) {cases[i][0], strlen(cases[i][0])};
+        request.if_modified_since = (str_view) {cases[i][1], strlen(cases[i][1])};
+        assert(request_not_modified(&request, etag, st.st_mtim.tv_sec) == cases[i][2][0] - '0');
+    }
+
+    set_response_not_modified(resp);
+    resp->connection = char_to_string("close");
+    string *header = response_header_string(resp);
+    char *c = "HTTP/1.1 304 Not Modified\r\nConnection: close\r\nETag: \"1234-269b-2ebc98a100000005\"\r\n\r\n";
+    assert(header->len == strlen(c) && memcmp(header->str, c, header->len) == 0);
+    str_free(header);
+    free_response(resp);
+}
+
+static void range_test(void) {
+    //Range header, expected status, expected ranges as start/length pairs for a file of 1000 bytes
+    const struct {
+        const char *range;
+        http_range_status status;
+        size_t count;
+        size_t expected[4];
+    } cases[] = {
+            {"bytes=0-499",                HTTP_RANGE_SATISFIABLE,   1, {0,   500}},
+            {"bytes=500-",                 HTTP_RANGE_SATISFIABLE,   1, {500, 500}},
+            {"bytes=-100",                 HTTP_RANGE_SATISFIABLE,   1, {900, 100}},
+            {"bytes=-5000",                HTTP_RANGE_SATISFIABLE,   1, {0,   1000}},
+            {"bytes=990-5000",             HTTP_RANGE_SATISFIABLE,   1, {990, 10}},
+            {"BYTES=0-0, -1",              HTTP_RANGE_SATISFIABLE,   2, {0,   1,  999, 1}},
+            //overlapping and adjacent ranges are coalesced and sorted
+            {"bytes=0-99, 50-149",         HTTP_RANGE_SATISFIABLE,   1, {0,   150}},
+            {"bytes=200-299,0-99,100-109", HTTP_RANGE_SATISFIABLE,   2, {0,   110, 200, 100}},
+            {"bytes=-10, 995-",            HTTP_RANGE_SATISFIABLE,   1, {990, 10}},
+            {"bytes=0-9,,20-29",           HTTP_RANGE_SATISFIABLE,   2, {0,   10, 20,  10}},
+            //unsatisfiable ranges are dropped
+            {"bytes=1000-1999",            HTTP_RANGE_UNSATISFIABLE, 0, {0}},
+            {"bytes=-0",                   HTTP_RANGE_UNSATISFIABLE, 0, {0}},
+            {"bytes=5000-, 10-19",         HTTP_RANGE_SATISFIABLE,   1, {10,  10}},
+            //invalid headers are ignored
+            {"bytes=",                     HTTP_RANGE_NONE,          0, {0}},
+            {"bytes=10-5",                 HTTP_RANGE_NONE,          0, {0}},
+            {"bytes=a-5",                  HTTP_RANGE_NONE,          0, {0}},
+            {"bytes=5",                    HTTP_RANGE_NONE,          0, {0}},
+            {"items=0-5",                  HTTP_RANGE_NONE,          0, {0}},
+            {"bytes=0-1,2-3,4-5,6-7,8-9,10-11,12-13,14-15,16-17,18-19,20-21,22-23,24-25,26-27,28-29,30-31,32-33",
+                                           HTTP_RANGE_NONE,          0, {0}},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        http_byte_range ranges[HTTP_MAX_RANGES];
+        size_t count;
+        str_view value = {cases[i].range, strlen(cases[i].range)};
+        assert(http_parse_range(value, 1000, ranges, &count) == cases[i].status);
+        assert(count == cases[i].count);
+        for (size_t j = 0; j < count; ++j) {
+            assert(ranges[j].start == cases[i].expected[2 * j] && ranges[j].length == cases[i].expected[2 * j + 1]);
+        }
+    }
+
+    //If-Range: only an exactly matching entity tag or date lets the ranges through
+    string etag = {5, "\"abc\"", 5};
+    http_request_view request = {0};
+    http_byte_range ranges[HTTP_MAX_RANGES];
+    size_t count;
+    request.range = (str_view) {"bytes=0-9", 9};
+    assert(request_ranges(&request, &etag, 784111777, 100, ranges, &count) == HTTP_RANGE_SATISFIABLE);
+    request.if_range = (str_view) {"\"abc\"", 5};
+    assert(request_ranges(&request, &etag, 784111777, 100, ranges, &count) == HTTP_RANGE_SATISFIABLE);
+    request.if_range = (str_view) {"W/\"abc\"", 7};
+    assert(request_ranges(&request, &etag, 784111777, 100, ranges, &count) == HTTP_RANGE_NONE);
+    request.if_range = (str_view) {"Sun, 06 Nov 1994 08:49:37 GMT", 29};
+    assert(request_ranges(&request, &etag, 784111777, 100, ranges, &count) == HTTP_RANGE_SATISFIABLE);
+    assert(request_ranges(&request, &etag, 784111778, 100, ranges, &count) == HTTP_RANGE_NONE);
+
+    //a single range of a borrowed body
+    string data = {10, "0123456789", 10};
+    http_response *resp = response_new();
+    resp->body = &data;
+    resp->release = free;
+    resp->owner = NULL;
+    resp->entity_header->content_type = get_content_type("txt", 3);
+    set_response_partial(resp, (http_byte_range) {2, 3}, 10);
+    assert(resp->body->len == 3 && memcmp(resp->body->str, "234", 3) == 0);
+    string *serialized = response_string(resp);
+    char *c = "HTTP/1.1 206 Partial Content\r\nContent-Type: text/plain; charset=utf-8\r\n"
+              "Content-Range: bytes 2-4/10\r\nContent-Length: 3\r\n\r\n234";
+    assert(serialized->len == strlen(c) && memcmp(serialized->str, c, serialized->len) == 0);
+    str_free(serialized);
+    free_response(resp);
+
+    //several ranges as multipart/byteranges, the body has exactly the computed size
+    resp = response_new();
+    resp->entity_header->content_type = get_content_type("txt", 3);
+    const http_byte_range parts[2] = {{0, 2}, {8, 2}};
+    assert(set_response_multipart(resp, parts, 2, 10, data.str, -1) == 1);
+    c = "\r\n--wg-byteranges-5c1e0b7d9a4f2368\r\nContent-Type: text/plain; charset=utf-8\r\n"
+        "Content-Range: bytes 0-1/10\r\n\r\n01"
+        "\r\n--wg-byteranges-5c1e0b7d9a4f2368\r\nContent-Type: text/plain; charset=utf-8\r\n"
+        "Content-Range: bytes 8-9/10\r\n\r\n89"
+        "\r\n--wg-byteranges-5c1e0b7d9a4f2368--\r\n";
+    assert(resp->body->len == strlen(c) && resp->body->len == resp->body->cap);
+    assert(memcmp(resp->body->str, c, resp->body->len) == 0);
+    assert(strncmp(resp->entity_header->content_type->str, "multipart/byteranges; boundary=", 31) == 0);
+    free_response(resp);
+
+    resp = response_new();
+    set_response_unsatisfiable(resp, 10);
+    serialized = response_string(resp);
+    c = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */10\r\nContent-Length: 0\r\n\r\n";
+    assert(serialized->len == strlen(c) && memcmp(serialized->str, c, serialized->len) == 0);
+    str_free(serialized);
+    free_response(resp);
+}
+
+static void template_test(void) {
+    static const char *const slots[] = {"method", "ressource"};
+    const char *text = "<p>${method} ${ressource}</p>${method}$ ${unknown} ${method";
+    html_template *template = template_parse(text, strlen(text), slots, 2);
+    //placeholders that are no slot stay literal text and are merged with their neighbours
+    assert(template->segment_count == 7);
+    assert(template->segments[1].slot == 0 && template->segments[3].slot == 1 && template->segments[5].slot == 0);
+    const str_view values[] = {{"GET", 3}, {"/debug?a=<b>&c=\"d\"'", 19}};
+    string *page = template_render(template, values);
+    const char *expected = "<p>GET /debug?a=&lt;b&gt;&amp;c=&quot;d&quot;&#39;</p>GET$ ${unknown} ${method";
+    assert(page->len == strlen(expected) && memcmp(page->str, expected, page->len) == 0);
+    str_free(page);
+    template_free(template);
+
+    //the template of a file is parsed again only after the file changed
+    char path[] = "/tmp/wg-template-XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0 && write(fd, "${method}!", 10) == 10);
+    template_file *file = template_file_open(path, slots, 2);
+    assert(template_file_get(file) != NULL && template_file_get(file) != NULL && file->loads == 1);
+    assert(write(fd, "!", 1) == 1);
+    page = template_render(template_file_get(file), values);
+    assert(file->loads == 2 && page->len == 5 && memcmp(page->str, "GET!!", 5) == 0);
+    str_free(page);
+    close(fd);
+    unlink(path);
+    assert(template_file_get(file) == NULL);
+    template_file_close(file);
+}
+
+/**
+ * Checks the AVL balance and the largest end of every node
+ * @return height of the subtree
+ */
+static int interval_tree_check(const booking_node *node) {
+    if (node == NULL) {
+        return 0;
+    }
+    const int left = interval_tree_check(node->left);
+    const int right = interval_tree_check(node->right);
+    assert(left - right <= 1 && right - left <= 1 && node->height == 1 + (left > right ? left : right));
+    int64_t max_end = node->booking.end;
+    max_end = node->left != NULL && node->left->max_end > max_end ? node->left->max_end : max_end;
+    max_end = node->right != NULL && node->right->max_end > max_end ? node->right->max_end : max_end;
+    assert(node->max_end == max_end);
+    return node->height;
+}
+
+static void booking_test(void) {
+    //random, overlapping intervals; queries are compared with a scan over all of them
+    enum { COUNT = 500 };
+    static booking_node nodes[COUNT];
+    interval_tree tree = {NULL, 0};
+    srand(7);
+    for (int i = 0; i < COUNT; ++i) {
+        nodes[i].booking.id = (uint64_t) i + 1;
+        nodes[i].booking.start = rand() % 10000;
+        nodes[i].booking.end = nodes[i].booking.start + 1 + rand() % 200;
+        interval_tree_insert(&tree, &nodes[i]);
+    }
+    for (int i = 0; i < COUNT; i += 3) {
+        interval_tree_remove(&tree, &nodes[i]);
+        nodes[i].booking.id = 0;
+    }
+    interval_tree_check(tree.root);
+    assert(tree.count == COUNT - (COUNT + 2) / 3);
+    for (int q = 0; q < 200; ++q) {
+        const int64_t start = rand() % 10200;
+        const int64_t end = start + 1 + rand() % 300;
+        size_t expected = 0;
+        for (int i = 0; i < COUNT; ++i) {
+            expected += nodes[i].booking.id != 0 && nodes[i].booking.start < end && nodes[i].booking.end > start;
+        }
+        const booking *found[COUNT];
+        const size_t count = interval_tree_overlaps(&tree, start, end, found, COUNT);
+        assert(count == expected && (interval_tree_first_overlap(&tree, start, end) != NULL) == (expected > 0));
+        for (size_t i = 0; i < count; ++i) {
+            assert(found[i]->start < end && found[i]->end > start);
+            assert(i == 0 || found[i - 1]->start <= found[i]->start);
+        }
+    }
+
+    //the store refuses overlapping bookings of the same resource, touching ones are fine
+    booking_store *store = booking_store_new();
+    booking created;
+    booking conflict;
+    assert(booking_resource_find("badezimmer", 10) == 1 && booking_resource_find("bad", 3) == -1);
+    assert(booking_create(store, 1, 100, 200, "Anna", 4, &created, NULL, NULL) == BOOKING_OK && created.id == 1);
+    assert(booking_create(store, 1, 150, 160, "Ben", 3, NULL, &conflict, NULL) == BOOKING_CONFLICT && conflict.id == 1);
+    assert(booking_create(store, 1, 200, 300, "Ben", 3, &created, NULL, NULL) == BOOKING_OK && created.id == 2);
+    assert(booking_create(store, 0, 150, 160, "Ben", 3, &created, NULL, NULL) == BOOKING_OK);
+    assert(booking_create(store, 1, 300, 300, "Ben", 3, NULL, NULL, NULL) == BOOKING_INVALID);
+    booking list[4];
+    assert(booking_list(store, 1, 0, 1000, list, 4) == 2 && strcmp(list[1].name, "Ben") == 0);
+    assert(booking_list(store, BOOKING_ALL_RESOURCES, 150, 201, list, 4) == 3 && list[0].resource == 0);
+    assert(booking_list(store, BOOKING_ALL_RESOURCES, 150, INT64_MAX, list, 4) == 3);
+    assert(booking_list(store, BOOKING_ALL_RESOURCES, INT64_MAX - 1, INT64_MAX, list, 4) == 0);
+    assert(booking_cancel(store, 1, &created, NULL) == BOOKING_OK && strcmp(created.name, "Anna") == 0);
+    assert(booking_cancel(store, 1, NULL, NULL) == BOOKING_NOT_FOUND);
+    assert(booking_get(store, 1, &created) == BOOKING_NOT_FOUND);
+    assert(booking_create(store, 1, 150, 160, "Ben", 3, &created, NULL, NULL) == BOOKING_OK && created.id == 4);
+    booking_store_free(store);
+}
+
+static void availability_test(void) {
+    //random bitmaps, the free runs of every kernel are compared with a scan slot by slot
+    enum { SLOTS = 3000 };
+    availability *a = availability_new(3, SLOTS);
+    srand(11);
+    for (int i = 0; i < 300; ++i) {
+        const size_t first = (size_t) (rand() % SLOTS);
+        availability_set(a, (size_t) (i % 3), first, first + 1 + (size_t) (rand() % 20), true);
+    }
+    const unsigned int resources[] = {0, 2};
+    const scan_level best = scan_get_level();
+    const scan_level levels[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l) {
+        if (!scan_set_level(levels[l])) {
+            continue;
+        }
+        for (int q = 0; q < 50; ++q) {
+            const size_t first = (size_t) (rand() % SLOTS);
+            const size_t end = first + (size_t) (rand() % 1500);
+            const size_t length = 1 + (size_t) (rand() % 8);
+            availability_run runs[SLOTS];
+            const size_t count = availability_find(a, resources, 2, first, end, length, runs, SLOTS);
+            size_t expected = 0;
+            for (size_t slot = first; slot < end && slot < SLOTS;) {
+                size_t run = slot;
+                while (run < end && !availability_occupied(a, 0, run) && !availability_occupied(a, 2, run)) {
+                    run++;
+                }
+                if (run - slot >= length) {
+                    assert(expected < count && runs[expected].first == slot && runs[expected].count == run - slot);
+                    expected++;
+                }
+                slot = run > slot ? run : slot + 1;
+            }
+            assert(count == expected);
+        }
+    }
+    scan_set_level(best);
+    availability_free(a);
+
+    //bookings occupy every slot they touch, a shared slot stays occupied after one is cancelled
+    booking_store *store = booking_store_new();
+    booking created;
+    assert(booking_create(store, 2, 1000, 2000, "Anna", 4, &created, NULL, NULL) == BOOKING_OK);
+    assert(booking_create(store, 2, 2000, 3600, "Ben", 3, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_create(store, 3, 5400, 6300, "Ben", 3, NULL, NULL, NULL) == BOOKING_OK);
+    const unsigned int both[] = {2, 3};
+    booking_window windows[4];
+    assert(booking_free_slots(store, both, 2, 0, 9000, 900, windows, 4) == 3);
+    assert(windows[0].start == 0 && windows[0].end == 900 && windows[1].start == 3600 && windows[1].end == 5400);
+    assert(windows[2].start == 6300 && windows[2].end == 9000);
+    assert(booking_free_slots(store, both, 2, 0, 9000, 1801, windows, 4) == 1 && windows[0].start == 6300);
+    assert(booking_free_slots(store, both, 2, INT64_MAX - 1, INT64_MAX, 900, windows, 4) == 0);
+    assert(booking_free_slots(store, both, 2, BOOKING_MAX_END - 900, INT64_MAX, 900, windows, 4) == 1);
+    assert(booking_cancel(store, created.id, NULL, NULL) == BOOKING_OK);
+    assert(availability_occupied(store->slots, 2, 2) && !availability_occupied(store->slots, 2, 1));
+    assert(booking_free_slots(store, both, 1, 0, 9000, 900, windows, 4) == 2 && windows[0].end == 1800);
+    booking_store_free(store);
+}
+
+/**
+ * Counts the records wal_open replays, all of them are "entry"
+ */
+static void wal_count_record(void *arg, const char *record, size_t len) {
+    size_t *seen = arg;
+    assert(len == 5 && memcmp(record, "entry", 5) == 0);
+    (*seen)++;
+}
+
+static void wal_test(void) {
+    assert(wal_crc32c("123456789", 9) == 0xE3069283u);
+
+    char path[] = "/tmp/wg-wal-XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    size_t seen = 0;
+    wal *log = wal_open(path, WAL_DURABILITY_GROUP, 0, wal_count_record, &seen);
+    assert(log != NULL && seen == 0);
+    const uint64_t first = wal_append(log, "entry", 5);
+    const uint64_t second = wal_append(log, "entry", 5);
+    assert(first == WAL_RECORD_HEADER + 5 && second == 2 * first && wal_is_durable(log, 0));
+    wal_wait(log, second);
+    assert(wal_is_durable(log, second) && wal_get_stats(log).records == 2);
+    wal_close(log);
+
+    //a torn record at the end is cut off, the records before it are replayed
+    assert(lseek(fd, 0, SEEK_END) == (off_t) (2 * first) && write(fd, "\x05\0\0\0\0\0\0\0ent", 11) == 11);
+    log = wal_open(path, WAL_DURABILITY_SYNC, 0, wal_count_record, &seen);
+    assert(log != NULL && seen == 2 && wal_get_stats(log).recovered == 2 && wal_get_stats(log).truncated == 11);
+    wal_wait(log, wal_append(log, "entry", 5));
+    assert(lseek(fd, 0, SEEK_END) == (off_t) (3 * (WAL_RECORD_HEADER + 5)));
+    wal_close(log);
+    close(fd);
+
+    //bookings and cancellations survive reopening the store
+    assert(truncate(path, 0) == 0);
+    booking_store *store = booking_store_new();
+    assert(booking_store_open_log(store, path, WAL_DURABILITY_GROUP));
+    booking created;
+    uint64_t lsn = 0;
+    assert(booking_create(store, 1, 100, 200, "Anna", 4, &created, NULL, &lsn) == BOOKING_OK && lsn > 0);
+    assert(booking_create(store, 1, 200, 300, "Ben", 3, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_cancel(store, created.id, NULL, &lsn) == BOOKING_OK);
+    wal_wait(store->log, lsn);
+    booking_store_free(store);
+    store = booking_store_new();
+    assert(booking_store_open_log(store, path, WAL_DURABILITY_NONE));
+    booking found;
+    assert(booking_get(store, 1, &found) == BOOKING_NOT_FOUND && booking_get(store, 2, &found) == BOOKING_OK);
+    assert(strcmp(found.name, "Ben") == 0 && found.start == 200 && found.end == 300);
+    assert(availability_occupied(store->slots, 1, 0));
+    assert(booking_create(store, 1, 250, 260, "C", 1, NULL, NULL, NULL) == BOOKING_CONFLICT);
+    assert(booking_create(store, 1, 0, 100, "C", 1, &created, NULL, NULL) == BOOKING_OK && created.id == 3);
+    booking_store_free(store);
+    unlink(path);
+}
+
+static void snapshot_test(void) {
+    char log_path[] = "/tmp/wg-snapshot-log-XXXXXX";
+    char path[] = "/tmp/wg-snapshot-XXXXXX";
+    close(mkstemp(log_path));
+    close(mkstemp(path));
+
+    //ids 1 to 4, id 2 is cancelled before the snapshot
+    booking_store *store = booking_store_new();
+    assert(booking_store_open_log(store, log_path, WAL_DURABILITY_NONE));
+    assert(booking_create(store, 1, 1000, 2000, "Anna", 4, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_create(store, 1, 2000, 3000, "Ben", 3, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_create(store, 0, 1000, 1800, "Carla", 5, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_create(store, 1, 5000, 6000, "Dora", 4, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_cancel(store, 2, NULL, NULL) == BOOKING_OK);
+    assert(booking_store_snapshot(store, path));
+    //behind the snapshot: id 5 in between, id 1 cancelled
+    assert(booking_create(store, 1, 3000, 4000, "Emil", 4, NULL, NULL, NULL) == BOOKING_OK);
+    assert(booking_cancel(store, 1, NULL, NULL) == BOOKING_OK);
+    booking_store_free(store);
+
+    store = booking_store_new();
+    assert(booking_store_open_snapshot(store, path) && store->base->header->record_count == 3);
+    assert(store->base->header->resource_start[1] == 1 && store->base->header->resource_start[2] == 3);
+    assert(booking_store_open_log(store, log_path, WAL_DURABILITY_NONE) && wal_get_stats(store->log).recovered == 2);
+    booking found;
+    assert(booking_get(store, 1, &found) == BOOKING_NOT_FOUND && booking_get(store, 2, &found) == BOOKING_NOT_FOUND);
+    assert(booking_get(store, 4, &found) == BOOKING_OK && found.resource == 1 && strcmp(found.name, "Dora") == 0);
+    assert(booking_get(store, 5, &found) == BOOKING_OK && found.start == 3000);
+    booking list[4];
+    assert(booking_list(store, BOOKING_ALL_RESOURCES, 0, 10000, list, 4) == 3);
+    assert(list[0].id == 3 && list[1].id == 5 && list[2].id == 4);
+    assert(booking_list(store, 1, 0, 10000, list, 1) == 1 && list[0].id == 5);
+    assert(booking_create(store, 1, 5500, 5600, "F", 1, NULL, &found, NULL) == BOOKING_CONFLICT && found.id == 4);
+    assert(booking_create(store, 1, 1000, 2000, "F", 1, &found, NULL, NULL) == BOOKING_OK && found.id == 6);
+    assert(availability_occupied(store->slots, 0, 1) && !availability_occupied(store->slots, 0, 2));
+    assert(booking_cancel(store, 3, NULL, NULL) == BOOKING_OK && !availability_occupied(store->slots, 0, 1));
+
+    //a snapshot of a store with a base merges both, it replaces the mapped one
+    assert(booking_store_snapshot(store, path));
+    booking_store_free(store);
+    store = booking_store_new();
+    assert(booking_store_open_snapshot(store, path) && store->base->header->record_count == 3);
+    assert(booking_store_open_log(store, log_path, WAL_DURABILITY_NONE) && wal_get_stats(store->log).recovered == 0);
+    assert(booking_list(store, 1, 0, 10000, list, 4) == 3 && list[0].id == 6 && list[1].id == 5 && list[2].id == 4);
+    assert(booking_get(store, 3, &found) == BOOKING_NOT_FOUND && store->last_id == 6);
+    booking_store_free(store);
+
+    //a log that lost records the snapshot contains is replayed from its start without the snapshot
+    //creates are 27 bytes and the name, so the log keeps Anna and Ben
+    assert(truncate(log_path, 2 * WAL_RECORD_HEADER + 27 + 4 + 27 + 3) == 0);
+    assert(wal_open(log_path, WAL_DURABILITY_NONE, 100, NULL, NULL) == NULL && errno == EINVAL);
+    store = booking_store_new();
+    assert(booking_store_open_snapshot(store, path));
+    assert(booking_store_open_log(store, log_path, WAL_DURABILITY_NONE) && store->base == NULL);
+    assert(wal_get_stats(store->log).recovered == 2 && store->last_id == 2);
+    assert(booking_list(store, BOOKING_ALL_RESOURCES, 0, 10000, list, 4) == 2 && list[1].id == 2);
+    assert(!availability_occupied(store->slots, 1, 5) && availability_occupied(store->slots, 1, 2));
+    assert(booking_create(store, 0, 1000, 1800, "Carla", 5, &found, NULL, NULL) == BOOKING_OK && found.id == 3);
+
+    //a snapshot that can't be written leaves the store as it was
+    assert(!booking_store_snapshot(store, "/nonexistent/wg-snapshot") && errno == ENOENT);
+    assert(booking_get(store, 3, &found) == BOOKING_OK);
+    booking_store_free(store);
+
+    //a damaged header is rejected
+    const int fd = open(path, O_WRONLY);
+    assert(fd >= 0 && pwrite(fd, "X", 1, 0) == 1);
+    close(fd);
+    store = booking_store_new();
+    assert(!booking_store_open_snapshot(store, path) && errno == EINVAL);
+    booking_store_free(store);
+    unlink(path);
+    unlink(log_path);
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Generates src/mimetable.h, the perfect-hashed extension -> MIME type table of httplib.c.
+
+Usage: tools/gen_mime_table.py > src/mimetable.h
+
+Every extension lands in its own slot of a table with 2^TABLE_BITS entries. The hash is FNV-1a
+over the lower case extension, started from a seed that this script searches until there are no
+collisions. get_content_type() in httplib.c has to compute the same hash.
+"""
+
+TABLE_BITS = 7
+MAX_EXTENSION = 11
+
+TEXT = "; charset=utf-8"
+
+TYPES = [
+    ("html", "text/html" + TEXT),
+    ("htm", "text/html" + TEXT),
+    ("css", "text/css" + TEXT),
+    ("js", "text/javascript" + TEXT),
+    ("mjs", "text/javascript" + TEXT),
+    ("txt", "text/plain" + TEXT),
+    ("csv", "text/csv" + TEXT),
+    ("md", "text/markdown" + TEXT),
+    ("xml", "application/xml"),
+    ("json", "application/json"),
+    ("map", "application/json"),
+    ("webmanifest", "application/manifest+json"),
+    ("wasm", "application/wasm"),
+    ("pdf", "application/pdf"),
+    ("zip", "application/zip"),
+    ("gz", "application/gzip"),
+    ("png", "image/png"),
+    ("jpg", "image/jpeg"),
+    ("jpeg", "image/jpeg"),
+    ("gif", "image/gif"),
+    ("webp", "image/webp"),
+    ("avif", "image/avif"),
+    ("svg", "image/svg+xml"),
+    ("ico", "image/x-icon"),
+    ("bmp", "image/bmp"),
+    ("woff", "font/woff"),
+    ("woff2", "font/woff2"),
+    ("ttf", "font/ttf"),
+    ("otf", "font/otf"),
+    ("mp3", "audio/mpeg"),
+    ("ogg", "audio/ogg"),
+    ("wav", "audio/wav"),
+    ("mp4", "video/mp4"),
+    ("webm", "video/webm"),
+]
+
+
+def slot(extension, seed):
+    h = seed
+    for c in extension.encode():
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h >> (32 - TABLE_BITS)
+
+
+def find_seed():
+    for seed in range(1, 1 << 32):
+        slots = {slot(extension, seed) for extension, _ in TYPES}
+        if len(slots) == len(TYPES):
+            return seed
+    raise SystemExit("no seed found, increase TABLE_BITS")
+
+
+def main():
+    assert all(len(e) <= MAX_EXTENSION and e == e.lower() for e, _ in TYPES)
+    seed = find_seed()
+    entries = sorted((slot(e, seed), e, t) for e, t in TYPES)
+    print("//Generated by tools/gen_mime_table.py, do not edit.")
+    print("#ifndef MIMETABLE_H")
+    print("#define MIMETABLE_H")
+    print()
+    print(f"#define MIME_TABLE_BITS {TABLE_BITS}")
+    print(f"#define MIME_HASH_SEED 0x{seed:08x}u")
+    print(f"#define MIME_MAX_EXTENSION {MAX_EXTENSION}")
+    print()
+    print("static const mime_type mime_table[1 << MIME_TABLE_BITS] = {")
+    for index, extension, mime in entries:
+        print(f'        [{index}] = {{"{extension}", {len(extension)}, '
+              f'{{{len(mime)}, "{mime}", 0}}}},')
+    print("};")
+    print()
+    print("#endif //MIMETABLE_H")
+
+
+if __name__ == "__main__":
+    main()